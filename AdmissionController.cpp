@@ -0,0 +1,325 @@
+/**
+ * @file AdmissionController.cpp
+ * @brief Implementation of per-user / per-room rate limiting
+ */
+
+#include "AdmissionController.h"
+#include "ChatRoom.h"
+#include "Users.h"
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+struct LiveControllers
+{
+    mutex lock;
+    vector<AdmissionController*> all;
+};
+
+// Never destroyed: static users may be destroyed during exit
+LiveControllers& liveControllers()
+{
+    static LiveControllers* instance = new LiveControllers();
+    return *instance;
+}
+
+} // namespace
+
+AdmissionController::AdmissionController(const Config& limits)
+    : config(limits),
+      userInterval(limits.userRate > 0 ? static_cast<int64_t>(1e9 / limits.userRate) : 0),
+      roomInterval(limits.roomRate > 0 ? static_cast<int64_t>(1e9 / limits.roomRate) : 0),
+      inFlight(0), admitted(0), rejectedUser(0), rejectedRoom(0),
+      rejectedConcurrency(0), queued(0), dropped(0), deferredCount(0)
+{
+    LiveControllers& live = liveControllers();
+    lock_guard<mutex> hold(live.lock);
+    live.all.push_back(this);
+}
+
+AdmissionController::~AdmissionController()
+{
+    LiveControllers& live = liveControllers();
+    lock_guard<mutex> hold(live.lock);
+    live.all.erase(find(live.all.begin(), live.all.end(), this));
+}
+
+int64_t AdmissionController::nowNs()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+AdmissionController::Verdict AdmissionController::tryAdmit(Users* user, ChatRoom* room)
+{
+    int64_t now = nowNs();
+
+    // Cheapest, most selective check first: a flooding user is stopped here
+    // without touching the shared room bucket or in-flight counter
+    if (!user->getSendBucket().tryAcquire(now, userInterval, config.userBurst))
+    {
+        return USER_LIMITED;
+    }
+    if (!room->getSendBucket().tryAcquire(now, roomInterval, config.roomBurst))
+    {
+        user->getSendBucket().refund(userInterval);
+        return ROOM_LIMITED;
+    }
+    if (config.maxInFlight > 0)
+    {
+        if (inFlight.fetch_add(1, memory_order_acquire) >= config.maxInFlight)
+        {
+            inFlight.fetch_sub(1, memory_order_release);
+            user->getSendBucket().refund(userInterval);
+            room->getSendBucket().refund(roomInterval);
+            return CONCURRENCY_LIMITED;
+        }
+    }
+    return ADMITTED;
+}
+
+AdmissionResult AdmissionController::admit(Users* user, ChatRoom* room, const string& message, uint64_t messageId)
+{
+    return admit(user, room, message, MessageVisibility(), messageId);
+}
+
+AdmissionResult AdmissionController::admit(Users* user, ChatRoom* room, const string& message,
+                                           const MessageVisibility& visibility, uint64_t messageId)
+{
+    switch (tryAdmit(user, room))
+    {
+    case ADMITTED:
+        admitted.fetch_add(1, memory_order_relaxed);
+        return ADMIT_NOW;
+    case USER_LIMITED:
+        rejectedUser.fetch_add(1, memory_order_relaxed);
+        break;
+    case ROOM_LIMITED:
+        rejectedRoom.fetch_add(1, memory_order_relaxed);
+        break;
+    case CONCURRENCY_LIMITED:
+        rejectedConcurrency.fetch_add(1, memory_order_relaxed);
+        break;
+    }
+
+    if (config.policy == QUEUE)
+    {
+        lock_guard<mutex> lock(deferredMutex);
+        deque<Deferred>& parked = deferred[user];
+        if (parked.size() < config.maxQueuedPerUser && deferredCount < config.maxQueued)
+        {
+            if (parked.empty())
+            {
+                senders.push_back(user);
+            }
+            Deferred entry = { user, room, message, messageId, visibility };
+            parked.push_back(entry);
+            deferredCount++;
+            queued.fetch_add(1, memory_order_relaxed);
+            return ADMIT_QUEUED;
+        }
+        if (parked.empty())
+        {
+            deferred.erase(user);
+        }
+        dropped.fetch_add(1, memory_order_relaxed);
+    }
+    return ADMIT_SHED;
+}
+
+AdmissionResult AdmissionController::admitBroadcast(Users* user, const vector<ChatRoom*>& rooms)
+{
+    int64_t now = nowNs();
+    if (!user->getSendBucket().tryAcquire(now, userInterval, config.userBurst))
+    {
+        rejectedUser.fetch_add(1, memory_order_relaxed);
+        return ADMIT_SHED;
+    }
+    for (size_t i = 0; i < rooms.size(); i++)
+    {
+        if (!rooms[i]->getSendBucket().tryAcquire(now, roomInterval, config.roomBurst))
+        {
+            // All or none: give back what the earlier rooms and the user gave
+            for (size_t j = 0; j < i; j++)
+            {
+                rooms[j]->getSendBucket().refund(roomInterval);
+            }
+            user->getSendBucket().refund(userInterval);
+            rejectedRoom.fetch_add(1, memory_order_relaxed);
+            return ADMIT_SHED;
+        }
+    }
+    if (config.maxInFlight > 0 && inFlight.fetch_add(1, memory_order_acquire) >= config.maxInFlight)
+    {
+        inFlight.fetch_sub(1, memory_order_release);
+        for (ChatRoom* room : rooms)
+        {
+            room->getSendBucket().refund(roomInterval);
+        }
+        user->getSendBucket().refund(userInterval);
+        rejectedConcurrency.fetch_add(1, memory_order_relaxed);
+        return ADMIT_SHED;
+    }
+    admitted.fetch_add(1, memory_order_relaxed);
+    return ADMIT_NOW;
+}
+
+void AdmissionController::release()
+{
+    if (config.maxInFlight > 0)
+    {
+        inFlight.fetch_sub(1, memory_order_release);
+    }
+}
+
+size_t AdmissionController::drainDeferred()
+{
+    size_t delivered = 0;
+    size_t passedOver = 0; // senders skipped since the last delivery
+    for (;;)
+    {
+        Deferred entry;
+        {
+            lock_guard<mutex> lock(deferredMutex);
+            if (senders.empty() || passedOver >= senders.size())
+            {
+                break;
+            }
+            Users* sender = senders.front();
+            senders.pop_front();
+            deque<Deferred>& parked = deferred[sender];
+            // A retry may have been admitted while this copy was parked
+            while (!parked.empty() && parked.front().messageId != 0 &&
+                   parked.front().room->isDuplicateMessage(sender, parked.front().messageId))
+            {
+                parked.pop_front();
+                deferredCount--;
+            }
+            if (parked.empty())
+            {
+                deferred.erase(sender);
+                continue;
+            }
+            Verdict verdict = tryAdmit(sender, parked.front().room);
+            if (verdict == CONCURRENCY_LIMITED)
+            {
+                senders.push_front(sender); // keeps its turn
+                break;
+            }
+            if (verdict != ADMITTED)
+            {
+                // This sender's bucket (or its head room's) is empty: let the others go
+                senders.push_back(sender);
+                passedOver++;
+                continue;
+            }
+            entry = parked.front();
+            parked.pop_front();
+            deferredCount--;
+            if (parked.empty())
+            {
+                deferred.erase(sender);
+            }
+            else
+            {
+                senders.push_back(sender);
+            }
+            passedOver = 0;
+        }
+        admitted.fetch_add(1, memory_order_relaxed);
+        if (entry.visibility.scope == MessageVisibility::ROOM)
+        {
+            entry.user->dispatch(entry.message, entry.room, entry.messageId);
+        }
+        else
+        {
+            entry.user->dispatchTargeted(entry.message, entry.room, entry.visibility, entry.messageId);
+        }
+        release();
+        delivered++;
+    }
+    return delivered;
+}
+
+void AdmissionController::dropUser(const Users* user)
+{
+    lock_guard<mutex> lock(deferredMutex);
+    unordered_map<Users*, deque<Deferred> >::iterator own = deferred.find(const_cast<Users*>(user));
+    if (own != deferred.end())
+    {
+        dropped.fetch_add(own->second.size(), memory_order_relaxed);
+        deferredCount -= own->second.size();
+        deferred.erase(own);
+        senders.erase(find(senders.begin(), senders.end(), user));
+    }
+    // Other senders' targeted sends to the user still go to everyone else
+    for (auto& parked : deferred)
+    {
+        for (Deferred& entry : parked.second)
+        {
+            entry.visibility.forget(user);
+        }
+    }
+}
+
+void AdmissionController::dropRoom(const ChatRoom* room)
+{
+    lock_guard<mutex> lock(deferredMutex);
+    for (auto parked = deferred.begin(); parked != deferred.end();)
+    {
+        deque<Deferred>& entries = parked->second;
+        size_t before = entries.size();
+        entries.erase(remove_if(entries.begin(), entries.end(),
+                                [room](const Deferred& entry) { return entry.room == room; }),
+                      entries.end());
+        dropped.fetch_add(before - entries.size(), memory_order_relaxed);
+        deferredCount -= before - entries.size();
+        if (entries.empty())
+        {
+            senders.erase(find(senders.begin(), senders.end(), parked->first));
+            parked = deferred.erase(parked);
+        }
+        else
+        {
+            ++parked;
+        }
+    }
+}
+
+void AdmissionController::dropUserEverywhere(const Users* user)
+{
+    LiveControllers& live = liveControllers();
+    lock_guard<mutex> hold(live.lock);
+    for (AdmissionController* controller : live.all)
+    {
+        controller->dropUser(user);
+    }
+}
+
+AdmissionStats AdmissionController::getStats() const
+{
+    AdmissionStats stats;
+    stats.admitted = admitted.load(memory_order_relaxed);
+    stats.rejectedUser = rejectedUser.load(memory_order_relaxed);
+    stats.rejectedRoom = rejectedRoom.load(memory_order_relaxed);
+    stats.rejectedConcurrency = rejectedConcurrency.load(memory_order_relaxed);
+    stats.queued = queued.load(memory_order_relaxed);
+    stats.dropped = dropped.load(memory_order_relaxed);
+    return stats;
+}
+
+size_t AdmissionController::getQueuedCount() const
+{
+    lock_guard<mutex> lock(deferredMutex);
+    return deferredCount;
+}
+
+int AdmissionController::getInFlight() const
+{
+    return inFlight.load(memory_order_relaxed);
+}
+
@@ -0,0 +1,272 @@
+/**
+ * @file AdmissionController.h
+ * @brief Rate limiting and admission control for Users::send
+ */
+
+#ifndef ADMISSIONCONTROLLER_H
+#define ADMISSIONCONTROLLER_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "MessageVisibility.h"
+
+using namespace std;
+
+class ChatRoom;
+class Users;
+
+/**
+ * @class TokenBucket
+ * @brief Lock-free token bucket state
+ *
+ * Implemented as a GCRA (virtual scheduling) bucket: the only state is
+ * the theoretical arrival time of the next message, updated with a
+ * single compare-and-swap. Rate and burst are supplied by the caller so
+ * one controller's configuration applies to every bucket it checks.
+ */
+class TokenBucket
+{
+private:
+    atomic<int64_t> arrival;
+
+public:
+    TokenBucket() : arrival(0) {}
+
+    /**
+     * @brief Try to take one token
+     * @param nowNs Current time in nanoseconds
+     * @param intervalNs Nanoseconds per token (0 means unlimited)
+     * @param burst Maximum number of tokens that can be taken back to back
+     * @return true if a token was taken
+     */
+    bool tryAcquire(int64_t nowNs, int64_t intervalNs, int64_t burst) {
+        if (intervalNs <= 0) {
+            return true;
+        }
+        int64_t current = arrival.load(memory_order_relaxed);
+        for (;;) {
+            int64_t next = (current > nowNs ? current : nowNs) + intervalNs;
+            if (next - nowNs > burst * intervalNs) {
+                return false;
+            }
+            if (arrival.compare_exchange_weak(current, next, memory_order_relaxed)) {
+                return true;
+            }
+        }
+    }
+
+    /**
+     * @brief Give back a token taken by tryAcquire
+     * @param intervalNs Nanoseconds per token used when acquiring
+     */
+    void refund(int64_t intervalNs) {
+        if (intervalNs > 0) {
+            arrival.fetch_sub(intervalNs, memory_order_relaxed);
+        }
+    }
+};
+
+/**
+ * @enum AdmissionResult
+ * @brief What admission control did with a send
+ */
+enum AdmissionResult
+{
+    ADMIT_NOW,      // deliver now; a fan-out slot is held until release()
+    ADMIT_QUEUED,   // parked; drainDeferred() delivers it later
+    ADMIT_SHED      // refused (SHED policy, or the sender's queue is full)
+};
+
+/**
+ * @struct AdmissionStats
+ * @brief Snapshot of admission counters
+ */
+struct AdmissionStats
+{
+    uint64_t admitted;
+    uint64_t rejectedUser;        // per-user bucket empty
+    uint64_t rejectedRoom;        // per-room bucket empty
+    uint64_t rejectedConcurrency; // too many fan-outs in flight
+    uint64_t queued;              // parked for a later drainDeferred()
+    uint64_t dropped;             // a deferred queue full, or its sender or room destroyed
+
+    uint64_t rejected() const {
+        return rejectedUser + rejectedRoom + rejectedConcurrency;
+    }
+};
+
+/**
+ * @class AdmissionController
+ * @brief Decides whether a send may fan out now
+ *
+ * Attach one controller to any number of rooms with
+ * ChatRoom::setAdmissionController(). Each send must take a token from
+ * the sender's bucket and the room's bucket, and a slot from the global
+ * in-flight limit. Rejected sends are either shed or, in QUEUE mode,
+ * parked and retried by drainDeferred().
+ *
+ * Parked sends wait in one FIFO per sender, and drainDeferred() visits
+ * the senders round-robin: a sender whose own bucket is still empty is
+ * passed over, so a flooding user neither blocks nor (thanks to the
+ * per-user bound) crowds out the polite users queued behind it.
+ *
+ * admit() and release() are safe to call from several threads.
+ * Controllers register themselves so that ~Users can purge a user's
+ * parked sends from all of them (dropUserEverywhere).
+ */
+class AdmissionController
+{
+public:
+    enum OverloadPolicy { SHED, QUEUE };
+
+    /**
+     * @struct Config
+     * @brief Limits applied by the controller (a rate of 0 disables that limit)
+     */
+    struct Config
+    {
+        double userRate;       // messages per second per user
+        int userBurst;
+        double roomRate;       // messages per second per room
+        int roomBurst;
+        int maxInFlight;       // concurrent fan-outs across all rooms (0 = unlimited)
+        OverloadPolicy policy;
+        size_t maxQueued;      // parked sends across all users in QUEUE mode
+        size_t maxQueuedPerUser;
+
+        Config()
+            : userRate(0), userBurst(1), roomRate(0), roomBurst(1),
+              maxInFlight(0), policy(SHED), maxQueued(1024), maxQueuedPerUser(16) {}
+    };
+
+    /**
+     * @brief Constructor
+     * @param limits The limits to enforce
+     */
+    AdmissionController(const Config& limits);
+    ~AdmissionController();
+
+    /**
+     * @brief Try to admit a send; on success a fan-out slot is held until release()
+     * @param user The sender
+     * @param room The target room
+     * @param message The message (kept only if the send is queued)
+     * @param messageId Client message ID (kept only if the send is queued)
+     * @return ADMIT_NOW if the caller may deliver now
+     */
+    AdmissionResult admit(Users* user, ChatRoom* room, const string& message, uint64_t messageId = 0);
+
+    /**
+     * @brief admit() for a targeted send; a queued send keeps its audience
+     * @param user The sender
+     * @param room The target room
+     * @param message The message (kept only if the send is queued)
+     * @param visibility The resolved audience (kept only if the send is queued)
+     * @param messageId Client message ID (kept only if the send is queued)
+     * @return ADMIT_NOW if the caller may deliver now
+     */
+    AdmissionResult admit(Users* user, ChatRoom* room, const string& message, const MessageVisibility& visibility,
+                          uint64_t messageId = 0);
+
+    /**
+     * @brief Admit one broadcast to several of this controller's rooms, all or none
+     * @param user The sender
+     * @param rooms The target rooms (no duplicates)
+     * @return ADMIT_NOW (one slot held until release()) or ADMIT_SHED
+     *
+     * A broadcast is one post: it takes one token from the sender's bucket,
+     * one from each room's bucket and one in-flight slot. It is never
+     * parked, since a drained copy could only be delivered room by room,
+     * and members in several rooms would get it more than once.
+     */
+    AdmissionResult admitBroadcast(Users* user, const vector<ChatRoom*>& rooms);
+
+    /**
+     * @brief Release the fan-out slot taken by a successful admit()
+     */
+    void release();
+
+    /**
+     * @brief Retry queued sends that can now be admitted
+     * @return Number of queued sends delivered
+     *
+     * Each sender's sends go out in arrival order; senders take turns.
+     * Stops when the in-flight limit is reached or no sender can go.
+     */
+    size_t drainDeferred();
+
+    /**
+     * @brief Discard a user's queued sends (it is being destroyed)
+     * @param user The user
+     */
+    void dropUser(const Users* user);
+
+    /**
+     * @brief Discard queued sends to a room (called when it is destroyed)
+     * @param room The room
+     */
+    void dropRoom(const ChatRoom* room);
+
+    /**
+     * @brief dropUser() on every live controller (called by ~Users)
+     * @param user The user
+     */
+    static void dropUserEverywhere(const Users* user);
+
+    /**
+     * @brief Get a snapshot of the counters
+     * @return Current admission statistics
+     */
+    AdmissionStats getStats() const;
+
+    /**
+     * @brief Get the number of sends waiting in the deferred queues
+     * @return Parked sends across all users
+     */
+    size_t getQueuedCount() const;
+
+    /**
+     * @brief Get the number of fan-outs currently in flight
+     * @return In-flight count
+     */
+    int getInFlight() const;
+
+private:
+    struct Deferred
+    {
+        Users* user;
+        ChatRoom* room;
+        string message;
+        uint64_t messageId;
+        MessageVisibility visibility;   // ROOM for an ordinary send
+    };
+
+    enum Verdict { ADMITTED, USER_LIMITED, ROOM_LIMITED, CONCURRENCY_LIMITED };
+
+    Verdict tryAdmit(Users* user, ChatRoom* room);
+    static int64_t nowNs();
+
+    Config config;
+    int64_t userInterval;
+    int64_t roomInterval;
+    atomic<int> inFlight;
+
+    atomic<uint64_t> admitted;
+    atomic<uint64_t> rejectedUser;
+    atomic<uint64_t> rejectedRoom;
+    atomic<uint64_t> rejectedConcurrency;
+    atomic<uint64_t> queued;
+    atomic<uint64_t> dropped;
+
+    mutable mutex deferredMutex;
+    unordered_map<Users*, deque<Deferred> > deferred;  // per sender, arrival order
+    deque<Users*> senders;                              // senders with parked sends, next turn first
+    size_t deferredCount;
+};
+
+#endif
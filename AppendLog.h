@@ -0,0 +1,112 @@
+/**
+ * @file AppendLog.h
+ * @brief Single-writer, many-reader append-only log in fixed segments
+ */
+
+#ifndef APPENDLOG_H
+#define APPENDLOG_H
+
+#include <atomic>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * @class AppendLog
+ * @brief Append-only sequence whose elements never move
+ * @tparam T Element type (default constructible, copy assignable)
+ * @tparam BASE Size of the first segment; segment k holds BASE << k elements
+ *
+ * Storage grows by adding segments of doubling size, so a push_back
+ * never reallocates and a reference to an element stays valid for the
+ * log's lifetime. One thread may append; any number of threads may read
+ * elements below size() concurrently without locks. The writer fills an
+ * element before publishing the new size with a release store, and
+ * readers acquire size() before reading, so they always see a complete,
+ * consistent prefix.
+ */
+template <typename T, size_t BASE = 64>
+class AppendLog
+{
+private:
+    static const int SEGMENTS = 40; // BASE * 2^40 elements: never the limit
+
+    T* segments[SEGMENTS];
+    atomic<size_t> published;
+    size_t count; // writer's copy of the size
+    size_t reserved; // bytes in allocated segments
+
+    static void locate(size_t index, int& segment, size_t& offset) {
+        size_t slot = index / BASE + 1;
+        segment = 0;
+        while (slot >>= 1) {
+            segment++;
+        }
+        offset = index - BASE * ((size_t(1) << segment) - 1);
+    }
+
+    AppendLog(const AppendLog&);
+    AppendLog& operator=(const AppendLog&);
+
+public:
+    AppendLog() : published(0), count(0), reserved(0) {
+        for (int i = 0; i < SEGMENTS; i++) {
+            segments[i] = nullptr;
+        }
+    }
+
+    ~AppendLog() {
+        for (int i = 0; i < SEGMENTS; i++) {
+            delete[] segments[i];
+        }
+    }
+
+    /**
+     * @brief Append an element and publish it (writer thread only)
+     * @param value The element
+     */
+    void push_back(const T& value) {
+        int segment;
+        size_t offset;
+        locate(count, segment, offset);
+        if (!segments[segment]) {
+            segments[segment] = new T[BASE << segment];
+            reserved += (BASE << segment) * sizeof(T);
+        }
+        segments[segment][offset] = value;
+        count++;
+        published.store(count, memory_order_release);
+    }
+
+    /**
+     * @brief Get the number of published elements
+     * @return Published size (elements below it are safe to read)
+     */
+    size_t size() const { return published.load(memory_order_acquire); }
+
+    /**
+     * @brief Check whether nothing was published yet
+     * @return true if empty
+     */
+    bool empty() const { return size() == 0; }
+
+    /**
+     * @brief Read a published element
+     * @param index Position, below a size() the caller observed
+     * @return The element
+     */
+    const T& operator[](size_t index) const {
+        int segment;
+        size_t offset;
+        locate(index, segment, offset);
+        return segments[segment][offset];
+    }
+
+    /**
+     * @brief Get the bytes held by allocated segments
+     * @return Reserved bytes
+     */
+    size_t reservedBytes() const { return reserved; }
+};
+
+#endif
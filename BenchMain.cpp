@@ -0,0 +1,1218 @@
+/**
+ * @file BenchMain.cpp
+ * @brief Microbenchmarks for PetSpace hot paths
+ *
+ * Console output from the rooms is silenced while timing; results are
+ * printed with printf as nanoseconds per element/operation.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Iterator.h"
+#include "ChatHistory.h"
+#include "ChatRoom.h"
+#include "CtrlCat.h"
+#include "Users.h"
+#include "AdmissionController.h"
+#include "FederationHost.h"
+#include "ChatSession.h"
+#include "DeliveryScheduler.h"
+#include "ModerationFilter.h"
+#include "RoomAnalytics.h"
+#include "MemoryRegistry.h"
+#include "TracePlayer.h"
+#include "TraceRecorder.h"
+#include <sched.h>
+#include <thread>
+
+using namespace std;
+
+typedef chrono::steady_clock BenchClock;
+
+// Keeps the optimizer from discarding benchmark loops
+static volatile size_t benchSink = 0;
+
+static double nsPer(BenchClock::time_point start, size_t count) {
+    double ns = chrono::duration<double, nano>(BenchClock::now() - start).count();
+    return count ? ns / count : 0.0;
+}
+
+// Results are per element for iteration benches, per call otherwise
+static void report(const char* name, double ns) {
+    printf("  %-40s %14.2f ns/op\n", name, ns);
+}
+
+// ============================================================================
+// Iterator: virtual adapter vs value-type cursor
+// ============================================================================
+static void benchIterators() {
+    const size_t messages = 200000;
+    const int rounds = 20;
+    const size_t total = messages * rounds;
+
+    CtrlCat room;
+    vector<Users*> senders;
+    for (int i = 0; i < 100; i++) {
+        senders.push_back(new Users("User" + to_string(i)));
+    }
+    ChatHistory& history = room.getChatHistory();
+    for (size_t i = 0; i < messages; i++) {
+        history.append(senders[i % senders.size()], "message number " + to_string(i));
+    }
+
+    printf("\nHistory iteration (%zu messages x %d rounds)\n", messages, rounds);
+
+    BenchClock::time_point start = BenchClock::now();
+    for (int r = 0; r < rounds; r++) {
+        Iterator<string>* it = room.createChatHistoryIterator();
+        while (it->hasNext()) {
+            benchSink += it->next().size();
+        }
+        delete it;
+    }
+    report("Iterator<string>::next (virtual, copy)", nsPer(start, total));
+
+    start = BenchClock::now();
+    for (int r = 0; r < rounds; r++) {
+        HistoryCursor cursor = room.historyCursor();
+        while (cursor.hasNext()) {
+            benchSink += cursor.next().size();
+        }
+    }
+    report("HistoryCursor::next (copy)", nsPer(start, total));
+
+    start = BenchClock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (const string& entry : room.historyCursor()) {
+            benchSink += entry.size();
+        }
+    }
+    report("HistoryCursor range-for", nsPer(start, total));
+
+    start = BenchClock::now();
+    for (int r = 0; r < rounds; r++) {
+        HistoryCursor cursor = room.historyCursor();
+        HistoryBatch batch;
+        size_t n;
+        while ((n = cursor.nextBatch(batch, 256)) > 0) {
+            for (size_t i = 0; i < n; i++) {
+                benchSink += batch[i].size();
+            }
+        }
+    }
+    report("HistoryCursor::nextBatch(256)", nsPer(start, total));
+
+    // Recent window that fits in the rendered page cache
+    const size_t recent = ChatHistory::PAGE_SIZE * ChatHistory::CACHED_PAGES;
+    const size_t recentRounds = total / recent;
+    start = BenchClock::now();
+    for (size_t r = 0; r < recentRounds; r++) {
+        HistoryCursor cursor(&history, messages - recent, messages);
+        HistoryBatch batch;
+        size_t n;
+        while ((n = cursor.nextBatch(batch, 256)) > 0) {
+            for (size_t i = 0; i < n; i++) {
+                benchSink += batch[i].size();
+            }
+        }
+    }
+    report("HistoryCursor::nextBatch, cached pages", nsPer(start, recentRounds * recent));
+
+    // User list: virtual adapter batches vs cursor
+    vector<Users*> people;
+    for (size_t i = 0; i < 10000; i++) {
+        people.push_back(new Users("User" + to_string(i)));
+        room.getUsers().push_back(people.back());
+    }
+    const size_t userTotal = people.size() * 200;
+
+    start = BenchClock::now();
+    for (int r = 0; r < 200; r++) {
+        Iterator<Users*>* it = room.createUserIterator();
+        while (it->hasNext()) {
+            benchSink += reinterpret_cast<size_t>(it->next());
+        }
+        delete it;
+    }
+    report("Iterator<Users*>::next (virtual)", nsPer(start, userTotal));
+
+    start = BenchClock::now();
+    for (int r = 0; r < 200; r++) {
+        Iterator<Users*>* it = room.createUserIterator();
+        Users* batch[256];
+        size_t n;
+        while ((n = it->nextBatch(batch, 256)) > 0) {
+            for (size_t i = 0; i < n; i++) {
+                benchSink += reinterpret_cast<size_t>(batch[i]);
+            }
+        }
+        delete it;
+    }
+    report("Iterator<Users*>::nextBatch(256)", nsPer(start, userTotal));
+
+    start = BenchClock::now();
+    for (int r = 0; r < 200; r++) {
+        for (Users* user : room.userCursor()) {
+            benchSink += reinterpret_cast<size_t>(user);
+        }
+    }
+    report("UserCursor range-for", nsPer(start, userTotal));
+
+    room.getUsers().clear();
+    for (Users* user : people) {
+        delete user;
+    }
+    for (Users* user : senders) {
+        delete user;
+    }
+}
+
+// ============================================================================
+// History write path: eager formatted strings vs raw records
+// ============================================================================
+static void benchHistoryWrites() {
+    const size_t messages = 1000000;
+    Users sender("SomeoneWithAName");
+    string message = "a typical short chat line";
+
+    printf("\nHistory writes (%zu messages)\n", messages);
+
+    vector<string> eager;
+    BenchClock::time_point start = BenchClock::now();
+    for (size_t i = 0; i < messages; i++) {
+        eager.push_back(sender.getName() + ": " + message);
+    }
+    report("eager formatted string", nsPer(start, messages));
+    size_t eagerBytes = eager.capacity() * sizeof(string);
+    for (const string& line : eager) {
+        if (line.capacity() > 15) {
+            eagerBytes += line.capacity() + 1;
+        }
+    }
+
+    ChatHistory history;
+    start = BenchClock::now();
+    for (size_t i = 0; i < messages; i++) {
+        history.append(&sender, message);
+    }
+    report("ChatHistory::append (raw record)", nsPer(start, messages));
+
+    printf("  bytes/message: eager %.1f, raw %.1f\n",
+           double(eagerBytes) / messages, double(history.storedBytes()) / messages);
+}
+
+// ============================================================================
+// History storage: bytes/message and read throughput of inline + blocks
+// ============================================================================
+static void benchHistoryStorage() {
+    const size_t messages = 500000;
+    const char* phrases[] = {
+        "has anyone tried the new grain-free food from the pet store downtown?",
+        "my cat keeps knocking things off the table, any tips for that behaviour",
+        "reminder: adoption day this Saturday at the shelter, volunteers welcome",
+        "just posted pictures from the dog park in the gallery, check them out",
+    };
+    Users sender("SomeoneWithAName");
+
+    // 60% short lines, 40% longer lines built from phrases the room repeats
+    vector<string> corpus;
+    corpus.reserve(messages);
+    for (size_t i = 0; i < messages; i++) {
+        if (i % 5 < 3) {
+            corpus.push_back(i % 2 ? "lol same" : "ok see you at " + to_string(i % 24) + "h");
+        } else {
+            corpus.push_back(string(phrases[i % 4]) + " (" + to_string(i) + ")");
+        }
+    }
+
+    printf("\nHistory storage (%zu messages, 60%% short)\n", messages);
+
+    size_t payloadBytes = 0;
+    size_t stringBytes = corpus.capacity() * sizeof(string);
+    for (const string& line : corpus) {
+        payloadBytes += line.size();
+        if (line.capacity() > 15) {
+            stringBytes += line.capacity() + 1 + 16; // text, terminator, malloc header
+        }
+    }
+
+    ChatHistory history;
+    BenchClock::time_point start = BenchClock::now();
+    for (const string& line : corpus) {
+        history.append(&sender, line);
+    }
+    report("ChatHistory::append (inline/blocks)", nsPer(start, messages));
+    HistoryStorageStats stats = history.getStorageStats();
+
+    printf("  bytes/message: payload %.1f, string per message %.1f,\n", double(payloadBytes) / messages,
+           double(stringBytes) / messages);
+    printf("                 flat arena %.1f, inline + blocks %.1f (%.1f outside records)\n",
+           32.0 + double(payloadBytes) / messages, double(stats.recordBytes) / messages +
+           double(stats.storedBytes - stats.recordBytes) / messages,
+           double(stats.storedBytes - stats.recordBytes) / messages);
+
+    start = BenchClock::now();
+    for (const string& line : corpus) {
+        benchSink += line.size();
+    }
+    report("vector<string> scan", nsPer(start, messages));
+
+    start = BenchClock::now();
+    for (size_t i = 0; i < messages; i++) {
+        benchSink += history.payload(i).size();
+    }
+    report("ChatHistory::payload (sequential)", nsPer(start, messages));
+
+    const size_t probes = 100000;
+    size_t index = 12345;
+    start = BenchClock::now();
+    for (size_t i = 0; i < probes; i++) {
+        index = (index * 2862933555777941757ull + 3037000493ull) % messages;
+        benchSink += history.payload(index).size();
+    }
+    report("ChatHistory::payload (random)", nsPer(start, probes));
+
+    start = BenchClock::now();
+    for (const string& line : history.cursor()) {
+        benchSink += line.size();
+    }
+    report("HistoryCursor range-for (cold pages)", nsPer(start, messages));
+}
+
+// ============================================================================
+// Concurrent history readers while the room keeps appending
+// ============================================================================
+static void benchConcurrentReaders() {
+    const size_t messages = 400000;
+    Users sender("SomeoneWithAName");
+    ChatHistory history;
+    for (size_t i = 0; i < messages; i++) {
+        history.append(&sender, i % 3 ? "message number " + to_string(i) : "ok");
+    }
+
+    printf("\nConcurrent history readers (%zu entries, %u hardware threads)\n", messages,
+           thread::hardware_concurrency());
+
+    for (int readers = 1; readers <= 4; readers *= 2) {
+        atomic<bool> stop(false);
+        thread writer([&]() {
+            while (!stop) {
+                history.append(&sender, "live traffic while readers scan");
+            }
+        });
+
+        BenchClock::time_point start = BenchClock::now();
+        vector<thread> pool;
+        for (int r = 0; r < readers; r++) {
+            pool.push_back(thread([&]() {
+                HistoryReader view = history.reader();
+                string text;
+                size_t bytes = 0;
+                for (size_t i = 0; i < messages; i++) {
+                    view.payload(i, text);
+                    bytes += text.size();
+                }
+                benchSink += bytes;
+            }));
+        }
+        for (thread& reader : pool) {
+            reader.join();
+        }
+        double seconds = chrono::duration<double>(BenchClock::now() - start).count();
+        stop = true;
+        writer.join();
+
+        char label[64];
+        snprintf(label, sizeof(label), "%d reader thread%s + 1 writer", readers, readers > 1 ? "s" : "");
+        printf("  %-40s %11.1f M entries/s total\n", label, readers * messages / seconds / 1e6);
+    }
+}
+
+// ============================================================================
+// History: seeking by time in a multi-million-message room
+// ============================================================================
+static void benchHistorySeek() {
+    const size_t messages = 4000000;
+    const int64_t start = 1700000000000000LL;
+    Users sender("SomeoneWithAName");
+    ChatHistory history;
+    int64_t now = start;
+    size_t seed = 1;
+    for (size_t i = 0; i < messages; i++) {
+        // Bursty arrivals: 0-40 ms apart, with the odd long quiet spell
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        now += (seed >> 40) % 40000 + ((seed >> 20) % 1000 == 0 ? 60000000 : 0);
+        history.append(&sender, "ok", now);
+    }
+    const int64_t span = now - start;
+
+    printf("\nHistory seek by time (%zu entries, %.1f days)\n", messages, span / 86400e6);
+
+    const size_t seeks = 200000;
+    vector<int64_t> targets;
+    for (size_t i = 0; i < seeks; i++) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        targets.push_back(start + static_cast<int64_t>((seed >> 11) % static_cast<uint64_t>(span)));
+    }
+
+    BenchClock::time_point begin = BenchClock::now();
+    size_t found = 0;
+    for (int64_t target : targets) {
+        found += history.seek(target);
+    }
+    report("ChatHistory::seek (time index)", nsPer(begin, seeks));
+
+    // Same search straight over the records, without the sparse index
+    begin = BenchClock::now();
+    for (int64_t target : targets) {
+        size_t low = 0;
+        size_t high = history.size();
+        while (low < high) {
+            size_t mid = low + (high - low) / 2;
+            if (history.record(mid).timestampUs < target) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        found -= low;
+    }
+    report("binary search over records", nsPer(begin, seeks));
+
+    // What a seek cost before: scan from the first entry
+    const size_t scans = 20;
+    begin = BenchClock::now();
+    for (size_t i = 0; i < scans; i++) {
+        size_t index = 0;
+        while (index < history.size() && history.record(index).timestampUs < targets[i]) {
+            index++;
+        }
+        found += index;
+    }
+    report("linear scan from entry 0", nsPer(begin, scans));
+
+    // Seek, then stream the next hour
+    begin = BenchClock::now();
+    size_t streamed = 0;
+    for (size_t i = 0; i < 1000; i++) {
+        HistoryReader view = history.reader();
+        size_t end = view.seek(targets[i] + 3600000000LL);
+        for (size_t index = view.seek(targets[i]); index < end; index++) {
+            streamed += view.record(index).payloadLength;
+        }
+    }
+    report("seek + stream one hour (reader)", nsPer(begin, 1000));
+    benchSink += found + streamed;
+}
+
+// ============================================================================
+// Delivery: whole-room fan-out vs targeted delivery
+// ============================================================================
+static void benchTargetedDelivery() {
+    const size_t members = 100000;
+
+    // Rooms detach their members on destruction in O(members); deleting a
+    // member first would instead cost O(members) per user
+    CtrlCat* roomOwner = new CtrlCat();
+    CtrlCat& room = *roomOwner;
+    vector<Users*> people;
+    people.reserve(members);
+    for (size_t i = 0; i < members; i++) {
+        people.push_back(new Users("User" + to_string(i)));
+        room.registerUser(people.back());
+    }
+    room.tagUser(people[1], "mods");
+    room.tagUser(people[2], "mods");
+
+    printf("\nDelivery in a %zu-member room\n", members);
+
+    const int broadcasts = 20;
+    BenchClock::time_point start = BenchClock::now();
+    for (int i = 0; i < broadcasts; i++) {
+        people[0]->send("hello everyone", &room);
+    }
+    report("Users::send (whole room)", nsPer(start, broadcasts));
+
+    const int dms = 100000;
+    start = BenchClock::now();
+    for (int i = 0; i < dms; i++) {
+        people[0]->sendDirect("hello you", people[1 + i % (members - 1)], &room);
+    }
+    report("Users::sendDirect", nsPer(start, dms));
+
+    start = BenchClock::now();
+    for (int i = 0; i < dms; i++) {
+        people[0]->sendToTag("hello mods", "mods", &room);
+    }
+    report("Users::sendToTag (2 members)", nsPer(start, dms));
+
+    delete roomOwner;
+    for (Users* user : people) {
+        delete user;
+    }
+}
+
+// ============================================================================
+// Delivery: fan-out on write vs on read in a very large room
+// ============================================================================
+static void benchHybridFanout() {
+    const size_t members = 1000000;
+    const size_t activeReaders = 1000;
+
+    CtrlCat* roomOwner = new CtrlCat();
+    CtrlCat& room = *roomOwner;
+    vector<Users*> people;
+    people.reserve(members);
+    for (size_t i = 0; i < members; i++) {
+        people.push_back(new Users("User" + to_string(i)));
+        room.registerUser(people.back());
+    }
+
+    printf("\nHybrid fan-out (%zu members, %zu active)\n", members, activeReaders);
+
+    const int pushes = 5;
+    BenchClock::time_point start = BenchClock::now();
+    for (int i = 0; i < pushes; i++) {
+        people[i]->send("hello everyone", &room);
+    }
+    report("send, push to every member", nsPer(start, pushes));
+
+    room.setFanoutThreshold(10000);
+    const int publishes = 10000;
+    start = BenchClock::now();
+    for (int i = 0; i < publishes; i++) {
+        people[i % activeReaders]->send("hello everyone", &room);
+    }
+    report("send, publish once (pulled on read)", nsPer(start, publishes));
+
+    // Only active members pay for delivery
+    size_t pulled = 0;
+    start = BenchClock::now();
+    for (size_t i = 0; i < activeReaders; i++) {
+        pulled += people[i * (members / activeReaders)]->catchUp(&room);
+    }
+    report("catchUp, per message pulled", nsPer(start, pulled));
+    benchSink += pulled;
+
+    delete roomOwner;
+    for (Users* user : people) {
+        delete user;
+    }
+}
+
+// ============================================================================
+// Broadcast: one send per room vs merged multi-room fan-out
+// ============================================================================
+static void benchBroadcast() {
+    const size_t roomCount = 100;
+    const size_t userCount = 2000;
+    const size_t roomsPerUser = 10;
+
+    vector<ChatRoom*> rooms;
+    for (size_t i = 0; i < roomCount; i++) {
+        rooms.push_back(new CtrlCat());
+    }
+    Users announcer("Announcer");
+    vector<Users*> people;
+    size_t seed = 3;
+    size_t memberships = 0;
+    for (size_t i = 0; i < userCount; i++) {
+        people.push_back(new Users("User" + to_string(i)));
+        for (size_t j = 0; j < roomsPerUser; j++) {
+            seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+            ChatRoom* room = rooms[(seed >> 33) % roomCount];
+            if (!room->isMember(people.back())) {
+                room->registerUser(people.back());
+                memberships++;
+            }
+        }
+    }
+    for (ChatRoom* room : rooms) {
+        room->registerUser(&announcer);
+    }
+
+    printf("\nBroadcast to %zu rooms (%zu memberships, %zu distinct members)\n", roomCount, memberships,
+           userCount);
+
+    const int announcements = 200;
+    BenchClock::time_point start = BenchClock::now();
+    for (int i = 0; i < announcements; i++) {
+        for (ChatRoom* room : rooms) {
+            announcer.send("Adoption day on Saturday!", room);
+        }
+    }
+    report("Users::send once per room", nsPer(start, announcements));
+
+    start = BenchClock::now();
+    for (int i = 0; i < announcements; i++) {
+        announcer.broadcast("Adoption day on Saturday!", rooms);
+    }
+    report("Users::broadcast (merged fan-out)", nsPer(start, announcements));
+
+    for (ChatRoom* room : rooms) {
+        delete room;
+    }
+    for (Users* user : people) {
+        delete user;
+    }
+}
+
+// ============================================================================
+// Admission control: spammer vs well-behaved user
+// ============================================================================
+static void benchAdmission() {
+    const size_t members = 1000;
+    const int spam = 20000;
+    const int polite = 200;
+
+    CtrlCat room;
+    vector<Users*> people;
+    for (size_t i = 0; i < members; i++) {
+        people.push_back(new Users("User" + to_string(i)));
+        room.registerUser(people.back());
+    }
+    printf("\nAdmission control (%zu members, %d spam sends per %d polite sends)\n",
+           members, spam, polite);
+
+    // open: no controller; shed and queue: the spammer is over its rate. In
+    // queue mode the loop drains after every send, as a server loop would,
+    // and a polite sample covers its send plus the drain that follows
+    const char* modes[] = { "open", "shed", "queue" };
+    for (int mode = 0; mode < 3; mode++) {
+        AdmissionController::Config limits;
+        limits.userRate = 100;
+        limits.userBurst = polite; // the polite user never exceeds this
+        limits.policy = mode == 2 ? AdmissionController::QUEUE : AdmissionController::SHED;
+        AdmissionController controller(limits);
+        room.setAdmissionController(mode ? &controller : nullptr);
+        // Token buckets live in the users: fresh ones so no mode inherits a spent bucket
+        Users* spammer = new Users("Spammer");
+        Users* politeUser = new Users("Polite");
+        room.registerUser(spammer);
+        room.registerUser(politeUser);
+
+        vector<double> politeNs;
+        BenchClock::time_point start = BenchClock::now();
+        for (int i = 0; i < spam; i++) {
+            spammer->send("buy now", &room);
+            if (mode == 2) {
+                controller.drainDeferred();
+            }
+            if (i % (spam / polite) == 0) {
+                BenchClock::time_point sendStart = BenchClock::now();
+                politeUser->send("hello", &room);
+                if (mode == 2) {
+                    controller.drainDeferred();
+                }
+                politeNs.push_back(nsPer(sendStart, 1));
+            }
+        }
+        double total = nsPer(start, 1) / 1e6;
+        sort(politeNs.begin(), politeNs.end());
+        double p50 = politeNs[politeNs.size() / 2];
+        double p99 = politeNs[politeNs.size() * 99 / 100];
+
+        printf("  %-8s total %9.1f ms, polite p50 %9.0f ns, p99 %9.0f ns, rejected %llu, still queued %zu\n",
+               modes[mode], total, p50, p99, (unsigned long long)controller.getStats().rejected(),
+               controller.getQueuedCount());
+        room.setAdmissionController(nullptr);
+        delete spammer;
+        delete politeUser;
+    }
+
+    for (Users* user : people) {
+        delete user;
+    }
+}
+
+// ============================================================================
+// Deduplication: retried send vs first send
+// ============================================================================
+static void benchDedup() {
+    const size_t members = 1000;
+    const int sends = 2000;
+
+    CtrlCat room;
+    vector<Users*> people;
+    for (size_t i = 0; i < members; i++) {
+        people.push_back(new Users("User" + to_string(i)));
+        room.registerUser(people.back());
+    }
+
+    printf("\nIdempotent send (%zu members)\n", members);
+
+    BenchClock::time_point start = BenchClock::now();
+    for (int i = 0; i < sends; i++) {
+        people[0]->send("hello", &room, i + 1);
+    }
+    report("Users::send with new ID", nsPer(start, sends));
+
+    start = BenchClock::now();
+    for (int r = 0; r < 50; r++) {
+        for (int i = 0; i < sends; i++) {
+            people[0]->send("hello", &room, i + 1);
+        }
+    }
+    report("Users::send retry (duplicate)", nsPer(start, sends * 50));
+
+    DedupStats stats = room.getDeduplicator().getStats();
+    printf("  dedupe window memory: %zu bytes for %d IDs\n", stats.memoryBytes, sends);
+
+    for (Users* user : people) {
+        delete user;
+    }
+}
+
+// ============================================================================
+// Federation: in-process room vs room in a worker process
+// ============================================================================
+static void benchFederation() {
+    const size_t members = 100;
+    const int sends = 20000;
+    const int pings = 2000;
+
+    vector<Users*> people;
+    for (size_t i = 0; i < members; i++) {
+        people.push_back(new Users("User" + to_string(i)));
+    }
+
+    printf("\nFederation (%zu-member room, %d sends; ping in a 2-member room)\n", members, sends);
+
+    {
+        CtrlCat local;
+        for (Users* user : people) {
+            local.registerUser(user);
+        }
+        BenchClock::time_point start = BenchClock::now();
+        for (int i = 0; i < sends; i++) {
+            people[i % members]->send("hello", &local);
+        }
+        double ns = nsPer(start, sends);
+        report("in-process send + fan-out", ns);
+        printf("  %-40s %14.0f msg/s\n", "in-process throughput", 1e9 / ns);
+    }
+
+    {
+        FederationHost federation(1);
+        ChatRoom* remote = federation.createRoom("CtrlCat");
+        for (Users* user : people) {
+            remote->registerUser(user);
+        }
+        federation.sync();
+
+        BenchClock::time_point start = BenchClock::now();
+        for (int i = 0; i < sends; i++) {
+            people[i % members]->send("hello", remote);
+        }
+        federation.sync();
+        double ns = nsPer(start, sends);
+        report("cross-process send + fan-out", ns);
+        printf("  %-40s %14.0f msg/s\n", "cross-process throughput", 1e9 / ns);
+
+        ChatRoom* pingRoom = federation.createRoom("Dogorithm");
+        pingRoom->registerUser(people[0]);
+        pingRoom->registerUser(people[1]);
+        federation.sync();
+
+        vector<double> rtt;
+        rtt.reserve(pings);
+        for (int i = 0; i < pings; i++) {
+            uint64_t before = federation.getDelivered();
+            BenchClock::time_point sent = BenchClock::now();
+            pingRoom->sendMessage("ping", people[0]);
+            while (federation.getDelivered() == before) {
+                if (federation.pump() == 0) {
+                    sched_yield(); // the worker may share our core
+                }
+            }
+            rtt.push_back(nsPer(sent, 1));
+        }
+        sort(rtt.begin(), rtt.end());
+        printf("  %-40s %14.0f ns (p50), %.0f ns (p99)\n", "cross-process delivery latency",
+               rtt[pings / 2], rtt[pings * 99 / 100]);
+    }
+
+    for (Users* user : people) {
+        delete user;
+    }
+}
+
+// ============================================================================
+// Ownership: heap-allocated objects vs arena-backed session
+// ============================================================================
+static void benchOwnership() {
+    const size_t members = 50000;
+    const int broadcasts = 20;
+
+    printf("\nOwnership with %zu users in one room\n", members);
+
+    // Heap users, interleaved with unrelated allocations as in a long-lived process
+    vector<string*> clutter;
+    vector<Users*> people;
+    BenchClock::time_point start = BenchClock::now();
+    for (size_t i = 0; i < members; i++) {
+        people.push_back(new Users("User" + to_string(i)));
+        clutter.push_back(new string(200, 'x'));
+    }
+    report("new Users", nsPer(start, members));
+
+    CtrlCat* heapRoom = new CtrlCat();
+    for (Users* user : people) {
+        heapRoom->registerUser(user);
+    }
+    start = BenchClock::now();
+    for (int i = 0; i < broadcasts; i++) {
+        people[0]->send("hello everyone", heapRoom);
+    }
+    report("fan-out per member (heap users)", nsPer(start, broadcasts * members));
+
+    start = BenchClock::now();
+    delete heapRoom;
+    for (Users* user : people) {
+        delete user;
+    }
+    report("teardown per user (delete)", nsPer(start, members));
+    for (string* junk : clutter) {
+        delete junk;
+    }
+
+    ChatSession session;
+    vector<UserHandle> handles;
+    handles.reserve(members);
+    start = BenchClock::now();
+    for (size_t i = 0; i < members; i++) {
+        handles.push_back(session.createUser("User" + to_string(i)));
+    }
+    report("ChatSession::createUser", nsPer(start, members));
+
+    CtrlCatHandle arenaRoom = session.createCtrlCat();
+    for (UserHandle handle : handles) {
+        session.get(arenaRoom)->registerUser(session.get(handle));
+    }
+    Users* first = session.get(handles[0]);
+    start = BenchClock::now();
+    for (int i = 0; i < broadcasts; i++) {
+        first->send("hello everyone", session.get(arenaRoom));
+    }
+    report("fan-out per member (arena users)", nsPer(start, broadcasts * members));
+
+    const int lookups = 20;
+    start = BenchClock::now();
+    for (int round = 0; round < lookups; round++) {
+        for (UserHandle handle : handles) {
+            benchSink += reinterpret_cast<uintptr_t>(session.get(handle)) & 1;
+        }
+    }
+    report("ChatSession::get (handle check)", nsPer(start, lookups * members));
+
+    start = BenchClock::now();
+    session.clear();
+    report("teardown per user (ChatSession::clear)", nsPer(start, members));
+}
+
+// ============================================================================
+// Scheduling: admin broadcasts under overload, with and without priority
+// ============================================================================
+static void runOverload(bool prioritised) {
+    const int rooms = 50;
+    const int membersPerRoom = 10;
+    const int ticks = 400;
+    const size_t servicePerTick = 180; // arrivals are 200 commands per tick
+
+    DeliveryScheduler scheduler;
+    vector<CtrlCat*> roomList;
+    vector<Users*> people;
+    Users admin("Admin");
+    admin.setSendPriority(prioritised ? PRIORITY_HIGH : PRIORITY_NORMAL);
+    for (int r = 0; r < rooms; r++) {
+        CtrlCat* room = new CtrlCat();
+        room->setDeliveryScheduler(&scheduler);
+        for (int m = 0; m < membersPerRoom; m++) {
+            people.push_back(new Users("User" + to_string(people.size())));
+            room->registerUser(people.back());
+        }
+        room->registerUser(&admin);
+        roomList.push_back(room);
+    }
+    scheduler.drain();
+    scheduler.resetStats();
+
+    for (int t = 0; t < ticks; t++) {
+        for (int r = 0; r < rooms; r++) {
+            Users* chatter = people[r * membersPerRoom + t % membersPerRoom];
+            chatter->send("chatter", roomList[r]);
+            chatter->send("more chatter", roomList[r]);
+        }
+        admin.send("announcement", roomList[t % rooms]);
+        scheduler.drain(servicePerTick);
+    }
+
+    PriorityClassStats normal = scheduler.getStats(PRIORITY_NORMAL);
+    PriorityClassStats high = scheduler.getStats(PRIORITY_HIGH);
+    const char* label = prioritised ? "admin as HIGH" : "admin as NORMAL (FIFO)";
+    printf("  %-40s admin p99 <= %8.0f us, chatter p99 <= %8.0f us, backlog %zu\n", label,
+           prioritised ? high.p99LatencyUs : normal.p99LatencyUs, normal.p99LatencyUs, normal.depth);
+
+    for (CtrlCat* room : roomList) {
+        delete room;
+    }
+    for (Users* user : people) {
+        delete user;
+    }
+}
+
+static void benchScheduler() {
+    const int members = 100;
+    const int sends = 20000;
+
+    printf("\nDelivery scheduler\n");
+
+    CtrlCat room;
+    vector<Users*> people;
+    for (int i = 0; i < members; i++) {
+        people.push_back(new Users("User" + to_string(i)));
+        room.registerUser(people.back());
+    }
+
+    BenchClock::time_point start = BenchClock::now();
+    for (int i = 0; i < sends; i++) {
+        people[0]->send("hello", &room);
+    }
+    report("Users::send (inline, 100 members)", nsPer(start, sends));
+
+    DeliveryScheduler scheduler;
+    room.setDeliveryScheduler(&scheduler);
+    start = BenchClock::now();
+    for (int i = 0; i < sends; i++) {
+        people[0]->send("hello", &room);
+        if (i % 64 == 63) {
+            scheduler.drain();
+        }
+    }
+    scheduler.drain();
+    report("Users::send (scheduled, 100 members)", nsPer(start, sends));
+    room.setDeliveryScheduler(nullptr);
+
+    printf("  overload (50 rooms, arrivals > service, latency bucketed):\n");
+    runOverload(false);
+    runOverload(true);
+
+    for (Users* user : people) {
+        delete user;
+    }
+}
+
+// ============================================================================
+// Moderation: compiled matcher with a large pattern set
+// ============================================================================
+static string syntheticPattern(size_t i) {
+    // Word-like patterns of 5-12 letters, deterministic per index
+    static const char* consonants = "bcdfghjklmnprstvwz";
+    static const char* vowels = "aeiou";
+    string pattern;
+    size_t length = 5 + i % 8;
+    size_t seed = i * 2654435761u + 12345;
+    for (size_t j = 0; j < length; j++) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        pattern += j % 2 ? vowels[(seed >> 33) % 5] : consonants[(seed >> 33) % 18];
+    }
+    return pattern;
+}
+
+static void benchModeration() {
+    const size_t patternCount = 10000;
+    vector<string> patterns;
+    for (size_t i = 0; i < patternCount; i++) {
+        patterns.push_back(syntheticPattern(i));
+    }
+
+    printf("\nModeration filter (%zu patterns)\n", patternCount);
+
+    BenchClock::time_point start = BenchClock::now();
+    PatternMatcher matcher(patterns);
+    double buildMs = chrono::duration<double, milli>(BenchClock::now() - start).count();
+    printf("  %-40s %11.1f ms, %zu states, %zu classes, %.1f MiB\n", "compile", buildMs,
+           matcher.stateCount(), matcher.classCount(), matcher.memoryBytes() / 1048576.0);
+
+    // Ordinary chat text: mostly no match, so every byte is scanned
+    const string sentence = "the quick brown fox jumps over the lazy dog while everyone watches. ";
+    const size_t sizes[] = {16, 128, 1024};
+    for (size_t size : sizes) {
+        string text;
+        while (text.size() < size) {
+            text += sentence;
+        }
+        text.resize(size);
+        const size_t scans = 4000000 / size + 1000;
+        size_t hits = 0;
+        start = BenchClock::now();
+        for (size_t i = 0; i < scans; i++) {
+            hits += matcher.contains(text.data(), text.size());
+        }
+        double ns = nsPer(start, scans);
+        benchSink += hits;
+        char label[64];
+        snprintf(label, sizeof(label), "contains, %zu-byte message", size);
+        printf("  %-40s %14.2f ns/op (%.2f ns/byte)\n", label, ns, ns / size);
+    }
+
+    // End to end: the filter's share of a send
+    const int sends = 20000;
+    CtrlCat room;
+    Users sender("Sender");
+    Users listener("Listener");
+    room.registerUser(&sender);
+    room.registerUser(&listener);
+    const string message = "hello everyone, how is the weather over there today?";
+
+    start = BenchClock::now();
+    for (int i = 0; i < sends; i++) {
+        sender.send(message, &room);
+    }
+    report("Users::send (no filter)", nsPer(start, sends));
+
+    ModerationFilter filter(patterns);
+    room.addFilter(&filter);
+    start = BenchClock::now();
+    for (int i = 0; i < sends; i++) {
+        sender.send(message, &room);
+    }
+    report("Users::send (10k-pattern filter)", nsPer(start, sends));
+
+    start = BenchClock::now();
+    filter.reload(patterns);
+    printf("  %-40s %11.1f ms\n", "hot reload (compile + swap)",
+           chrono::duration<double, milli>(BenchClock::now() - start).count());
+    room.removeFilter(&filter);
+}
+
+// ============================================================================
+// Analytics: streaming sketches vs recomputing from history
+// ============================================================================
+static void benchAnalytics() {
+    const size_t messages = 1000000;
+    const size_t senders = 10000;
+    vector<Users*> people;
+    for (size_t i = 0; i < senders; i++) {
+        people.push_back(new Users("User" + to_string(i)));
+    }
+
+    printf("\nRoom analytics (%zu messages, %zu senders)\n", messages, senders);
+
+    RoomAnalytics stats;
+    ChatHistory history;
+    vector<string> texts;
+    for (size_t i = 0; i < 64; i++) {
+        texts.push_back(string(4 + (i * 37) % 200, 'x'));
+    }
+    size_t seed = 7;
+    BenchClock::time_point start = BenchClock::now();
+    for (size_t i = 0; i < messages; i++) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        // Skewed activity: a few senders do most of the talking
+        size_t who = (seed >> 33) % senders;
+        who = who * who / senders;
+        stats.recordMessage(people[who]->getIdentity(), texts[i % texts.size()].size());
+    }
+    report("RoomAnalytics::recordMessage", nsPer(start, messages));
+
+    for (size_t i = 0; i < messages; i++) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        size_t who = (seed >> 33) % senders;
+        history.append(people[who * who / senders], texts[i % texts.size()]);
+    }
+
+    const int queries = 1000;
+    start = BenchClock::now();
+    for (int i = 0; i < queries; i++) {
+        AnalyticsSnapshot snapshot = stats.getSnapshot();
+        benchSink += snapshot.topSenders.size();
+    }
+    report("getSnapshot (all statistics)", nsPer(start, queries));
+
+    // The alternative: walk the whole history for the same answers
+    start = BenchClock::now();
+    unordered_map<uint32_t, uint64_t> perSender;
+    vector<uint32_t> sizes;
+    sizes.reserve(history.size());
+    for (size_t i = 0; i < history.size(); i++) {
+        const HistoryRecord& entry = history.record(i);
+        perSender[entry.senderSlot]++;
+        sizes.push_back(entry.payloadLength);
+    }
+    nth_element(sizes.begin(), sizes.begin() + sizes.size() / 2, sizes.end());
+    benchSink += perSender.size() + sizes[sizes.size() / 2];
+    report("full history scan (same statistics)", nsPer(start, 1));
+
+    printf("  %-40s %11zu bytes\n", "sketch memory", stats.memoryBytes());
+
+    // Cost added to a real send
+    CtrlCat room;
+    room.registerUser(people[0]);
+    room.registerUser(people[1]);
+    const int sends = 20000;
+    start = BenchClock::now();
+    for (int i = 0; i < sends; i++) {
+        people[0]->send("hello everyone", &room);
+    }
+    report("Users::send (analytics off)", nsPer(start, sends));
+    room.enableAnalytics();
+    start = BenchClock::now();
+    for (int i = 0; i < sends; i++) {
+        people[0]->send("hello everyone", &room);
+    }
+    report("Users::send (analytics on)", nsPer(start, sends));
+
+    room.removeUser(people[0]);
+    room.removeUser(people[1]);
+    for (Users* user : people) {
+        delete user;
+    }
+}
+
+// ============================================================================
+// Trace recording overhead and playback throughput
+// ============================================================================
+static void benchTrace() {
+    const string tracePath = "bench_session.trace";
+    const int sends = 20000;
+    TraceRecorder recorder(tracePath);
+    CtrlCat plain;
+    CtrlCat recorded;
+    recorded.setTraceRecorder(&recorder);
+    vector<Users*> people;
+    for (size_t i = 0; i < 50; i++) {
+        people.push_back(new Users("User" + to_string(i)));
+        plain.registerUser(people.back());
+        recorded.registerUser(people.back());
+    }
+
+    printf("\nTrace record/playback (%d sends, %zu members)\n", sends, people.size());
+
+    BenchClock::time_point start = BenchClock::now();
+    for (int i = 0; i < sends; i++) {
+        people[i % people.size()]->send("hello everyone", &plain);
+    }
+    report("Users::send (not recording)", nsPer(start, sends));
+
+    start = BenchClock::now();
+    for (int i = 0; i < sends; i++) {
+        people[i % people.size()]->send("hello everyone", &recorded);
+    }
+    report("Users::send (recording)", nsPer(start, sends));
+    recorded.setTraceRecorder(nullptr);
+    recorder.flush();
+    printf("  %-40s %11.1f bytes\n", "trace size per send", double(recorder.getBytesRecorded()) / sends);
+
+    TracePlayer player;
+    if (player.load(tracePath)) {
+        start = BenchClock::now();
+        PlaybackStats stats = player.play(PlaybackOptions());
+        report("TracePlayer::play per operation", nsPer(start, stats.operations));
+    }
+    remove(tracePath.c_str());
+
+    for (Users* user : people) {
+        plain.removeUser(user);
+        recorded.removeUser(user);
+        delete user;
+    }
+}
+
+// ============================================================================
+// Memory accounting: exact vs sampled charging, report cost
+// ============================================================================
+static void benchMemoryAccounting() {
+    const int appends = 1000000;
+    const size_t owners = 100000;
+
+    printf("\nMemory accounting (%d history appends, %zu accounts)\n", appends, owners);
+
+    Users sender("Sender");
+    string text(100, 'x');
+    {
+        ChatHistory history;
+        BenchClock::time_point start = BenchClock::now();
+        for (int i = 0; i < appends; i++) {
+            history.append(&sender, text);
+        }
+        report("ChatHistory::append (no account)", nsPer(start, appends));
+    }
+    {
+        MemoryAccount account(MemoryAccount::OTHER, "bench");
+        ChatHistory history;
+        history.setMemoryAccount(&account);
+        BenchClock::time_point start = BenchClock::now();
+        for (int i = 0; i < appends; i++) {
+            history.append(&sender, text);
+        }
+        report("ChatHistory::append (charged)", nsPer(start, appends));
+    }
+
+    // Allocation-heavy path: every notification is a string and maybe a regrowth
+    const size_t samplePeriods[] = { 1, 4096 };
+    for (size_t period : samplePeriods) {
+        MemoryRegistry::setSamplePeriod(period);
+        Users listener("Listener");
+        const int notifications = 200000;
+        BenchClock::time_point start = BenchClock::now();
+        for (int i = 0; i < notifications; i++) {
+            listener.update("Someone has joined the room, say hello to them", "Lounge");
+            if (i % 1000 == 999) {
+                listener.clearNotifications();
+            }
+        }
+        report(period == 1 ? "Users::update (exact accounting)" : "Users::update (sampled 1/4096 B)",
+               nsPer(start, notifications));
+    }
+    MemoryRegistry::setSamplePeriod(1);
+
+    vector<Users*> people;
+    for (size_t i = 0; i < owners; i++) {
+        people.push_back(new Users("User" + to_string(i)));
+        people.back()->update("Welcome!", "Lobby");
+    }
+    const int reports = 20;
+    BenchClock::time_point start = BenchClock::now();
+    for (int i = 0; i < reports; i++) {
+        MemoryReport snapshot = MemoryRegistry::report(10);
+        benchSink += snapshot.topUsers.size();
+    }
+    report("MemoryRegistry::report (top 10)", nsPer(start, reports));
+    printf("  %-40s %11zu bytes\n", "MemoryAccount footprint", sizeof(MemoryAccount));
+    for (Users* user : people) {
+        delete user;
+    }
+}
+
+int main() {
+    cout.setstate(ios::badbit); // silence room/user chatter while timing
+
+    printf("PetSpace microbenchmarks\n");
+    benchIterators();
+    benchHistoryWrites();
+    benchHistoryStorage();
+    benchConcurrentReaders();
+    benchHistorySeek();
+    benchTargetedDelivery();
+    benchHybridFanout();
+    benchBroadcast();
+    benchAdmission();
+    benchDedup();
+    benchFederation();
+    benchOwnership();
+    benchScheduler();
+    benchModeration();
+    benchAnalytics();
+    benchTrace();
+    benchMemoryAccounting();
+
+    cout.clear();
+    return benchSink == 0xdeadbeef ? 1 : 0;
+}
@@ -0,0 +1,83 @@
+//BroadcastCommand.cpp
+#include "BroadcastCommand.h"
+#include "RecipientSet.h"
+#include "ChatRoom.h"
+#include "Users.h"
+#include <memory>
+
+namespace {
+
+// Bitmaps kept for reuse by later broadcasts on this thread. A receive()
+// may broadcast again before the outer fan-out is done, so each call takes
+// its own set instead of sharing one
+thread_local vector<unique_ptr<RecipientSet> > spareSets;
+
+class BorrowedSet
+{
+public:
+    BorrowedSet()
+    {
+        if (spareSets.empty())
+        {
+            set.reset(new RecipientSet());
+        }
+        else
+        {
+            set = move(spareSets.back());
+            spareSets.pop_back();
+        }
+    }
+
+    ~BorrowedSet()
+    {
+        set->clear();
+        spareSets.push_back(move(set));
+    }
+
+    RecipientSet& operator*() { return *set; }
+
+private:
+    unique_ptr<RecipientSet> set;
+};
+
+} // namespace
+
+void BroadcastCommand::execute()
+{
+    // Merged fan-out: the union of the pushed rooms' members, each visited once
+    BorrowedSet borrowed;
+    RecipientSet& seen = *borrowed;
+    for (ChatRoom* target : rooms)
+    {
+        if (!target->fansOutLocally())
+        {
+            target->sendMessage(message, fromUser);
+            continue;
+        }
+        if (target->deliversOnRead())
+        {
+            continue; // members pull it from the history entry saved below
+        }
+        for (Users* user : target->getUsers())
+        {
+            if (user != fromUser && seen.insert(user->getDenseId()))
+            {
+                user->receive(message, fromUser, target);
+            }
+        }
+    }
+    recipients = seen.size();
+
+    // Then every room's history, in one pass
+    for (ChatRoom* target : rooms)
+    {
+        if (target->deliversOnRead())
+        {
+            target->publishMessage(message, fromUser);
+        }
+        else
+        {
+            target->saveMessage(message, fromUser);
+        }
+    }
+}
@@ -0,0 +1,30 @@
+//BroadcastCommand.h
+#ifndef BROADCASTCOMMAND_H
+#define BROADCASTCOMMAND_H
+
+#include <vector>
+#include "Command.h"
+#include "ChatRoom.h"
+#include "Users.h"
+
+/**
+ * One message posted to several rooms: every distinct member of the
+ * pushed rooms receives it once, then each room saves it. Scheduled
+ * through the first room.
+ */
+class BroadcastCommand : public Command
+{
+private:
+    vector<ChatRoom*> rooms;
+    size_t recipients;
+
+public:
+    BroadcastCommand(const vector<ChatRoom*>& targets, string msg, Users* user)
+        : Command(targets.front(), msg, user), rooms(targets), recipients(0) {}
+    
+    void execute() override;
+    
+    size_t getRecipientCount() const { return recipients; }
+};
+
+#endif
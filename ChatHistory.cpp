@@ -0,0 +1,309 @@
+/**
+ * @file ChatHistory.cpp
+ * @brief Implementation of structured history and the rendered page cache
+ */
+
+#include "ChatHistory.h"
+#include "Users.h"
+#include <chrono>
+#include <cstring>
+
+using namespace std;
+
+atomic<uint64_t> ChatHistory::globalEpoch(0);
+atomic<uint64_t> ChatHistory::nextSequence(0);
+
+ChatHistory::ChatHistory()
+    : lastTimestampUs(INT64_MIN), inlineCount(0), inlineBytes(0), formatter(&ChatHistory::defaultFormat),
+      account(nullptr), chargedBytes(0), localEpoch(0), pagesRendered(0)
+{
+}
+
+ChatHistory::~ChatHistory()
+{
+    setMemoryAccount(nullptr);
+}
+
+void ChatHistory::setMemoryAccount(MemoryAccount* owner)
+{
+    if (account)
+    {
+        account->adjustBytes(MEM_HISTORY, -static_cast<int64_t>(chargedBytes));
+        account->addObjects(MEM_HISTORY, -static_cast<int64_t>(records.size()));
+    }
+    account = owner;
+    chargedBytes = 0;
+    if (account)
+    {
+        account->addObjects(MEM_HISTORY, static_cast<int64_t>(records.size()));
+        chargeStorage();
+    }
+}
+
+void ChatHistory::chargeStorage()
+{
+    // Storage grows in segments and blocks, so this is usually a no-op
+    size_t bytes = storedBytes();
+    if (bytes != chargedBytes)
+    {
+        account->adjustBytes(MEM_HISTORY, static_cast<int64_t>(bytes) - static_cast<int64_t>(chargedBytes));
+        chargedBytes = bytes;
+    }
+}
+
+string ChatHistory::defaultFormat(const string& senderName, const string& message)
+{
+    return senderName + ": " + message;
+}
+
+int64_t ChatHistory::nowUs()
+{
+    return chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+size_t ChatHistory::append(Users* sender, const string& message)
+{
+    return append(sender, message, nowUs());
+}
+
+size_t ChatHistory::append(Users* sender, const string& message, int64_t timestampUs)
+{
+    return append(sender ? sender->getIdentity() : SenderHandle(), message, timestampUs);
+}
+
+size_t ChatHistory::append(const SenderHandle& sender, const string& message)
+{
+    return append(sender, message, nowUs());
+}
+
+size_t ChatHistory::append(const SenderHandle& sender, const string& message, int64_t timestampUs)
+{
+    return append(sender, message, timestampUs, nextSequence.fetch_add(1, memory_order_relaxed));
+}
+
+size_t ChatHistory::append(const SenderHandle& sender, const string& message, int64_t timestampUs,
+                           uint64_t sequence)
+{
+    // Clamp so timestamps never go backwards (clock steps, out-of-order imports):
+    // the time index relies on them being sorted
+    if (timestampUs < lastTimestampUs)
+    {
+        timestampUs = lastTimestampUs;
+    }
+    lastTimestampUs = timestampUs;
+
+    HistoryRecord entry;
+    entry.senderSlot = senderSlot(sender);
+    entry.timestampUs = timestampUs;
+    entry.sequence = sequence;
+    entry.payloadLength = static_cast<uint32_t>(message.size());
+    if (entry.isInline())
+    {
+        // Most chat lines fit here: no allocation and no store lookup on read
+        memcpy(entry.inlineText, message.data(), message.size());
+        inlineCount++;
+        inlineBytes += entry.payloadLength;
+    }
+    else
+    {
+        store.add(message.data(), entry.payloadLength, entry.stored.block, entry.stored.offset);
+    }
+    records.push_back(entry);
+
+    size_t count = records.size();
+    if (count % TIME_INDEX_BLOCK == 0)
+    {
+        TimeIndexEntry span = { records[count - TIME_INDEX_BLOCK].timestampUs, timestampUs };
+        timeIndex.push_back(span);
+    }
+    if (account)
+    {
+        account->addObjects(MEM_HISTORY, 1);
+        chargeStorage();
+    }
+    return count - 1;
+}
+
+uint32_t ChatHistory::senderSlot(const SenderHandle& identity)
+{
+    // Published before the record that refers to it, so readers can resolve it
+    unordered_map<const SenderIdentity*, uint32_t>::iterator it = senderSlots.find(identity.get());
+    if (it != senderSlots.end())
+    {
+        return it->second;
+    }
+    uint32_t slot = static_cast<uint32_t>(senders.size());
+    senders.push_back(identity);
+    senderSlots[identity.get()] = slot;
+    return slot;
+}
+
+size_t ChatHistory::seekWithin(int64_t timestampUs, size_t limit) const
+{
+    // First full block that ends at or after the time; the index may lag
+    // the records a reader sees by one block, which the tail search covers
+    size_t blocks = timeIndex.size();
+    if (blocks > limit / TIME_INDEX_BLOCK)
+    {
+        blocks = limit / TIME_INDEX_BLOCK;
+    }
+    size_t low = 0;
+    size_t high = blocks;
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        if (timeIndex[mid].maxUs < timestampUs)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    // Then the first record inside that block (or the unindexed tail)
+    size_t first = low * TIME_INDEX_BLOCK;
+    size_t last = low < blocks ? first + TIME_INDEX_BLOCK : limit;
+    if (low < blocks && timeIndex[low].minUs >= timestampUs)
+    {
+        return first;
+    }
+    while (first < last)
+    {
+        size_t mid = first + (last - first) / 2;
+        if (records[mid].timestampUs < timestampUs)
+        {
+            first = mid + 1;
+        }
+        else
+        {
+            last = mid;
+        }
+    }
+    return first;
+}
+
+string ChatHistory::payload(size_t index) const
+{
+    const HistoryRecord& entry = records[index];
+    if (entry.isInline())
+    {
+        return string(entry.inlineText, entry.payloadLength);
+    }
+    string text;
+    store.read(entry.stored.block, entry.stored.offset, entry.payloadLength, text);
+    return text;
+}
+
+string ChatHistory::at(size_t index)
+{
+    return page(index / PAGE_SIZE)->lines[index % PAGE_SIZE];
+}
+
+void ChatHistory::renderInto(RenderedPage& target, size_t pageIndex)
+{
+    size_t begin = pageIndex * PAGE_SIZE + target.lines.size();
+    size_t end = (pageIndex + 1) * PAGE_SIZE;
+    if (end > records.size())
+    {
+        end = records.size();
+    }
+    for (size_t i = begin; i < end; i++)
+    {
+        target.lines.push_back(formatter(senderName(i), payload(i)));
+    }
+}
+
+ChatHistory::PagePtr ChatHistory::page(size_t pageIndex)
+{
+    uint64_t epoch = localEpoch + globalEpoch.load(memory_order_relaxed);
+
+    unordered_map<size_t, CachedPage>::iterator it = pageCache.find(pageIndex);
+    if (it != pageCache.end())
+    {
+        lruPages.splice(lruPages.begin(), lruPages, it->second.lru);
+        if (it->second.page->epoch == epoch)
+        {
+            // Entries appended since the page was rendered are filled in place
+            renderInto(*it->second.page, pageIndex);
+            return it->second.page;
+        }
+    }
+
+    // Holders of a stale page keep it; the cache gets a fresh one
+    PagePtr fresh = make_shared<RenderedPage>();
+    fresh->lines.reserve(PAGE_SIZE);
+    fresh->epoch = epoch;
+    renderInto(*fresh, pageIndex);
+    pagesRendered++;
+
+    if (it != pageCache.end())
+    {
+        it->second.page = fresh;
+        return fresh;
+    }
+
+    if (pageCache.size() >= CACHED_PAGES)
+    {
+        pageCache.erase(lruPages.back());
+        lruPages.pop_back();
+    }
+    lruPages.push_front(pageIndex);
+    CachedPage cached = { fresh, lruPages.begin() };
+    pageCache[pageIndex] = cached;
+    return fresh;
+}
+
+void ChatHistory::setFormatter(HistoryFormatter fn)
+{
+    formatter = fn;
+    localEpoch++;
+}
+
+HistoryReader ChatHistory::reader() const
+{
+    return HistoryReader(this);
+}
+
+HistoryCursor ChatHistory::cursor()
+{
+    return HistoryCursor(this, 0, records.size());
+}
+
+HistoryCursor ChatHistory::cursorFrom(int64_t fromUs)
+{
+    return HistoryCursor(this, seek(fromUs), records.size());
+}
+
+HistoryCursor ChatHistory::cursorBetween(int64_t fromUs, int64_t toUs)
+{
+    size_t begin = seek(fromUs);
+    size_t end = toUs > fromUs ? seek(toUs) : begin;
+    return HistoryCursor(this, begin, end);
+}
+
+size_t ChatHistory::storedBytes() const
+{
+    return records.reservedBytes() + timeIndex.reservedBytes() + senders.reservedBytes() + store.storedBytes();
+}
+
+HistoryStorageStats ChatHistory::getStorageStats() const
+{
+    HistoryStorageStats stats;
+    stats.messages = records.size();
+    stats.inlineMessages = inlineCount;
+    stats.payloadBytes = store.rawBytes() + inlineBytes;
+    stats.storedBytes = storedBytes();
+    stats.recordBytes = records.reservedBytes();
+    stats.sealedBlocks = store.sealedBlocks();
+    stats.retiredBytes = store.retiredBytes();
+    stats.dictionaryBytes = store.dictionaryBytes();
+    stats.blocksDecoded = store.getBlocksDecoded();
+    return stats;
+}
+
+void ChatHistory::invalidateAllPages()
+{
+    globalEpoch.fetch_add(1, memory_order_relaxed);
+}
@@ -0,0 +1,613 @@
+/**
+ * @file ChatHistory.h
+ * @brief Structured chat history with lazily rendered display pages
+ */
+
+#ifndef CHATHISTORY_H
+#define CHATHISTORY_H
+
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "AppendLog.h"
+#include "MemoryAccount.h"
+#include "PayloadStore.h"
+#include "SenderIdentity.h"
+
+using namespace std;
+
+class Users;
+
+/**
+ * @struct HistoryRecord
+ * @brief One saved message, stored raw (no display formatting)
+ *
+ * Messages of up to INLINE_CAPACITY bytes live in the record itself;
+ * longer ones are kept in the history's PayloadStore. The sender is a
+ * slot in the history's sender table, which outlives the user, so old
+ * entries stay readable after their sender is destroyed. Timestamps never
+ * decrease within one history; sequence numbers are unique and
+ * increasing across all histories, so they order messages between rooms.
+ */
+struct HistoryRecord
+{
+    static const uint32_t INLINE_CAPACITY = 20;
+
+    struct StoredPayload
+    {
+        uint32_t block;
+        uint32_t offset;
+    };
+
+    int64_t timestampUs;    // wall-clock time the message was saved, never decreasing
+    uint64_t sequence;      // process-wide save order
+    uint32_t senderSlot;    // index into the history's sender table
+    uint32_t payloadLength;
+    union
+    {
+        char inlineText[INLINE_CAPACITY];
+        StoredPayload stored;
+    };
+
+    bool isInline() const { return payloadLength <= INLINE_CAPACITY; }
+};
+
+/**
+ * @struct HistoryStorageStats
+ * @brief Where a history's bytes go
+ */
+struct HistoryStorageStats
+{
+    size_t messages;
+    size_t inlineMessages;
+    size_t payloadBytes;    // message text as sent
+    size_t storedBytes;     // records plus compressed store
+    size_t recordBytes;     // fixed-size records (inline text included)
+    size_t sealedBlocks;
+    size_t retiredBytes;    // raw buffers of sealed blocks a reader may still be copying from
+    size_t dictionaryBytes;
+    uint64_t blocksDecoded;
+
+    double bytesPerMessage() const {
+        return messages ? static_cast<double>(storedBytes) / messages : 0;
+    }
+};
+
+/**
+ * @struct TimeIndexEntry
+ * @brief Time span of one full block of TIME_INDEX_BLOCK records
+ */
+struct TimeIndexEntry
+{
+    int64_t minUs;
+    int64_t maxUs;
+};
+
+/**
+ * @brief Formats one history entry for display
+ * @param senderName The sender's current display name
+ * @param message The raw message text
+ * @return The display string
+ */
+typedef string (*HistoryFormatter)(const string& senderName, const string& message);
+
+class HistoryCursor;
+class HistoryReader;
+
+/**
+ * @class ChatHistory
+ * @brief Append-only message history that renders display strings on demand
+ *
+ * saveMessage() only appends a fixed-size record (with short text
+ * inline) and hands longer text to a block-compressed PayloadStore; no
+ * display string is built. Strings
+ * are rendered a page at a time when an iterator or cursor visits them
+ * and kept in a small LRU of pages. Changing the formatter, or any
+ * user's display name, makes the next visit re-render.
+ *
+ * Every TIME_INDEX_BLOCK records, the block's time span is added to a
+ * sparse index. seek() binary-searches the index and then one block, so
+ * finding the first message at or after a time is O(log n) and touches
+ * a few cache lines instead of scanning from the start.
+ *
+ * Records live in an AppendLog, so they never move. The room's thread
+ * appends and uses the rendered views (at(), page(), cursor()); other
+ * threads read raw records and payloads through a HistoryReader, without
+ * locks, while the room keeps appending.
+ */
+class ChatHistory
+{
+public:
+    static const size_t PAGE_SIZE = 64;
+    static const size_t CACHED_PAGES = 16;
+    static const size_t TIME_INDEX_BLOCK = 256;
+
+    /**
+     * @struct RenderedPage
+     * @brief PAGE_SIZE consecutive display strings (the last page may be partial)
+     */
+    struct RenderedPage
+    {
+        vector<string> lines; // capacity reserved up front, so references stay valid
+        uint64_t epoch;
+    };
+    typedef shared_ptr<RenderedPage> PagePtr;
+
+    ChatHistory();
+    ~ChatHistory();
+
+    /**
+     * @brief Append a message
+     * @param sender The user who sent the message
+     * @param message The raw message text
+     * @return Index of the new entry
+     */
+    size_t append(Users* sender, const string& message);
+
+    /**
+     * @brief Append a message with a given save time (imports, replays)
+     * @param sender The user who sent the message
+     * @param message The raw message text
+     * @param timestampUs Save time; raised to the last entry's if earlier
+     * @return Index of the new entry
+     */
+    size_t append(Users* sender, const string& message, int64_t timestampUs);
+
+    /**
+     * @brief Append a message by a sender known only by its identity
+     * @param sender The sender's identity, which may already be retired
+     * @param message The raw message text
+     * @return Index of the new entry
+     */
+    size_t append(const SenderHandle& sender, const string& message);
+
+    /**
+     * @brief Append a message saved elsewhere, keeping its time and sequence
+     * @param sender The sender's identity, which may already be retired
+     * @param message The raw message text
+     * @param timestampUs Original save time; raised to the last entry's if earlier
+     * @param sequence Original sequence number (unique only where it was assigned)
+     * @return Index of the new entry
+     */
+    size_t append(const SenderHandle& sender, const string& message, int64_t timestampUs, uint64_t sequence);
+
+    /**
+     * @brief Get the number of saved messages
+     * @return Entry count
+     */
+    size_t size() const { return records.size(); }
+
+    /**
+     * @brief Check whether the history is empty
+     * @return true if nothing was saved
+     */
+    bool empty() const { return records.empty(); }
+
+    /**
+     * @brief Get the raw record of an entry
+     * @param index Position in history
+     * @return The stored record
+     */
+    const HistoryRecord& record(size_t index) const { return records[index]; }
+
+    /**
+     * @brief Get the sender of an entry, if it still exists
+     * @param index Position in history
+     * @return The user, or nullptr if it was destroyed (or none was given)
+     */
+    Users* sender(size_t index) const {
+        const SenderHandle& who = senders[records[index].senderSlot];
+        return who ? who->getUser() : nullptr;
+    }
+
+    /**
+     * @brief Get the sender's name (its last name if it was destroyed)
+     * @param index Position in history
+     * @return Display name, empty if no sender was given
+     */
+    string senderName(size_t index) const {
+        const SenderHandle& who = senders[records[index].senderSlot];
+        return who ? who->getName() : string();
+    }
+
+    /**
+     * @brief Get the raw message text of an entry
+     * @param index Position in history
+     * @return The message as sent (empty if its stored block is corrupt)
+     */
+    string payload(size_t index) const;
+
+    /**
+     * @brief Find the first entry saved at or after a time
+     * @param timestampUs Time in microseconds since the epoch
+     * @return Index of that entry, or size() if every entry is older
+     */
+    size_t seek(int64_t timestampUs) const { return seekWithin(timestampUs, records.size()); }
+
+    /**
+     * @brief Get the display string of an entry (rendered through the page cache)
+     * @param index Position in history
+     * @return The formatted entry
+     */
+    string at(size_t index);
+
+    /**
+     * @brief Get a rendered page, rendering it if it is missing or stale
+     * @param pageIndex Page number (entry index / PAGE_SIZE)
+     * @return Shared page; stays valid for the holder even if evicted
+     */
+    PagePtr page(size_t pageIndex);
+
+    /**
+     * @brief Replace the display formatter (invalidates this history's pages)
+     * @param fn The new formatter
+     */
+    void setFormatter(HistoryFormatter fn);
+
+    /**
+     * @brief Create a cursor over the current entries
+     * @return Cursor viewing entries [0, size())
+     */
+    HistoryCursor cursor();
+
+    /**
+     * @brief Create a cursor starting at a time
+     * @param fromUs First save time to include
+     * @return Cursor viewing entries saved at or after fromUs
+     */
+    HistoryCursor cursorFrom(int64_t fromUs);
+
+    /**
+     * @brief Create a cursor over a time range
+     * @param fromUs First save time to include
+     * @param toUs End of the range (exclusive)
+     * @return Cursor viewing entries saved in [fromUs, toUs)
+     */
+    HistoryCursor cursorBetween(int64_t fromUs, int64_t toUs);
+
+    /**
+     * @brief Create a reader usable from any thread
+     * @return Reader viewing the entries published so far
+     */
+    HistoryReader reader() const;
+
+    /**
+     * @brief Get the bytes held by records and payloads (excluding the page cache)
+     * @return Stored bytes
+     */
+    size_t storedBytes() const;
+
+    /**
+     * @brief Charge stored bytes and entries to an account (MEM_HISTORY)
+     * @param owner The account, or nullptr to stop; what was charged moves with it
+     */
+    void setMemoryAccount(MemoryAccount* owner);
+
+    /**
+     * @brief Get a breakdown of storage use
+     * @return Storage statistics
+     */
+    HistoryStorageStats getStorageStats() const;
+
+    /**
+     * @brief Get the number of pages rendered so far (cache misses)
+     * @return Render count
+     */
+    uint64_t getPagesRendered() const { return pagesRendered; }
+
+    /**
+     * @brief Mark every rendered page of every history as stale
+     *
+     * Called when a display name changes, since any room may show it.
+     */
+    static void invalidateAllPages();
+
+    /**
+     * @brief Default formatter: "name: message"
+     */
+    static string defaultFormat(const string& senderName, const string& message);
+
+    /**
+     * @brief Get the current wall-clock time in history timestamp units
+     * @return Microseconds since the epoch
+     */
+    static int64_t nowUs();
+
+private:
+    typedef list<size_t> PageList;
+
+    struct CachedPage
+    {
+        PagePtr page;
+        PageList::iterator lru;
+    };
+
+    void renderInto(RenderedPage& target, size_t pageIndex);
+    size_t seekWithin(int64_t timestampUs, size_t limit) const;
+    void chargeStorage();
+    size_t append(const SenderHandle& sender, const string& message, int64_t timestampUs);
+    uint32_t senderSlot(const SenderHandle& sender);
+
+    AppendLog<HistoryRecord, 256> records;
+    AppendLog<TimeIndexEntry, 64> timeIndex;   // one entry per full block
+    AppendLog<SenderHandle, 64> senders;       // one per distinct sender, in order of first message
+    unordered_map<const SenderIdentity*, uint32_t> senderSlots;
+    int64_t lastTimestampUs;
+    PayloadStore store;
+    size_t inlineCount;
+    size_t inlineBytes;
+    HistoryFormatter formatter;
+    MemoryAccount* account;
+    size_t chargedBytes;
+
+    friend class HistoryReader;
+
+    unordered_map<size_t, CachedPage> pageCache;
+    PageList lruPages; // most recently used at the front
+    uint64_t localEpoch;
+    uint64_t pagesRendered;
+
+    static atomic<uint64_t> globalEpoch;
+    static atomic<uint64_t> nextSequence;
+};
+
+/**
+ * @class HistoryReader
+ * @brief Lock-free view of a history prefix for threads other than the room's
+ *
+ * A reader sees the entries that were published when it was created or
+ * last refreshed, and every one of them stays readable while the room
+ * keeps appending. It decodes compressed blocks into its own cache, so
+ * readers never contend with each other or with the writer. Senders
+ * resolve through the history's sender table like ChatHistory::sender().
+ */
+class HistoryReader
+{
+public:
+    explicit HistoryReader(const ChatHistory* source)
+        : history(source), limit(source->size()) {
+        history->store.addReader(cache);
+    }
+
+    HistoryReader(HistoryReader&& other)
+        : history(other.history), limit(other.limit), cache(other.cache) {
+        other.history = nullptr;
+    }
+
+    ~HistoryReader() {
+        if (history) {
+            history->store.removeReader(cache);
+        }
+    }
+
+    /**
+     * @brief Extend the view to everything published since
+     * @return New entry count
+     */
+    size_t refresh() {
+        limit = history->size();
+        return limit;
+    }
+
+    /**
+     * @brief Get the number of entries in the view
+     * @return Entry count
+     */
+    size_t size() const { return limit; }
+
+    /**
+     * @brief Get the raw record of an entry
+     * @param index Position, below size()
+     * @return The stored record
+     */
+    const HistoryRecord& record(size_t index) const { return history->records[index]; }
+
+    /**
+     * @brief Get the sender of an entry, if it still exists
+     * @param index Position, below size()
+     * @return The user, or nullptr if it was destroyed
+     */
+    Users* sender(size_t index) const { return history->sender(index); }
+
+    /**
+     * @brief Get the sender's name (its last name if it was destroyed)
+     * @param index Position, below size()
+     * @return Display name
+     */
+    string senderName(size_t index) const { return history->senderName(index); }
+
+    /**
+     * @brief Find the first entry in the view saved at or after a time
+     * @param timestampUs Time in microseconds since the epoch
+     * @return Index of that entry, or size() if every entry is older
+     */
+    size_t seek(int64_t timestampUs) const { return history->seekWithin(timestampUs, limit); }
+
+    /**
+     * @brief Copy out the message text of an entry
+     * @param index Position, below size()
+     * @param out Receives the message (empty on failure)
+     * @return false if its stored block is corrupt
+     */
+    bool payload(size_t index, string& out) {
+        const HistoryRecord& entry = history->records[index];
+        if (entry.isInline()) {
+            out.assign(entry.inlineText, entry.payloadLength);
+            return true;
+        }
+        return history->store.read(entry.stored.block, entry.stored.offset, entry.payloadLength, out, cache);
+    }
+
+private:
+    HistoryReader(const HistoryReader&);
+    HistoryReader& operator=(const HistoryReader&);
+
+    const ChatHistory* history;
+    size_t limit;
+    PayloadStore::DecodeCache cache;
+};
+
+/**
+ * @struct HistoryBatch
+ * @brief Contiguous rendered entries from one page
+ *
+ * The batch shares ownership of its page, so its strings stay valid for
+ * as long as the batch is held, even after the cursor moves on or the
+ * page cache evicts or re-renders the page.
+ */
+struct HistoryBatch
+{
+    HistoryBatch() : lines(nullptr), count(0) {}
+
+    const string& operator[](size_t i) const { return lines[i]; }
+    size_t size() const { return count; }
+
+    ChatHistory::PagePtr page;
+    const string* lines;
+    size_t count;
+};
+
+/**
+ * @class HistoryCursor
+ * @brief Value-type cursor over a range of history entries
+ *
+ * Copies single entries out through next(), hands out whole pages
+ * without copying through nextBatch(), and exposes begin()/end() for
+ * range-for. The range is fixed when the cursor is created. Pages that
+ * are not in the cache are rendered on first use.
+ */
+class HistoryCursor
+{
+public:
+    /**
+     * @class const_iterator
+     * @brief Forward iterator yielding display strings
+     *
+     * The iterator holds the page it last read, so a reference from
+     * operator* stays valid until that iterator is dereferenced on
+     * another page or destroyed. Copy the string to keep it longer.
+     */
+    class const_iterator
+    {
+    public:
+        typedef forward_iterator_tag iterator_category;
+        typedef string value_type;
+        typedef ptrdiff_t difference_type;
+        typedef const string* pointer;
+        typedef const string& reference;
+
+        const_iterator() : history(nullptr), index(0), loadedPage(SIZE_MAX) {}
+        const_iterator(ChatHistory* h, size_t i) : history(h), index(i), loadedPage(SIZE_MAX) {}
+
+        reference operator*() const {
+            size_t pageIndex = index / ChatHistory::PAGE_SIZE;
+            if (pageIndex != loadedPage) {
+                page = history->page(pageIndex);
+                loadedPage = pageIndex;
+            }
+            return page->lines[index % ChatHistory::PAGE_SIZE];
+        }
+        pointer operator->() const { return &**this; }
+        const_iterator& operator++() { ++index; return *this; }
+        const_iterator operator++(int) { const_iterator old = *this; ++index; return old; }
+        bool operator==(const const_iterator& other) const { return index == other.index; }
+        bool operator!=(const const_iterator& other) const { return index != other.index; }
+
+    private:
+        ChatHistory* history;
+        size_t index;
+        mutable ChatHistory::PagePtr page;
+        mutable size_t loadedPage;
+    };
+
+    /**
+     * @brief Constructor
+     * @param h The history to view
+     * @param begin First entry index
+     * @param end One past the last entry index
+     */
+    HistoryCursor(ChatHistory* h, size_t begin, size_t end)
+        : history(h), first(begin), last(end), pos(begin), loadedPage(SIZE_MAX) {}
+
+    /**
+     * @brief Check if there are more entries
+     * @return true if more entries exist
+     */
+    bool hasNext() const {
+        return pos < last;
+    }
+
+    /**
+     * @brief Get a copy of the next entry
+     * @return The rendered entry (caller must check hasNext())
+     */
+    string next() {
+        const string& line = currentPage()->lines[pos % ChatHistory::PAGE_SIZE];
+        pos++;
+        return line;
+    }
+
+    /**
+     * @brief Fetch up to max entries from the current page in one call
+     * @param out Receives the entries and a share of their page
+     * @param max Maximum number of entries to fetch
+     * @return Number of entries in out (0 at the end)
+     */
+    size_t nextBatch(HistoryBatch& out, size_t max) {
+        if (pos >= last) {
+            out = HistoryBatch();
+            return 0;
+        }
+        size_t offset = pos % ChatHistory::PAGE_SIZE;
+        size_t n = ChatHistory::PAGE_SIZE - offset;
+        if (n > last - pos) n = last - pos;
+        if (n > max) n = max;
+        out.page = currentPage();
+        out.lines = &out.page->lines[offset];
+        out.count = n;
+        pos += n;
+        return n;
+    }
+
+    /**
+     * @brief Reset cursor to start
+     */
+    void reset() {
+        pos = first;
+    }
+
+    /**
+     * @brief Get the number of entries in the view
+     * @return Entry count
+     */
+    size_t size() const {
+        return last - first;
+    }
+
+    const_iterator begin() const { return const_iterator(history, first); }
+    const_iterator end() const { return const_iterator(history, last); }
+
+private:
+    const ChatHistory::PagePtr& currentPage() {
+        size_t pageIndex = pos / ChatHistory::PAGE_SIZE;
+        if (pageIndex != loadedPage) {
+            page = history->page(pageIndex);
+            loadedPage = pageIndex;
+        }
+        return page;
+    }
+
+    ChatHistory* history;
+    size_t first;
+    size_t last;
+    size_t pos;
+    ChatHistory::PagePtr page;
+    size_t loadedPage;
+};
+
+#endif
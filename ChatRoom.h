@@ -9,9 +9,24 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <unordered_map>
 #include "Users.h"
 #include "Observer.h"
 #include "Iterator.h"
+#include "MessageVisibility.h"
+#include "RecipientSet.h"
+#include "AdmissionController.h"
+#include "MessageDeduplicator.h"
+#include "PresenceChannel.h"
+#include "DeliveryScheduler.h"
+#include "MessagePriority.h"
+#include "MessageFilter.h"
+#include "RoomAnalytics.h"
+#include "TraceRecorder.h"
 
 using namespace std;
 
@@ -27,17 +42,210 @@ using namespace std;
 class ChatRoom : public Subject
 {
 protected:
-    vector<Users*> users;
-    vector<string> chatHistory;
+    MemberList users;
+    ChatHistory chatHistory;
     string roomName;
+    
+    // Indexes for targeted delivery (O(1) membership, O(group) fan-out).
+    // Each member maps to the next history entry it has yet to pull.
+    typedef unordered_map<Users*, size_t, hash<Users*>, equal_to<Users*>,
+                          TrackingAllocator<pair<Users* const, size_t> > > MemberIndex;
+    MemberIndex memberIndex;
+    unordered_map<string, vector<Users*> > tagIndex;
+    unordered_map<Users*, vector<string> > memberTags;
+    mutable RecipientSet listedRecipients;   // scratch for resolveRecipients, empty between calls
+    
+    // Visibility of non-public history entries, keyed by history index
+    map<size_t, MessageVisibility> restrictedHistory;
+    
+    // Rate limiting (not owned; nullptr admits everything)
+    AdmissionController* admission;
+    TokenBucket sendBucket;
+    
+    // Client message IDs seen recently (created on first use)
+    MessageDeduplicator* deduplicator;
+    
+    // Ephemeral presence/typing state, separate from history and notifications
+    PresenceChannel presence;
+    
+    // Pre-delivery pipeline, run in order (not owned)
+    vector<MessageFilter*> filters;
+    
+    // Deferred, prioritised execution (not owned; nullptr runs commands inline)
+    DeliveryScheduler* scheduler;
+    MessagePriority notificationPriority;
+    
+    // Hybrid delivery: public sends in rooms above the threshold are written
+    // once and pulled by members; these history ranges [first, second) hold them
+    size_t fanoutThreshold;
+    vector<pair<size_t, size_t> > pulledRanges;
+    
+    // Streaming statistics (owned; created by enableAnalytics)
+    RoomAnalytics* analytics;
+    
+    // Operation capture for replay (not owned). A join or leave is followed
+    // by its own notification, which replay regenerates: it is not recorded
+    TraceRecorder* recorder;
+    bool membershipNotice;
+    
+    /**
+     * @brief Add a user to the membership index (call from registerUser)
+     * @param user The user that joined
+     */
+    void indexMember(Users* user) {
+        // New members only pull what is published after they joined
+        size_t before = memberIndex.size();
+        memberIndex[user] = chatHistory.size();
+        memory.addObjects(MEM_MEMBERS, static_cast<int64_t>(memberIndex.size() - before));
+        if (analytics) {
+            analytics->recordJoin();
+        }
+        if (recorder) {
+            recorder->recordJoin(this, user);
+            membershipNotice = true;
+        }
+    }
+    
+    /**
+     * @brief Drop a user from the membership and tag indexes (call from removeUser)
+     * @param user The user that left
+     */
+    void unindexMember(Users* user) {
+        if (memberIndex.erase(user)) {
+            memory.addObjects(MEM_MEMBERS, -1);
+            if (analytics) {
+                analytics->recordLeave();
+            }
+            if (recorder) {
+                recorder->recordLeave(this, user);
+                membershipNotice = true;
+            }
+        }
+        presence.forget(user);
+        presence.removeListener(user);
+        unordered_map<Users*, vector<string> >::iterator tags = memberTags.find(user);
+        if (tags != memberTags.end()) {
+            for (const string& tag : tags->second) {
+                vector<Users*>& group = tagIndex[tag];
+                group.erase(find(group.begin(), group.end(), user));
+            }
+            memberTags.erase(tags);
+        }
+    }
+    
+    /**
+     * @brief Feed a saved message to the room's analytics (call from saveMessage)
+     * @param fromUser The sender
+     * @param message The saved text
+     */
+    void recordSaved(Users* fromUser, const string& message) {
+        if (analytics) {
+            analytics->recordMessage(fromUser->getIdentity(), message.size());
+        }
+    }
+
+    /**
+     * @brief Bring chatHistory up to date before it is read
+     *
+     * Called by every history accessor. Local rooms hold their history
+     * already; proxies for rooms that live elsewhere override this to pull in
+     * entries saved since the last read.
+     */
+    virtual void refreshHistory() {}
 
 public:
     /**
      * @brief Constructor
      * @param name The name of the chat room
      */
-    ChatRoom(const std::string& name) : roomName(name) {}
-    virtual ~ChatRoom() {}
+    ChatRoom(const std::string& name) 
+        : Subject(MemoryAccount::ROOM, name), users(MemberList::allocator_type(&memory, MEM_MEMBERS)),
+          roomName(name), memberIndex(MemberIndex::allocator_type(&memory, MEM_MEMBERS)),
+          admission(nullptr), deduplicator(nullptr),
+          scheduler(nullptr), notificationPriority(PRIORITY_HIGH), fanoutThreshold(SIZE_MAX),
+          analytics(nullptr), recorder(nullptr), membershipNotice(false) {
+        chatHistory.setMemoryAccount(&memory);
+    }
+    virtual ~ChatRoom() {
+        // Members must not keep a pointer to a room that no longer exists
+        for (Users* user : users) {
+            user->removeChatRoom(this);
+        }
+        for (Observer* observer : observers) {
+            Users* user = dynamic_cast<Users*>(observer);
+            if (user) {
+                user->removeSubscription(this);
+            }
+        }
+        if (scheduler) {
+            scheduler->dropRoom(this);
+        }
+        if (admission) {
+            admission->dropRoom(this);
+        }
+        if (recorder) {
+            recorder->forgetRoom(this);
+        }
+        delete deduplicator;
+        delete analytics;
+    }
+    
+    /**
+     * @brief Drop a user without announcing it (used when the user is destroyed)
+     * @param user The user being destroyed
+     *
+     * Unlike removeUser this neither prints nor notifies, since the user
+     * can no longer be referred to by name once its destructor runs.
+     */
+    virtual void detachUser(Users* user) {
+        MemberList::iterator it = find(users.begin(), users.end(), user);
+        if (it != users.end()) {
+            users.erase(it);
+            unindexMember(user);
+            membershipNotice = false; // no notification follows a detach
+        }
+        unsubscribe(user);
+        // A later user at the same address must not see its direct messages
+        for (auto& entry : restrictedHistory) {
+            entry.second.forget(user);
+        }
+        if (recorder) {
+            recorder->forgetUser(user);
+        }
+    }
+    
+    /**
+     * @brief Subscribe an observer to notifications (recorded if it is a user)
+     * @param observer The observer to add
+     */
+    void subscribe(Observer* observer) override {
+        size_t before = observers.size();
+        Subject::subscribe(observer);
+        Users* user = observers.size() != before ? dynamic_cast<Users*>(observer) : nullptr;
+        if (user) {
+            // Kept after the user leaves: its destructor unsubscribes it
+            user->addSubscription(this);
+            if (recorder) {
+                recorder->recordSubscribe(this, user);
+            }
+        }
+    }
+    
+    /**
+     * @brief Unsubscribe an observer from notifications (recorded if it is a user)
+     * @param observer The observer to remove
+     */
+    void unsubscribe(Observer* observer) override {
+        size_t before = observers.size();
+        Subject::unsubscribe(observer);
+        Users* user = observers.size() != before ? dynamic_cast<Users*>(observer) : nullptr;
+        if (user) {
+            user->removeSubscription(this);
+            if (recorder) {
+                recorder->recordUnsubscribe(this, user);
+            }
+        }
+    }
     
     /**
      * @brief Register a user to the chat room
@@ -65,19 +273,244 @@ public:
      */
     virtual void saveMessage(string message, Users* fromUser) = 0;
     
+    /**
+     * @brief Send a message only to the audience described by visibility
+     * @param message The message content
+     * @param fromUser The user sending the message
+     * @param visibility The resolved audience (see resolveRecipients)
+     *
+     * Cost is proportional to the number of recipients, not the room size.
+     * Recipients that are not members of this room are skipped.
+     */
+    virtual void sendMessage(string message, Users* fromUser, const MessageVisibility& visibility) {
+        if (visibility.scope == MessageVisibility::ROOM) {
+            sendMessage(message, fromUser);
+            return;
+        }
+        for (Users* user : visibility.recipients) {
+            if (user != fromUser && isMember(user)) {
+                user->receive(message, fromUser, this);
+            }
+        }
+    }
+    
+    /**
+     * @brief Save a targeted message to chat history with its visibility
+     * @param message The message content
+     * @param fromUser The user who sent the message
+     * @param visibility Who the message was addressed to
+     */
+    virtual void saveMessage(string message, Users* fromUser, const MessageVisibility& visibility) {
+        saveMessage(message, fromUser);
+        if (visibility.scope != MessageVisibility::ROOM) {
+            restrictedHistory[chatHistory.size() - 1] = visibility;
+        }
+    }
+    
+    /**
+     * @brief Save a message that members will pull instead of being pushed
+     * @param message The message content
+     * @param fromUser The user who sent the message
+     */
+    void publishMessage(const string& message, Users* fromUser) {
+        saveMessage(message, fromUser);
+        size_t index = chatHistory.size() - 1;
+        if (!pulledRanges.empty() && pulledRanges.back().second == index) {
+            pulledRanges.back().second++;
+        } else {
+            pulledRanges.push_back(make_pair(index, index + 1));
+        }
+    }
+    
+    /**
+     * @brief Set the member count above which public sends are pulled, not pushed
+     * @param members Threshold (SIZE_MAX, the default, always pushes)
+     *
+     * Pushing costs one receive() per member on every send. Above the
+     * threshold a send is a single history write, and each member pays
+     * for the messages it actually reads when it calls deliverPending().
+     */
+    void setFanoutThreshold(size_t members) {
+        fanoutThreshold = members;
+    }
+    
+    /**
+     * @brief Get the hybrid delivery threshold
+     * @return Member count above which sends are pulled
+     */
+    size_t getFanoutThreshold() const {
+        return fanoutThreshold;
+    }
+    
+    /**
+     * @brief Check whether sendMessage reaches members by calling their receive() here
+     * @return false for rooms whose fan-out happens elsewhere (e.g. a federation worker)
+     */
+    virtual bool fansOutLocally() const {
+        return true;
+    }
+    
+    /**
+     * @brief Check whether a public send would currently be pulled by members
+     * @return true if the room fans out locally and is above its fan-out threshold
+     */
+    bool deliversOnRead() const {
+        return users.size() > fanoutThreshold && fansOutLocally();
+    }
+    
+    /**
+     * @brief Count the published messages a member has not pulled yet
+     * @param user The member
+     * @return Pending messages (including the member's own, which are skipped on delivery)
+     */
+    size_t pendingFor(Users* user) const {
+        MemberIndex::const_iterator member = memberIndex.find(user);
+        if (member == memberIndex.end()) {
+            return 0;
+        }
+        size_t pending = 0;
+        for (size_t i = firstPulledRange(member->second); i < pulledRanges.size(); i++) {
+            pending += pulledRanges[i].second - max(pulledRanges[i].first, member->second);
+        }
+        return pending;
+    }
+    
+    /**
+     * @brief Deliver the published messages a member has not pulled yet
+     * @param user The member becoming active
+     * @return Number of messages passed to user->receive()
+     *
+     * Walks only the pulled ranges after the member's cursor, so the
+     * cost is proportional to what the member reads, not the room size.
+     */
+    size_t deliverPending(Users* user) {
+        MemberIndex::iterator member = memberIndex.find(user);
+        if (member == memberIndex.end()) {
+            return 0;
+        }
+        // Advance the cursor first: receive() may send, join or leave
+        size_t cursor = member->second;
+        size_t end = chatHistory.size();
+        member->second = end;
+        
+        size_t delivered = 0;
+        for (size_t i = firstPulledRange(cursor); i < pulledRanges.size(); i++) {
+            size_t last = min(pulledRanges[i].second, end);
+            for (size_t index = max(pulledRanges[i].first, cursor); index < last; index++) {
+                Users* sender = chatHistory.sender(index); // nullptr once destroyed
+                if (sender != user) {
+                    user->receive(chatHistory.payload(index), sender, this);
+                    delivered++;
+                }
+            }
+        }
+        return delivered;
+    }
+    
+    /**
+     * @brief Fill in the recipients of a TAG visibility from the tag index,
+     *        and drop repeated recipients from a GROUP one
+     * @param visibility The visibility to resolve (other scopes are unchanged)
+     */
+    void resolveRecipients(MessageVisibility& visibility) const {
+        if (visibility.scope == MessageVisibility::TAG) {
+            visibility.recipients = getTagMembers(visibility.tag);
+        } else if (visibility.scope == MessageVisibility::GROUP) {
+            // A recipient listed twice still gets one copy; order is kept
+            vector<Users*>& listed = visibility.recipients;
+            size_t kept = 0;
+            for (Users* user : listed) {
+                if (listedRecipients.insert(user->getDenseId())) {
+                    listed[kept++] = user;
+                }
+            }
+            listed.resize(kept);
+            listedRecipients.clear();
+        }
+    }
+    
+    /**
+     * @brief Check membership in O(1)
+     * @param user The user to look up
+     * @return true if the user is registered in this room
+     */
+    bool isMember(Users* user) const {
+        return memberIndex.count(user) != 0;
+    }
+    
+    /**
+     * @brief Give a member a role or tag for group delivery
+     * @param user The member to tag
+     * @param tag The tag name
+     * @return false if the user is not a member or already has the tag
+     */
+    bool tagUser(Users* user, const string& tag) {
+        if (!isMember(user)) {
+            return false;
+        }
+        vector<string>& tags = memberTags[user];
+        if (find(tags.begin(), tags.end(), tag) != tags.end()) {
+            return false;
+        }
+        tags.push_back(tag);
+        tagIndex[tag].push_back(user);
+        return true;
+    }
+    
+    /**
+     * @brief Remove a role or tag from a member
+     * @param user The member to untag
+     * @param tag The tag name
+     */
+    void untagUser(Users* user, const string& tag) {
+        unordered_map<Users*, vector<string> >::iterator tags = memberTags.find(user);
+        if (tags == memberTags.end()) {
+            return;
+        }
+        vector<string>::iterator it = find(tags->second.begin(), tags->second.end(), tag);
+        if (it != tags->second.end()) {
+            tags->second.erase(it);
+            vector<Users*>& group = tagIndex[tag];
+            group.erase(find(group.begin(), group.end(), user));
+        }
+    }
+    
+    /**
+     * @brief Get the members carrying a tag
+     * @param tag The tag name
+     * @return The tagged members (empty if none)
+     */
+    const vector<Users*>& getTagMembers(const string& tag) const {
+        static const vector<Users*> none;
+        unordered_map<string, vector<Users*> >::const_iterator it = tagIndex.find(tag);
+        return it == tagIndex.end() ? none : it->second;
+    }
+    
+    /**
+     * @brief Get the visibility of a history entry
+     * @param index Position in chat history
+     * @return The entry's visibility (ROOM for public messages)
+     */
+    const MessageVisibility& getVisibility(size_t index) const {
+        static const MessageVisibility everyone;
+        map<size_t, MessageVisibility>::const_iterator it = restrictedHistory.find(index);
+        return it == restrictedHistory.end() ? everyone : it->second;
+    }
+    
     /**
      * @brief Get the list of users
      * @return Reference to the users vector
      */
-    vector<Users*>& getUsers() {
+    MemberList& getUsers() {
         return users;
     }
     
     /**
      * @brief Get the chat history
-     * @return Reference to the chat history vector
+     * @return Reference to the structured chat history
      */
-    vector<string>& getChatHistory() {
+    ChatHistory& getChatHistory() {
+        refreshHistory();
         return chatHistory;
     }
     
@@ -94,9 +527,250 @@ public:
      * @return Pointer to ChatHistoryIterator
      */
     Iterator<string>* createChatHistoryIterator() {
+        refreshHistory();
         return new ChatHistoryIterator(&chatHistory);
     }
     
+    /**
+     * @brief Create a cursor over the user list (no allocation)
+     * @return UserCursor viewing the current members
+     */
+    UserCursor userCursor() const {
+        return UserCursor(users);
+    }
+    
+    /**
+     * @brief Create a cursor over the chat history (renders pages on demand)
+     * @return HistoryCursor viewing the current history
+     */
+    HistoryCursor historyCursor() {
+        refreshHistory();
+        return chatHistory.cursor();
+    }
+
+    /**
+     * @brief Create a cursor over the history saved since a time
+     * @param fromUs Microseconds since the epoch (see ChatHistory::nowUs)
+     * @return HistoryCursor starting at the first entry saved at or after fromUs
+     */
+    HistoryCursor historySince(int64_t fromUs) {
+        refreshHistory();
+        return chatHistory.cursorFrom(fromUs);
+    }
+
+    /**
+     * @brief Attach an admission controller that gates Users::send
+     * @param controller The controller (not owned), or nullptr to disable
+     */
+    void setAdmissionController(AdmissionController* controller) {
+        admission = controller;
+    }
+    
+    /**
+     * @brief Get the attached admission controller
+     * @return The controller, or nullptr if sends are not limited
+     */
+    AdmissionController* getAdmissionController() const {
+        return admission;
+    }
+    
+    /**
+     * @brief Append a stage to the pre-delivery filter pipeline
+     * @param filter The filter (not owned)
+     */
+    void addFilter(MessageFilter* filter) {
+        filters.push_back(filter);
+    }
+    
+    /**
+     * @brief Remove a stage from the pre-delivery filter pipeline
+     * @param filter The filter to remove
+     */
+    void removeFilter(MessageFilter* filter) {
+        vector<MessageFilter*>::iterator it = find(filters.begin(), filters.end(), filter);
+        if (it != filters.end()) {
+            filters.erase(it);
+        }
+    }
+    
+    /**
+     * @brief Run a message through the filter pipeline (called before commands are created)
+     * @param message The message text; filters may rewrite it
+     * @param fromUser The sender
+     * @return FILTER_REJECT if any stage rejected it, otherwise whether it was rewritten
+     */
+    virtual FilterVerdict screenMessage(string& message, Users* fromUser) {
+        FilterVerdict result = FILTER_ALLOW;
+        for (MessageFilter* filter : filters) {
+            FilterVerdict verdict = filter->inspect(message, fromUser, this);
+            if (verdict == FILTER_REJECT) {
+                return FILTER_REJECT;
+            }
+            if (verdict == FILTER_REWRITTEN) {
+                result = FILTER_REWRITTEN;
+            }
+        }
+        return result;
+    }
+    
+    /**
+     * @brief Attach a delivery scheduler; commands and notifications are then
+     *        queued by priority instead of running inline
+     * @param deliveryScheduler The scheduler (not owned), or nullptr to disable
+     */
+    void setDeliveryScheduler(DeliveryScheduler* deliveryScheduler) {
+        scheduler = deliveryScheduler;
+    }
+    
+    /**
+     * @brief Get the attached delivery scheduler
+     * @return The scheduler, or nullptr if commands run inline
+     */
+    DeliveryScheduler* getDeliveryScheduler() const {
+        return scheduler;
+    }
+    
+    /**
+     * @brief Set the class of this room's join/leave notifications (default HIGH)
+     * @param priority The priority class
+     */
+    void setNotificationPriority(MessagePriority priority) {
+        notificationPriority = priority;
+    }
+    
+    /**
+     * @brief Notify observers, through the scheduler if one is attached
+     * @param message The notification message
+     * @param roomName The name of the room sending the notification
+     */
+    void notify(const string& message, const string& roomName) override {
+        notify(message, roomName, notificationPriority);
+    }
+    
+    /**
+     * @brief Notify observers in a specific priority class
+     * @param message The notification message
+     * @param roomName The name of the room sending the notification
+     * @param priority The priority class
+     */
+    void notify(const string& message, const string& roomName, MessagePriority priority) {
+        if (analytics) {
+            analytics->recordNotification();
+        }
+        if (recorder) {
+            if (membershipNotice) {
+                membershipNotice = false;
+            } else {
+                recorder->recordNotify(this, message);
+            }
+        }
+        if (scheduler) {
+            scheduler->enqueueNotification(this, message, roomName, priority);
+        } else {
+            Subject::notify(message, roomName);
+        }
+    }
+    
+    /**
+     * @brief Notify observers immediately (used by NotifyCommand)
+     * @param message The notification message
+     * @param roomName The name of the room sending the notification
+     */
+    void notifyNow(const string& message, const string& roomName) {
+        Subject::notify(message, roomName);
+    }
+    
+    /**
+     * @brief Get this room's rate limit state
+     * @return Reference to the room's token bucket
+     */
+    TokenBucket& getSendBucket() {
+        return sendBucket;
+    }
+    
+    /**
+     * @brief Check whether a client message ID was already accepted here
+     * @param fromUser The sender
+     * @param messageId The client-supplied message ID
+     * @return true if the send is a retry of a delivered or still queued message
+     */
+    bool isDuplicateMessage(Users* fromUser, uint64_t messageId) {
+        return getDeduplicator().isDuplicate(MessageDeduplicator::makeKey(fromUser->getIdentity()->getId(), messageId));
+    }
+    
+    /**
+     * @brief Record an accepted client message ID (called by Users::dispatch
+     *        before the commands are run or queued)
+     * @param fromUser The sender
+     * @param messageId The client-supplied message ID
+     */
+    void recordMessageId(Users* fromUser, uint64_t messageId) {
+        getDeduplicator().record(MessageDeduplicator::makeKey(fromUser->getIdentity()->getId(), messageId));
+    }
+    
+    /**
+     * @brief Get the room's deduplicator, creating it on first use
+     * @return Reference to the deduplicator
+     */
+    MessageDeduplicator& getDeduplicator() {
+        if (!deduplicator) {
+            deduplicator = new MessageDeduplicator();
+        }
+        return *deduplicator;
+    }
+    
+    /**
+     * @brief Start collecting streaming statistics (joins, leaves, messages, notifications)
+     * @return The room's analytics, created on the first call
+     */
+    RoomAnalytics& enableAnalytics() {
+        if (!analytics) {
+            analytics = new RoomAnalytics();
+        }
+        return *analytics;
+    }
+    
+    /**
+     * @brief Get the room's analytics; safe to query from any thread
+     * @return The analytics, or nullptr if not enabled
+     */
+    const RoomAnalytics* getAnalytics() const {
+        return analytics;
+    }
+    
+    /**
+     * @brief Record this room's operations (joins, leaves, subscriptions, sends, notifications)
+     * @param traceRecorder The recorder (not owned; may be shared by rooms), or nullptr to stop
+     */
+    void setTraceRecorder(TraceRecorder* traceRecorder) {
+        recorder = traceRecorder;
+        membershipNotice = false;
+    }
+    
+    /**
+     * @brief Get the attached trace recorder
+     * @return The recorder, or nullptr if not recording
+     */
+    TraceRecorder* getTraceRecorder() const {
+        return recorder;
+    }
+    
+    /**
+     * @brief Get the room's presence and typing-indicator channel
+     * @return Reference to the presence channel
+     */
+    PresenceChannel& getPresence() {
+        return presence;
+    }
+    
+    /**
+     * @brief Deliver coalesced presence changes if a tick has elapsed
+     * @return Number of users in the delivered diff
+     */
+    size_t tickPresence() {
+        return presence.tick(this);
+    }
+    
     /**
      * @brief Get the room name
      * @return The name of the chat room
@@ -104,6 +778,22 @@ public:
     string getRoomName() const {
         return roomName;
     }
+
+private:
+    // Index of the first pulled range ending after a history position
+    size_t firstPulledRange(size_t position) const {
+        size_t low = 0;
+        size_t high = pulledRanges.size();
+        while (low < high) {
+            size_t mid = low + (high - low) / 2;
+            if (pulledRanges[mid].second <= position) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        return low;
+    }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,52 @@
+/**
+ * @file ChatSession.cpp
+ * @brief Implementation of arena-backed session ownership
+ */
+
+#include "ChatSession.h"
+
+using namespace std;
+
+ChatSession::~ChatSession()
+{
+    clear();
+}
+
+UserHandle ChatSession::createUser(const string& name)
+{
+    return userArena.create(name);
+}
+
+CtrlCatHandle ChatSession::createCtrlCat()
+{
+    return ctrlCatArena.create();
+}
+
+DogorithmHandle ChatSession::createDogorithm()
+{
+    return dogorithmArena.create();
+}
+
+bool ChatSession::destroy(UserHandle handle)
+{
+    return userArena.destroy(handle);
+}
+
+bool ChatSession::destroy(CtrlCatHandle handle)
+{
+    return ctrlCatArena.destroy(handle);
+}
+
+bool ChatSession::destroy(DogorithmHandle handle)
+{
+    return dogorithmArena.destroy(handle);
+}
+
+void ChatSession::clear()
+{
+    // Rooms first: each detaches from its members in O(members), after
+    // which users have no rooms left to unlink from
+    ctrlCatArena.clear();
+    dogorithmArena.clear();
+    userArena.clear();
+}
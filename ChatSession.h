@@ -0,0 +1,91 @@
+/**
+ * @file ChatSession.h
+ * @brief Arena-backed owner of the users and rooms of one session
+ */
+
+#ifndef CHATSESSION_H
+#define CHATSESSION_H
+
+#include <string>
+#include "SlabArena.h"
+#include "Users.h"
+#include "CtrlCat.h"
+#include "Dogorithm.h"
+
+using namespace std;
+
+typedef Handle<Users> UserHandle;
+typedef Handle<CtrlCat> CtrlCatHandle;
+typedef Handle<Dogorithm> DogorithmHandle;
+
+/**
+ * @class ChatSession
+ * @brief Creates users and rooms in per-type slab arenas and hands out handles
+ *
+ * Objects created here must not be deleted directly; destroy them through
+ * the session (or let clear()/the destructor tear everything down).
+ * Stale handles resolve to nullptr in O(1). Users of one session sit
+ * next to each other in memory, which keeps fan-out loops cache friendly.
+ */
+class ChatSession
+{
+public:
+    ChatSession() {}
+    ~ChatSession();
+
+    /**
+     * @brief Create a user
+     * @param name The user's name
+     * @return Handle to the user
+     */
+    UserHandle createUser(const string& name);
+
+    /**
+     * @brief Create a CtrlCat room
+     * @return Handle to the room
+     */
+    CtrlCatHandle createCtrlCat();
+
+    /**
+     * @brief Create a Dogorithm room
+     * @return Handle to the room
+     */
+    DogorithmHandle createDogorithm();
+
+    Users* get(UserHandle handle) const { return userArena.get(handle); }
+    CtrlCat* get(CtrlCatHandle handle) const { return ctrlCatArena.get(handle); }
+    Dogorithm* get(DogorithmHandle handle) const { return dogorithmArena.get(handle); }
+
+    /**
+     * @brief Destroy a user; it leaves every room it is a member of
+     * @param handle The user's handle
+     * @return false if the handle was stale
+     */
+    bool destroy(UserHandle handle);
+
+    /**
+     * @brief Destroy a room; its members forget it
+     * @param handle The room's handle
+     * @return false if the handle was stale
+     */
+    bool destroy(CtrlCatHandle handle);
+    bool destroy(DogorithmHandle handle);
+
+    /**
+     * @brief Tear down every room and then every user
+     */
+    void clear();
+
+    size_t userCount() const { return userArena.size(); }
+    size_t roomCount() const { return ctrlCatArena.size() + dogorithmArena.size(); }
+
+private:
+    ChatSession(const ChatSession&);
+    ChatSession& operator=(const ChatSession&);
+
+    SlabArena<Users> userArena;
+    SlabArena<CtrlCat, 16> ctrlCatArena;
+    SlabArena<Dogorithm, 16> dogorithmArena;
+};
+
+#endif
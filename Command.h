@@ -3,6 +3,8 @@
 #define COMMAND_H
 
 #include <string>
+#include <cstdint>
+#include "MessagePriority.h"
 
 using namespace std;
 
@@ -15,14 +17,26 @@ protected:
     ChatRoom* room;
     string message;
     Users* fromUser;
+    uint64_t messageId; // client-supplied ID, 0 if the send has none
+    MessagePriority priority;
 
 public:
     virtual ~Command() {} 
     
-    Command(ChatRoom* chatRoom, string msg, Users* user)
-        : room(chatRoom), message(msg), fromUser(user) {}
+    Command(ChatRoom* chatRoom, string msg, Users* user, uint64_t id = 0)
+        : room(chatRoom), message(msg), fromUser(user), messageId(id), priority(PRIORITY_NORMAL) {}
     
     virtual void execute() = 0;
+    
+    uint64_t getMessageId() const { return messageId; }
+    
+    ChatRoom* getRoom() const { return room; }
+    
+    // Called when a user is destroyed; true means the command must be discarded
+    virtual bool forgetUser(const Users* user) { return fromUser == user; }
+    
+    MessagePriority getPriority() const { return priority; }
+    void setPriority(MessagePriority level) { priority = level; }
 };
 
 #endif
\ No newline at end of file
@@ -7,10 +7,10 @@ using namespace std;
 void CtrlCat::registerUser(Users *user)
 {
     // Check if user is already registered
-    auto it = find(users.begin(), users.end(), user);
-    if (it == users.end())
+    if (!isMember(user))
     {
         users.push_back(user);
+        indexMember(user);
         user->addChatRoom(this); // Add this room to user's list
         cout << "[CtrlCat]: " << user->getName() << " has joined the room!" << endl;
         
@@ -27,6 +27,8 @@ void CtrlCat::removeUser(Users *user)
     {
         cout << "[CtrlCat]: " << user->getName() << " has left the room." << endl;
         users.erase(it);
+        unindexMember(user);
+        user->removeChatRoom(this);
         
         // Notify all subscribers that user left (Observer pattern)
         notify(user->getName() + " has left CtrlCat!", roomName);
@@ -47,8 +49,8 @@ void CtrlCat::sendMessage(string message, Users *fromUser)
 
 void CtrlCat::saveMessage(string message, Users *fromUser)
 {
-    // Save message to chat history
-    string historyEntry = fromUser->getName() + ": " + message;
-    chatHistory.push_back(historyEntry);
-    cout << "[CtrlCat - Message Saved]: " << historyEntry << endl;
+    // Save the raw message; the display string is rendered only when read
+    chatHistory.append(fromUser, message);
+    recordSaved(fromUser, message);
+    cout << "[CtrlCat - Message Saved]: " << fromUser->getName() << ": " << message << endl;
 }
\ No newline at end of file
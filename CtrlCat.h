@@ -26,6 +26,9 @@ public:
     void removeUser(Users* user) override;
     void sendMessage(string message, Users* fromUser) override;
     void saveMessage(string message, Users* fromUser) override;
+    
+    using ChatRoom::sendMessage;
+    using ChatRoom::saveMessage;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,304 @@
+/**
+ * @file DeliveryScheduler.cpp
+ * @brief Implementation of strict-priority, weighted-fair command scheduling
+ */
+
+#include "DeliveryScheduler.h"
+#include "Command.h"
+#include "NotifyCommand.h"
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+struct LiveSchedulers
+{
+    mutex lock;
+    vector<DeliveryScheduler*> all;
+};
+
+// Never destroyed: static users may be destroyed during exit
+LiveSchedulers& liveSchedulers()
+{
+    static LiveSchedulers* instance = new LiveSchedulers();
+    return *instance;
+}
+
+} // namespace
+
+DeliveryScheduler::PriorityClass::PriorityClass()
+    : depth(0), maxDepth(0), enqueued(0), executed(0), dropped(0), maxLatencyNs(0)
+{
+    fill(latency, latency + LATENCY_BUCKETS, 0);
+}
+
+DeliveryScheduler::DeliveryScheduler()
+{
+    LiveSchedulers& live = liveSchedulers();
+    lock_guard<mutex> hold(live.lock);
+    live.all.push_back(this);
+}
+
+DeliveryScheduler::~DeliveryScheduler()
+{
+    {
+        LiveSchedulers& live = liveSchedulers();
+        lock_guard<mutex> hold(live.lock);
+        live.all.erase(find(live.all.begin(), live.all.end(), this));
+    }
+    for (PriorityClass& level : classes)
+    {
+        for (auto& entry : level.rooms)
+        {
+            for (Entry& queued : entry.second.entries)
+            {
+                delete queued.command;
+            }
+        }
+    }
+}
+
+int64_t DeliveryScheduler::nowNs()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void DeliveryScheduler::enqueue(Command* command)
+{
+    PriorityClass& level = classes[command->getPriority()];
+    ChatRoom* room = command->getRoom();
+    RoomQueue& queue = level.rooms[room];
+    if (queue.entries.empty())
+    {
+        level.ring.push_back(room);
+    }
+    Entry entry = { command, nowNs() };
+    queue.entries.push_back(entry);
+
+    level.enqueued++;
+    level.depth++;
+    level.maxDepth = max(level.maxDepth, level.depth);
+}
+
+void DeliveryScheduler::enqueueNotification(ChatRoom* room, const string& message,
+                                            const string& roomName, MessagePriority priority)
+{
+    Command* command = new NotifyCommand(room, message, roomName);
+    command->setPriority(priority);
+    enqueue(command);
+}
+
+bool DeliveryScheduler::runNext()
+{
+    for (PriorityClass& level : classes)
+    {
+        if (level.depth == 0)
+        {
+            continue;
+        }
+
+        ChatRoom* room = level.ring.front();
+        unordered_map<ChatRoom*, RoomQueue>::iterator found = level.rooms.find(room);
+        RoomQueue& queue = found->second;
+        if (queue.deficit == 0)
+        {
+            queue.deficit = weightOf(room);
+        }
+
+        Entry entry = queue.entries.front();
+        queue.entries.pop_front();
+        queue.deficit--;
+        level.depth--;
+
+        // Finish with the queues before executing: the command may enqueue
+        // more work or destroy its room
+        if (queue.entries.empty())
+        {
+            level.rooms.erase(found);
+            level.ring.pop_front();
+        }
+        else if (queue.deficit == 0)
+        {
+            level.ring.pop_front();
+            level.ring.push_back(room);
+        }
+
+        recordLatency(level, nowNs() - entry.enqueuedNs);
+        level.executed++;
+        entry.command->execute();
+        delete entry.command;
+        return true;
+    }
+    return false;
+}
+
+size_t DeliveryScheduler::drain(size_t maxCommands)
+{
+    size_t run = 0;
+    while ((maxCommands == 0 || run < maxCommands) && runNext())
+    {
+        run++;
+    }
+    return run;
+}
+
+void DeliveryScheduler::setRoomWeight(ChatRoom* room, unsigned weight)
+{
+    weights[room] = max(weight, 1u);
+}
+
+unsigned DeliveryScheduler::weightOf(ChatRoom* room) const
+{
+    unordered_map<ChatRoom*, unsigned>::const_iterator found = weights.find(room);
+    return found == weights.end() ? 1 : found->second;
+}
+
+void DeliveryScheduler::dropRoom(ChatRoom* room)
+{
+    for (PriorityClass& level : classes)
+    {
+        unordered_map<ChatRoom*, RoomQueue>::iterator found = level.rooms.find(room);
+        if (found == level.rooms.end())
+        {
+            continue;
+        }
+        for (Entry& queued : found->second.entries)
+        {
+            delete queued.command;
+        }
+        level.depth -= found->second.entries.size();
+        level.dropped += found->second.entries.size();
+        level.rooms.erase(found);
+        level.ring.erase(find(level.ring.begin(), level.ring.end(), room));
+    }
+    weights.erase(room);
+}
+
+void DeliveryScheduler::dropUser(const Users* user)
+{
+    for (PriorityClass& level : classes)
+    {
+        unordered_map<ChatRoom*, RoomQueue>::iterator it = level.rooms.begin();
+        while (it != level.rooms.end())
+        {
+            deque<Entry>& entries = it->second.entries;
+            deque<Entry>::iterator kept = entries.begin();
+            for (Entry& queued : entries)
+            {
+                if (queued.command->forgetUser(user))
+                {
+                    delete queued.command;
+                }
+                else
+                {
+                    *kept++ = queued;
+                }
+            }
+            size_t removed = entries.end() - kept;
+            entries.erase(kept, entries.end());
+            level.depth -= removed;
+            level.dropped += removed;
+
+            if (entries.empty())
+            {
+                level.ring.erase(find(level.ring.begin(), level.ring.end(), it->first));
+                it = level.rooms.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+}
+
+void DeliveryScheduler::dropUserEverywhere(const Users* user)
+{
+    LiveSchedulers& live = liveSchedulers();
+    lock_guard<mutex> hold(live.lock);
+    for (DeliveryScheduler* scheduler : live.all)
+    {
+        scheduler->dropUser(user);
+    }
+}
+
+size_t DeliveryScheduler::pending() const
+{
+    size_t total = 0;
+    for (const PriorityClass& level : classes)
+    {
+        total += level.depth;
+    }
+    return total;
+}
+
+void DeliveryScheduler::recordLatency(PriorityClass& level, int64_t ns)
+{
+    uint64_t us = static_cast<uint64_t>(ns > 0 ? ns : 0) / 1000;
+    int bucket = 0;
+    while (us > 0 && bucket < LATENCY_BUCKETS - 1)
+    {
+        us >>= 1;
+        bucket++;
+    }
+    level.latency[bucket]++;
+    level.maxLatencyNs = max(level.maxLatencyNs, ns);
+}
+
+double DeliveryScheduler::percentileUs(const PriorityClass& level, double fraction)
+{
+    uint64_t total = 0;
+    for (uint64_t count : level.latency)
+    {
+        total += count;
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(fraction * (total - 1)) + 1;
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+    {
+        seen += level.latency[bucket];
+        if (seen >= rank)
+        {
+            // Bucket b holds [2^(b-1), 2^b) microseconds; report its upper bound
+            return static_cast<double>(1ull << bucket);
+        }
+    }
+    return static_cast<double>(1ull << (LATENCY_BUCKETS - 1));
+}
+
+PriorityClassStats DeliveryScheduler::getStats(MessagePriority priority) const
+{
+    const PriorityClass& level = classes[priority];
+    PriorityClassStats stats;
+    stats.enqueued = level.enqueued;
+    stats.executed = level.executed;
+    stats.dropped = level.dropped;
+    stats.depth = level.depth;
+    stats.maxDepth = level.maxDepth;
+    stats.p50LatencyUs = percentileUs(level, 0.50);
+    stats.p99LatencyUs = percentileUs(level, 0.99);
+    stats.maxLatencyUs = level.maxLatencyNs / 1000.0;
+    return stats;
+}
+
+void DeliveryScheduler::resetStats()
+{
+    for (PriorityClass& level : classes)
+    {
+        level.enqueued = 0;
+        level.executed = 0;
+        level.dropped = 0;
+        level.maxDepth = level.depth;
+        level.maxLatencyNs = 0;
+        fill(level.latency, level.latency + LATENCY_BUCKETS, 0);
+    }
+}
@@ -0,0 +1,179 @@
+/**
+ * @file DeliveryScheduler.h
+ * @brief Priority-aware queue between command creation and execution
+ */
+
+#ifndef DELIVERYSCHEDULER_H
+#define DELIVERYSCHEDULER_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include "MessagePriority.h"
+
+using namespace std;
+
+class ChatRoom;
+class Command;
+class Users;
+
+/**
+ * @struct PriorityClassStats
+ * @brief Queue depth and queueing latency of one priority class
+ */
+struct PriorityClassStats
+{
+    uint64_t enqueued;
+    uint64_t executed;
+    uint64_t dropped;       // discarded because their room or sender was destroyed
+    size_t depth;           // commands waiting now
+    size_t maxDepth;
+    double p50LatencyUs;    // enqueue to execute, bucketed (upper bound)
+    double p99LatencyUs;
+    double maxLatencyUs;
+
+    PriorityClassStats()
+        : enqueued(0), executed(0), dropped(0), depth(0), maxDepth(0),
+          p50LatencyUs(0), p99LatencyUs(0), maxLatencyUs(0) {}
+};
+
+/**
+ * @class DeliveryScheduler
+ * @brief Orders queued commands by strict priority, then fairly across rooms
+ *
+ * A room with a scheduler attached hands its commands here instead of
+ * running them inline; the owner calls drain() from its event loop.
+ * A command is always taken from the most urgent non-empty class. Within
+ * a class, rooms are served by deficit round robin: each turn a room may
+ * run up to its weight in commands before the next room gets its turn,
+ * so one busy room cannot hold back a quiet one. Lower classes can be
+ * starved by sustained higher-class load; that is the intended trade.
+ *
+ * The scheduler owns queued commands and deletes them after execution.
+ * Not thread-safe, except that schedulers register themselves so that
+ * ~Users can purge a user from all of them (dropUserEverywhere).
+ */
+class DeliveryScheduler
+{
+public:
+    DeliveryScheduler();
+    ~DeliveryScheduler();
+
+    /**
+     * @brief Queue a command in its priority class (takes ownership)
+     * @param command The command to run later
+     */
+    void enqueue(Command* command);
+
+    /**
+     * @brief Queue a room notification in the given class
+     * @param room The room whose observers are notified
+     * @param message The notification message
+     * @param roomName The name passed to Observer::update
+     * @param priority The priority class
+     */
+    void enqueueNotification(ChatRoom* room, const string& message, const string& roomName,
+                             MessagePriority priority);
+
+    /**
+     * @brief Run queued commands in scheduling order
+     * @param maxCommands Upper bound on commands to run (0 = until empty)
+     * @return Number of commands run
+     */
+    size_t drain(size_t maxCommands = 0);
+
+    /**
+     * @brief Set a room's share within each class (default 1)
+     * @param room The room
+     * @param weight Commands the room may run per round-robin turn
+     */
+    void setRoomWeight(ChatRoom* room, unsigned weight);
+
+    /**
+     * @brief Discard everything queued for a room (called when it is destroyed)
+     * @param room The room
+     */
+    void dropRoom(ChatRoom* room);
+
+    /**
+     * @brief Forget a user that is being destroyed
+     * @param user The user
+     *
+     * Its own commands are discarded; targeted commands addressed to it
+     * still run for the remaining audience.
+     */
+    void dropUser(const Users* user);
+
+    /**
+     * @brief dropUser() on every live scheduler (called by ~Users)
+     * @param user The user
+     */
+    static void dropUserEverywhere(const Users* user);
+
+    /**
+     * @brief Get the number of commands waiting in all classes
+     * @return Total queue depth
+     */
+    size_t pending() const;
+
+    /**
+     * @brief Get depth and latency metrics for one class
+     * @param priority The priority class
+     * @return Snapshot of the class's metrics
+     */
+    PriorityClassStats getStats(MessagePriority priority) const;
+
+    /**
+     * @brief Reset counters and latency histograms (queued work is kept)
+     */
+    void resetStats();
+
+private:
+    DeliveryScheduler(const DeliveryScheduler&);
+    DeliveryScheduler& operator=(const DeliveryScheduler&);
+
+    struct Entry
+    {
+        Command* command;
+        int64_t enqueuedNs;
+    };
+
+    // Present in its class only while it has queued work
+    struct RoomQueue
+    {
+        deque<Entry> entries;
+        unsigned deficit;   // commands left in the room's current turn
+
+        RoomQueue() : deficit(0) {}
+    };
+
+    // Latency buckets are powers of two in microseconds: [0,1), [1,2), [2,4) ...
+    static const int LATENCY_BUCKETS = 32;
+
+    struct PriorityClass
+    {
+        unordered_map<ChatRoom*, RoomQueue> rooms;
+        deque<ChatRoom*> ring;      // rooms with queued work, in service order
+        size_t depth;
+        size_t maxDepth;
+        uint64_t enqueued;
+        uint64_t executed;
+        uint64_t dropped;
+        int64_t maxLatencyNs;
+        uint64_t latency[LATENCY_BUCKETS];
+
+        PriorityClass();
+    };
+
+    bool runNext();
+    unsigned weightOf(ChatRoom* room) const;
+    void recordLatency(PriorityClass& level, int64_t ns);
+    static double percentileUs(const PriorityClass& level, double fraction);
+    static int64_t nowNs();
+
+    PriorityClass classes[PRIORITY_CLASSES];
+    unordered_map<ChatRoom*, unsigned> weights;
+};
+
+#endif
@@ -8,10 +8,10 @@ using namespace std;
 void Dogorithm::registerUser(Users *user)
 {
     // Check if user is already registered
-    auto it = find(users.begin(), users.end(), user);
-    if (it == users.end())
+    if (!isMember(user))
     {
         users.push_back(user);
+        indexMember(user);
         user->addChatRoom(this); // Add this room to user's list
         cout << "[Dogorithm]: " << user->getName() << " has joined the room!" << endl;
         
@@ -28,6 +28,8 @@ void Dogorithm::removeUser(Users *user)
     {
         cout << "[Dogorithm]: " << user->getName() << " has left the room." << endl;
         users.erase(it);
+        unindexMember(user);
+        user->removeChatRoom(this);
         
         // Notify all subscribers that user left (Observer pattern)
         notify(user->getName() + " has left Dogorithm!", roomName);
@@ -48,8 +50,8 @@ void Dogorithm::sendMessage(string message, Users *fromUser)
 
 void Dogorithm::saveMessage(string message, Users *fromUser)
 {
-    // Save message to chat history
-    string historyEntry = fromUser->getName() + ": " + message;
-    chatHistory.push_back(historyEntry);
-    cout << "[Dogorithm - Message Saved]: " << historyEntry << endl;
+    // Save the raw message; the display string is rendered only when read
+    chatHistory.append(fromUser, message);
+    recordSaved(fromUser, message);
+    cout << "[Dogorithm - Message Saved]: " << fromUser->getName() << ": " << message << endl;
 }
\ No newline at end of file
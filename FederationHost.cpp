@@ -0,0 +1,373 @@
+/**
+ * @file FederationHost.cpp
+ * @brief Worker processes, frame routing and the worker-side event loop
+ */
+
+#include "FederationHost.h"
+#include "RemoteChatRoom.h"
+#include "CtrlCat.h"
+#include "Dogorithm.h"
+#include "Users.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+// ============================================================================
+// Worker side
+// ============================================================================
+
+namespace {
+
+struct WorkerContext
+{
+    ShmRing* out;
+    unordered_map<ChatRoom*, uint32_t> roomIds;
+};
+
+void pushOrYield(ShmRing* ring, const FederationFrame& header, const string& text)
+{
+    while (!ring->tryPush(&header, sizeof(header), text.data(), text.size()))
+    {
+        sched_yield();
+    }
+}
+
+/**
+ * Stand-in for a user that lives in the host process. The worker's room
+ * fans out to it as usual; receive() ships the delivery back instead.
+ */
+class WorkerUser : public Users
+{
+public:
+    WorkerUser(WorkerContext* ctx, uint64_t id, const string& userName)
+        : Users(userName), context(ctx), remoteId(id) {}
+
+    void receive(string message, Users* fromUser, ChatRoom* room) override
+    {
+        FederationFrame header = { FederationFrame::DELIVER, 0, context->roomIds[room],
+                                   static_cast<WorkerUser*>(fromUser)->remoteId, remoteId };
+        pushOrYield(context->out, header, message);
+    }
+
+    WorkerContext* context;
+    uint64_t remoteId;
+};
+
+ChatRoom* makeRoom(const string& type)
+{
+    if (type == "CtrlCat")
+    {
+        return new CtrlCat();
+    }
+    if (type == "Dogorithm")
+    {
+        return new Dogorithm();
+    }
+    return nullptr;
+}
+
+} // namespace
+
+void FederationHost::workerMain(ShmRing* in, ShmRing* out)
+{
+    // The host prints deliveries; room chatter in the worker is suppressed
+    cout.setstate(ios::badbit);
+
+    WorkerContext context;
+    context.out = out;
+    unordered_map<uint32_t, ChatRoom*> localRooms;
+    unordered_map<uint64_t, WorkerUser*> localUsers;
+    vector<char> frame;
+    unsigned idle = 0;
+    bool running = true;
+
+    while (running)
+    {
+        if (!in->tryPop(frame))
+        {
+            if (++idle > 64)
+            {
+                sched_yield();
+            }
+            continue;
+        }
+        idle = 0;
+
+        FederationFrame header;
+        memcpy(&header, frame.data(), sizeof(header));
+        string text(frame.begin() + sizeof(header), frame.end());
+        ChatRoom* room = localRooms.count(header.roomId) ? localRooms[header.roomId] : nullptr;
+        WorkerUser* user = localUsers.count(header.userA) ? localUsers[header.userA] : nullptr;
+
+        switch (header.op)
+        {
+        case FederationFrame::CREATE_ROOM:
+            room = makeRoom(text);
+            if (room)
+            {
+                localRooms[header.roomId] = room;
+                context.roomIds[room] = header.roomId;
+            }
+            break;
+        case FederationFrame::DEFINE_USER:
+            if (user)
+            {
+                user->setName(text);
+            }
+            else
+            {
+                localUsers[header.userA] = new WorkerUser(&context, header.userA, text);
+            }
+            break;
+        case FederationFrame::REGISTER:
+            if (room && user) room->registerUser(user);
+            break;
+        case FederationFrame::REMOVE:
+            if (room && user) room->removeUser(user);
+            break;
+        case FederationFrame::SEND:
+            if (room && user) room->sendMessage(text, user);
+            break;
+        case FederationFrame::SAVE:
+            if (room && user) room->saveMessage(text, user);
+            break;
+        case FederationFrame::HISTORY:
+            if (room)
+            {
+                ChatHistory& history = room->getChatHistory();
+                for (size_t i = header.userA; i < history.size(); i++)
+                {
+                    const HistoryRecord& saved = history.record(i);
+                    FederationFrame entry = { FederationFrame::HISTORY_ENTRY, 0, header.roomId,
+                                              static_cast<WorkerUser*>(history.sender(i))->remoteId,
+                                              static_cast<uint64_t>(saved.timestampUs) };
+                    string text(reinterpret_cast<const char*>(&saved.sequence), sizeof(saved.sequence));
+                    pushOrYield(out, entry, text + history.payload(i));
+                }
+            }
+            {
+                FederationFrame end = { FederationFrame::HISTORY_END, 0, header.roomId, 0, 0 };
+                pushOrYield(out, end, "");
+            }
+            break;
+        case FederationFrame::BARRIER:
+            {
+                FederationFrame ack = { FederationFrame::BARRIER_ACK, 0, 0, header.userA, 0 };
+                pushOrYield(out, ack, "");
+            }
+            break;
+        case FederationFrame::SHUTDOWN:
+            running = false;
+            break;
+        }
+    }
+
+    for (auto& entry : localRooms)
+    {
+        delete entry.second;
+    }
+    for (auto& entry : localUsers)
+    {
+        delete entry.second;
+    }
+}
+
+// ============================================================================
+// Host side
+// ============================================================================
+
+FederationHost::FederationHost(int workerCount, size_t ringBytes)
+    : nextRoomId(1), barriersPosted(0), delivered(0), maxText(0), started(false)
+{
+    for (int i = 0; i < workerCount; i++)
+    {
+        Worker worker;
+        worker.toWorker = ShmRing::create(ringBytes);
+        worker.fromWorker = ShmRing::create(ringBytes);
+        worker.barriersAcked = 0;
+        if (!worker.toWorker || !worker.fromWorker)
+        {
+            cerr << "FederationHost: cannot map the rings for worker " << i << endl;
+            delete worker.toWorker;
+            delete worker.fromWorker;
+            return;
+        }
+        // HISTORY_ENTRY frames carry the sequence ahead of a saved message,
+        // so every text must leave room for it
+        size_t frameBytes = worker.toWorker->maxFrameBytes();
+        size_t overhead = sizeof(FederationFrame) + sizeof(uint64_t);
+        maxText = frameBytes > overhead ? frameBytes - overhead : 0;
+
+        // Buffered output would otherwise be printed twice
+        cout.flush();
+        fflush(stdout);
+
+        worker.pid = fork();
+        if (worker.pid == -1)
+        {
+            perror("FederationHost: fork");
+            delete worker.toWorker;
+            delete worker.fromWorker;
+            return;
+        }
+        if (worker.pid == 0)
+        {
+            workerMain(worker.toWorker, worker.fromWorker);
+            _exit(0);
+        }
+        workers.push_back(worker);
+    }
+    started = true;
+}
+
+FederationHost::~FederationHost()
+{
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        post(static_cast<int>(i), FederationFrame::SHUTDOWN, 0, 0, 0, "");
+    }
+    for (Worker& worker : workers)
+    {
+        // Keep draining so a worker blocked on a full ring can reach SHUTDOWN
+        while (waitpid(worker.pid, nullptr, WNOHANG) == 0)
+        {
+            if (pump() == 0)
+            {
+                sched_yield();
+            }
+        }
+    }
+    // pump() reads every ring, so none can go before all workers are reaped
+    for (Worker& worker : workers)
+    {
+        delete worker.toWorker;
+        delete worker.fromWorker;
+    }
+    for (auto& entry : rooms)
+    {
+        delete entry.second;
+    }
+}
+
+ChatRoom* FederationHost::createRoom(const string& roomType)
+{
+    if (!started || workers.empty() || (roomType != "CtrlCat" && roomType != "Dogorithm"))
+    {
+        return nullptr;
+    }
+    uint32_t roomId = nextRoomId++;
+    int worker = static_cast<int>(roomId % workers.size());
+    RemoteChatRoom* room = new RemoteChatRoom(this, worker, roomId, roomType);
+    rooms[roomId] = room;
+    post(worker, FederationFrame::CREATE_ROOM, roomId, 0, 0, roomType);
+    return room;
+}
+
+uint64_t FederationHost::userId(Users* user)
+{
+    return user->getIdentity()->getId();
+}
+
+bool FederationHost::post(int worker, FederationFrame::Op op, uint32_t roomId,
+                          uint64_t userA, uint64_t userB, const string& text)
+{
+    // Would never fit: waiting for room would spin forever
+    if (text.size() > maxText)
+    {
+        return false;
+    }
+    FederationFrame header = { static_cast<uint16_t>(op), 0, roomId, userA, userB };
+    while (!workers[worker].toWorker->tryPush(&header, sizeof(header), text.data(), text.size()))
+    {
+        if (pump() == 0)
+        {
+            sched_yield();
+        }
+    }
+    return true;
+}
+
+size_t FederationHost::pump()
+{
+    size_t handled = 0;
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        while (workers[i].fromWorker->tryPop(scratch))
+        {
+            FederationFrame header;
+            memcpy(&header, scratch.data(), sizeof(header));
+            string text(scratch.begin() + sizeof(header), scratch.end());
+
+            switch (header.op)
+            {
+            case FederationFrame::DELIVER:
+                {
+                    // Either user may have been destroyed while the frame was in flight
+                    RemoteChatRoom* room = rooms[header.roomId];
+                    Users* to = room->knownUser(header.userB);
+                    if (to)
+                    {
+                        to->receive(text, room->knownUser(header.userA), room);
+                        delivered++;
+                    }
+                }
+                break;
+            case FederationFrame::HISTORY_ENTRY:
+                {
+                    uint64_t sequence = 0;
+                    memcpy(&sequence, text.data(), sizeof(sequence));
+                    rooms[header.roomId]->mirrorHistoryEntry(header.userA, static_cast<int64_t>(header.userB),
+                                                             sequence, text.substr(sizeof(sequence)));
+                }
+                break;
+            case FederationFrame::HISTORY_END:
+                historyEnds[header.roomId]++;
+                break;
+            case FederationFrame::BARRIER_ACK:
+                workers[i].barriersAcked = header.userA;
+                break;
+            }
+            handled++;
+        }
+    }
+    return handled;
+}
+
+void FederationHost::sync()
+{
+    barriersPosted++;
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        post(static_cast<int>(i), FederationFrame::BARRIER, 0, barriersPosted, 0, "");
+    }
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        while (workers[i].barriersAcked < barriersPosted)
+        {
+            if (pump() == 0)
+            {
+                sched_yield();
+            }
+        }
+    }
+}
+
+void FederationHost::fetchHistory(RemoteChatRoom* room)
+{
+    // Counted per room: a delivery handled while waiting may read another room's history
+    uint32_t roomId = room->getRoomId();
+    uint64_t request = ++historyRequests[roomId];
+    post(room->getWorker(), FederationFrame::HISTORY, roomId, room->mirroredEntries(), 0, "");
+    while (historyEnds[roomId] < request)
+    {
+        if (pump() == 0)
+        {
+            sched_yield();
+        }
+    }
+}
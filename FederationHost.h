@@ -0,0 +1,178 @@
+/**
+ * @file FederationHost.h
+ * @brief Spreads chat rooms across worker processes on the same host
+ */
+
+#ifndef FEDERATIONHOST_H
+#define FEDERATIONHOST_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+#include "ShmRing.h"
+
+using namespace std;
+
+class ChatRoom;
+class RemoteChatRoom;
+class Users;
+
+/**
+ * @struct FederationFrame
+ * @brief Fixed header of every frame on a federation ring (text follows it)
+ */
+struct FederationFrame
+{
+    enum Op
+    {
+        // host -> worker
+        CREATE_ROOM,  // text: room type
+        DEFINE_USER,  // userA: user id, text: display name
+        REGISTER,     // userA: user id
+        REMOVE,       // userA: user id
+        SEND,         // userA: sender id, text: message
+        SAVE,         // userA: sender id, text: message
+        HISTORY,      // userA: first index wanted
+        BARRIER,      // userA: barrier number
+        SHUTDOWN,
+        // worker -> host
+        DELIVER,       // userA: sender id, userB: recipient id, text: message
+        HISTORY_ENTRY, // userA: sender id, userB: save time (us), text: 8-byte sequence then message
+        HISTORY_END,
+        BARRIER_ACK    // userA: barrier number
+    };
+
+    uint16_t op;
+    uint16_t reserved;
+    uint32_t roomId;
+    uint64_t userA;
+    uint64_t userB;
+};
+
+/**
+ * @class FederationHost
+ * @brief Owns the worker processes and the proxies for their rooms
+ *
+ * Each worker is forked with a pair of ShmRings (one per direction)
+ * and hosts real CtrlCat/Dogorithm rooms. createRoom() returns a
+ * RemoteChatRoom that implements the ChatRoom interface by posting
+ * frames, so Users::send works unchanged. Deliveries come back as
+ * DELIVER frames and are handed to the real Users by pump().
+ *
+ * Users are identified on the wire by their SenderIdentity id, which is
+ * never reused, so frames that arrive after a user is destroyed are
+ * dropped instead of reaching whoever took its address.
+ *
+ * The constructor cannot fail loudly: if a ring cannot be mapped or a
+ * worker cannot be forked it stops there, and ok() reports false. The
+ * workers already running are shut down by the destructor as usual.
+ */
+class FederationHost
+{
+public:
+    /**
+     * @brief Fork the worker processes
+     * @param workerCount Number of worker processes
+     * @param ringBytes Capacity of each direction's ring
+     */
+    FederationHost(int workerCount, size_t ringBytes = 1 << 20);
+
+    /**
+     * @brief Check that every requested worker was started
+     * @return false if a ring or worker could not be created (createRoom() then returns nullptr)
+     */
+    bool ok() const { return started; }
+
+    /**
+     * @brief Shut down the workers and delete the room proxies
+     */
+    ~FederationHost();
+
+    /**
+     * @brief Create a room on the next worker (round robin)
+     * @param roomType "CtrlCat" or "Dogorithm"
+     * @return Proxy for the room (owned by the host), or nullptr for an unknown type or if !ok()
+     */
+    ChatRoom* createRoom(const string& roomType);
+
+    /**
+     * @brief Post a frame to the worker hosting a room
+     * @return false if the text is longer than maxTextBytes() (nothing is posted)
+     *
+     * Spins while the ring is full, pumping inbound frames meanwhile so
+     * neither side can block the other.
+     */
+    bool post(int worker, FederationFrame::Op op, uint32_t roomId,
+              uint64_t userA, uint64_t userB, const string& text);
+
+    /**
+     * @brief Get the longest text a frame can carry
+     * @return Bytes (the same for both directions of every worker)
+     */
+    size_t maxTextBytes() const { return maxText; }
+
+    /**
+     * @brief Process every frame the workers have sent back
+     * @return Number of frames handled
+     */
+    size_t pump();
+
+    /**
+     * @brief Wait until every worker has processed everything posted so far
+     */
+    void sync();
+
+    /**
+     * @brief Fetch a room's history entries from its worker into the proxy
+     * @param room The proxy to fill in
+     *
+     * Entries keep the timestamp and sequence they were given in the worker.
+     */
+    void fetchHistory(RemoteChatRoom* room);
+
+    /**
+     * @brief Get the number of deliveries handed to local users
+     * @return Delivery count
+     */
+    uint64_t getDelivered() const { return delivered; }
+
+    /**
+     * @brief Get the number of worker processes
+     * @return Worker count
+     */
+    int getWorkerCount() const { return static_cast<int>(workers.size()); }
+
+    /**
+     * @brief Get a wire ID for a user
+     * @param user The user
+     * @return The user's ID on the rings (never reused, unlike its address)
+     */
+    static uint64_t userId(Users* user);
+
+private:
+    struct Worker
+    {
+        pid_t pid;
+        ShmRing* toWorker;
+        ShmRing* fromWorker;
+        uint64_t barriersAcked;
+    };
+
+    static void workerMain(ShmRing* in, ShmRing* out);
+    void handle(const vector<char>& frame);
+
+    vector<Worker> workers;
+    unordered_map<uint32_t, RemoteChatRoom*> rooms;
+    uint32_t nextRoomId;
+    uint64_t barriersPosted;
+    uint64_t delivered;
+    unordered_map<uint32_t, uint64_t> historyRequests;   // by room ID
+    unordered_map<uint32_t, uint64_t> historyEnds;       // by room ID
+    size_t maxText;
+    bool started;
+    vector<char> scratch;
+};
+
+#endif
@@ -10,6 +10,8 @@
 #include <string>
 #include <vector>
 #include "Users.h"
+#include "ChatHistory.h"
+#include "TrackingAllocator.h"
 
 using namespace std;
 
@@ -39,8 +41,113 @@ public:
      * @brief Reset iterator to the beginning
      */
     virtual void reset() = 0;
+    
+    /**
+     * @brief Copy up to max elements into out, advancing the iterator
+     * @param out Destination array with room for at least max elements
+     * @param max Maximum number of elements to fetch
+     * @return Number of elements written
+     */
+    virtual size_t nextBatch(T* out, size_t max) {
+        size_t n = 0;
+        while (n < max && hasNext()) {
+            out[n++] = next();
+        }
+        return n;
+    }
 };
 
+/**
+ * @class ArrayCursor
+ * @brief Value-type cursor over a contiguous range of elements
+ * @tparam T The type of elements to iterate over
+ *
+ * Unlike Iterator<T>, a cursor lives on the stack, is not virtual and
+ * hands out references instead of copies. begin()/end() are plain
+ * pointers, so cursors work with range-for and STL algorithms.
+ * A cursor is a view: it is invalidated when the underlying collection
+ * is modified.
+ */
+template <typename T>
+class ArrayCursor {
+private:
+    const T* first;
+    const T* last;
+    const T* pos;
+    
+public:
+    typedef const T* const_iterator;
+    
+    /**
+     * @brief Constructor
+     * @param begin Pointer to the first element
+     * @param end Pointer one past the last element
+     */
+    ArrayCursor(const T* begin, const T* end)
+        : first(begin), last(end), pos(begin) {}
+    
+    /**
+     * @brief Constructor for a whole vector
+     * @param items The vector to view
+     */
+    template <typename Alloc>
+    explicit ArrayCursor(const vector<T, Alloc>& items)
+        : first(items.data()), last(items.data() + items.size()), pos(first) {}
+    
+    /**
+     * @brief Check if there are more elements
+     * @return true if more elements exist
+     */
+    bool hasNext() const {
+        return pos != last;
+    }
+    
+    /**
+     * @brief Get the next element without copying it
+     * @return Reference to the next element (caller must check hasNext())
+     */
+    const T& next() {
+        return *pos++;
+    }
+    
+    /**
+     * @brief Fetch up to max elements in one call
+     * @param out Set to the first element of the batch
+     * @param max Maximum number of elements to fetch
+     * @return Number of elements available starting at out
+     */
+    size_t nextBatch(const T*& out, size_t max) {
+        size_t left = static_cast<size_t>(last - pos);
+        size_t n = left < max ? left : max;
+        out = pos;
+        pos += n;
+        return n;
+    }
+    
+    /**
+     * @brief Reset cursor to start
+     */
+    void reset() {
+        pos = first;
+    }
+    
+    /**
+     * @brief Get the number of elements in the view
+     * @return Element count
+     */
+    size_t size() const {
+        return static_cast<size_t>(last - first);
+    }
+    
+    const_iterator begin() const { return first; }
+    const_iterator end() const { return last; }
+};
+
+typedef ArrayCursor<Users*> UserCursor;
+
+// A room's member list, charged to the room's memory account
+typedef vector<Users*, TrackingAllocator<Users*> > MemberList;
+
 /**
  * @class ChatHistoryIterator
  * @brief Concrete iterator for traversing chat history messages
@@ -48,15 +155,15 @@ public:
  */
 class ChatHistoryIterator : public Iterator<string> {
 private:
-    vector<string>* messages;
+    ChatHistory* messages;
     size_t currentPosition;
     
 public:
     /**
      * @brief Constructor
-     * @param msgs Pointer to the vector of messages
+     * @param msgs Pointer to the chat history
      */
-    ChatHistoryIterator(vector<string>* msgs) 
+    ChatHistoryIterator(ChatHistory* msgs) 
         : messages(msgs), currentPosition(0) {}
     
     /**
@@ -68,12 +175,12 @@ public:
     }
     
     /**
-     * @brief Get the next message
+     * @brief Get the next message, rendered for display
      * @return The next message string
      */
     string next() override {
         if (hasNext()) {
-            return (*messages)[currentPosition++];
+            return messages->at(currentPosition++);
         }
         return "";
     }
@@ -93,7 +200,7 @@ public:
  */
 class UserListIterator : public Iterator<Users*> {
 private:
-    vector<Users*>* users;
+    MemberList* users;
     size_t currentPosition;
     
 public:
@@ -101,7 +208,7 @@ public:
      * @brief Constructor
      * @param usrList Pointer to the vector of users
      */
-    UserListIterator(vector<Users*>* usrList) 
+    UserListIterator(MemberList* usrList) 
         : users(usrList), currentPosition(0) {}
     
     /**
@@ -123,6 +230,20 @@ public:
         return nullptr;
     }
     
+    /**
+     * @brief Copy up to max user pointers into out
+     * @param out Destination array
+     * @param max Maximum number of users to fetch
+     * @return Number of users written
+     */
+    size_t nextBatch(Users** out, size_t max) override {
+        size_t n = 0;
+        while (n < max && currentPosition < users->size()) {
+            out[n++] = (*users)[currentPosition++];
+        }
+        return n;
+    }
+    
     /**
      * @brief Reset iterator to start
      */
@@ -6,5 +6,12 @@
 void LogMessageCommand::execute()
 {
     // Call the ChatRoom's saveMessage method (Command pattern)
-    room->saveMessage(message, fromUser);
+    if (visibility.scope == MessageVisibility::ROOM)
+    {
+        room->saveMessage(message, fromUser);
+    }
+    else
+    {
+        room->saveMessage(message, fromUser, visibility);
+    }
 }
\ No newline at end of file
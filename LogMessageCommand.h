@@ -5,14 +5,27 @@
 #include "Command.h"
 #include "ChatRoom.h"
 #include "Users.h"
+#include "MessageVisibility.h"
 
 class LogMessageCommand : public Command
 {
+private:
+    MessageVisibility visibility;
+
 public:
-    LogMessageCommand(ChatRoom* chatRoom, string msg, Users* user)
-        : Command(chatRoom, msg, user) {}
+    LogMessageCommand(ChatRoom* chatRoom, string msg, Users* user, uint64_t id = 0)
+        : Command(chatRoom, msg, user, id) {}
+    
+    LogMessageCommand(ChatRoom* chatRoom, string msg, Users* user, const MessageVisibility& audience)
+        : Command(chatRoom, msg, user), visibility(audience) {}
     
     void execute() override;
+    
+    // Drop the sender's commands; a destroyed recipient is just left out
+    bool forgetUser(const Users* user) override {
+        visibility.forget(user);
+        return Command::forgetUser(user);
+    }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,92 @@
+/**
+ * @file MemoryAccount.cpp
+ * @brief Account registration and category names
+ */
+
+#include "MemoryAccount.h"
+#include "MemoryRegistry.h"
+#include <cmath>
+
+using namespace std;
+
+namespace {
+
+atomic<uint64_t> nextAccountId(1);
+atomic<uint64_t> nextSeed(1);
+
+/**
+ * Exponential gap with mean 1, from a per-thread xorshift generator.
+ * Only reached when a sample point is crossed.
+ */
+double nextSampleGap()
+{
+    static thread_local uint64_t state = 0;
+    if (state == 0)
+    {
+        state = nextSeed.fetch_add(1, memory_order_relaxed) * 0x9E3779B97F4A7C15ull;
+    }
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    // 53 random bits in (0, 1]
+    double uniform = (static_cast<double>(state >> 11) + 1.0) / 9007199254740992.0;
+    return -log(uniform);
+}
+
+} // namespace
+
+// Starts exhausted, so a thread draws its first gap on its first sampled allocation
+thread_local double MemoryAccount::untilSample = 0;
+
+const char* memoryCategoryName(MemoryCategory category)
+{
+    static const char* names[MEM_CATEGORY_COUNT] = {
+        "history", "members", "observers", "notifications", "commands"
+    };
+    return category < MEM_CATEGORY_COUNT ? names[category] : "unknown";
+}
+
+MemoryAccount::MemoryAccount(Kind ownerKind, const string& ownerLabel)
+    : quota(0), kind(ownerKind), id(nextAccountId.fetch_add(1, memory_order_relaxed)),
+      samplePeriod(MemoryRegistry::getSamplePeriod()),
+      sampleRate(1.0 / static_cast<double>(samplePeriod)), label(ownerLabel), registrySlot(0)
+{
+    for (int i = 0; i < MEM_CATEGORY_COUNT; i++)
+    {
+        liveBytes[i].store(0, memory_order_relaxed);
+        liveObjects[i].store(0, memory_order_relaxed);
+    }
+    MemoryRegistry::attach(this);
+}
+
+MemoryAccount::~MemoryAccount()
+{
+    MemoryRegistry::detach(this);
+}
+
+int64_t MemoryAccount::totalBytes() const
+{
+    int64_t total = 0;
+    for (int i = 0; i < MEM_CATEGORY_COUNT; i++)
+    {
+        total += liveBytes[i].load(memory_order_relaxed);
+    }
+    return total;
+}
+
+size_t MemoryAccount::sampledCharge() const
+{
+    // Each sample point crossed stands for samplePeriod bytes
+    size_t charge = 0;
+    while (untilSample <= 0)
+    {
+        charge += samplePeriod;
+        untilSample += nextSampleGap();
+    }
+    return charge;
+}
+
+void MemoryAccount::setLabel(const string& ownerLabel)
+{
+    MemoryRegistry::relabel(this, ownerLabel);
+}
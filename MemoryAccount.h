@@ -0,0 +1,202 @@
+/**
+ * @file MemoryAccount.h
+ * @brief Live bytes and object counts of one room or user, by category
+ */
+
+#ifndef MEMORYACCOUNT_H
+#define MEMORYACCOUNT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+/**
+ * @enum MemoryCategory
+ * @brief What a tracked allocation holds
+ */
+enum MemoryCategory
+{
+    MEM_HISTORY,        // ChatRoom::chatHistory records and payloads
+    MEM_MEMBERS,        // ChatRoom::users and its membership index
+    MEM_OBSERVERS,      // Subject::observers
+    MEM_NOTIFICATIONS,  // Users::notifications, text included
+    MEM_COMMANDS,       // Users::commandQueue
+    MEM_CATEGORY_COUNT
+};
+
+/**
+ * @brief Get the display name of a category
+ * @param category The category
+ * @return Short lower-case name
+ */
+const char* memoryCategoryName(MemoryCategory category);
+
+/**
+ * @class MemoryAccount
+ * @brief Per-owner ledger charged by TrackingAllocator
+ *
+ * Rooms and users each own one account; it registers itself with
+ * MemoryRegistry for reporting. Bytes are charged by the allocator of
+ * every tracked container; object counts (messages, members, queued
+ * commands...) are kept by the owner with addObjects().
+ *
+ * In sampling mode (MemoryRegistry::setSamplePeriod) allocations below
+ * the period P draw down a per-thread countdown, and only one that runs
+ * it out is charged: P bytes for every sample point it crosses, with
+ * exponentially distributed gaps between points. Totals stay unbiased
+ * whatever addresses the heap hands out, and most allocations only
+ * subtract from the countdown. allocated() returns the charge so the
+ * caller can hand the same amount to released(); TrackingAllocator keeps
+ * it in front of the block. An account keeps the period it was created
+ * with.
+ */
+class MemoryAccount
+{
+public:
+    enum Kind
+    {
+        ROOM,
+        USER,
+        OTHER
+    };
+
+    /**
+     * @brief Create and register an account
+     * @param ownerKind What owns the account
+     * @param ownerLabel Display name for reports
+     */
+    MemoryAccount(Kind ownerKind, const string& ownerLabel);
+
+    /**
+     * @brief Unregister the account
+     */
+    ~MemoryAccount();
+
+    /**
+     * @brief Charge an allocation
+     * @param category What the block holds
+     * @param bytes The block's size
+     * @return Bytes charged (0 for most blocks in sampling mode); pass them to released()
+     */
+    size_t allocated(MemoryCategory category, size_t bytes)
+    {
+        size_t charge = chargeFor(bytes);
+        if (charge)
+        {
+            liveBytes[category].fetch_add(static_cast<int64_t>(charge), memory_order_relaxed);
+        }
+        return charge;
+    }
+
+    /**
+     * @brief Uncharge a block passed to allocated()
+     * @param category What the block held
+     * @param charged What allocated() returned for it
+     */
+    void released(MemoryCategory category, size_t charged)
+    {
+        if (charged)
+        {
+            liveBytes[category].fetch_sub(static_cast<int64_t>(charged), memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Charge or uncharge bytes not held by a tracked container
+     * @param category The category
+     * @param delta Bytes (negative to release)
+     */
+    void adjustBytes(MemoryCategory category, int64_t delta)
+    {
+        liveBytes[category].fetch_add(delta, memory_order_relaxed);
+    }
+
+    /**
+     * @brief Count objects created or destroyed
+     * @param category The category
+     * @param delta Objects (negative when destroyed)
+     */
+    void addObjects(MemoryCategory category, int64_t delta)
+    {
+        liveObjects[category].fetch_add(delta, memory_order_relaxed);
+    }
+
+    int64_t getBytes(MemoryCategory category) const { return liveBytes[category].load(memory_order_relaxed); }
+    int64_t getObjects(MemoryCategory category) const { return liveObjects[category].load(memory_order_relaxed); }
+
+    /**
+     * @brief Get the live bytes over all categories
+     * @return Bytes (an estimate in sampling mode)
+     */
+    int64_t totalBytes() const;
+
+    /**
+     * @brief Set a byte budget reported by MemoryRegistry::overQuota()
+     * @param bytes Budget, 0 for none
+     */
+    void setQuota(int64_t bytes) { quota.store(bytes, memory_order_relaxed); }
+    int64_t getQuota() const { return quota.load(memory_order_relaxed); }
+
+    /**
+     * @brief Check the byte budget
+     * @return true if a quota is set and exceeded
+     */
+    bool overQuota() const
+    {
+        int64_t limit = getQuota();
+        return limit > 0 && totalBytes() > limit;
+    }
+
+    /**
+     * @brief Rename the owner in reports (e.g. after Users::setName)
+     * @param ownerLabel The new name
+     */
+    void setLabel(const string& ownerLabel);
+
+    Kind getKind() const { return kind; }
+    uint64_t getId() const { return id; }
+    size_t getSamplePeriod() const { return samplePeriod; }
+
+    /**
+     * @brief Check whether charges depend on sampling
+     * @return true if a block's charge may differ from its size
+     */
+    bool isSampled() const { return samplePeriod > 1; }
+
+private:
+    MemoryAccount(const MemoryAccount&);
+    MemoryAccount& operator=(const MemoryAccount&);
+
+    size_t chargeFor(size_t bytes) const
+    {
+        if (samplePeriod <= 1 || bytes >= samplePeriod)
+        {
+            return bytes;
+        }
+        // Counted in sample points rather than bytes, so accounts with
+        // different periods can share the countdown without bias
+        untilSample -= static_cast<double>(bytes) * sampleRate;
+        return untilSample > 0 ? 0 : sampledCharge();
+    }
+
+    size_t sampledCharge() const;
+
+    atomic<int64_t> liveBytes[MEM_CATEGORY_COUNT];
+    atomic<int64_t> liveObjects[MEM_CATEGORY_COUNT];
+    atomic<int64_t> quota;
+    const Kind kind;
+    const uint64_t id;
+    const size_t samplePeriod;
+    const double sampleRate;    // sample points per byte (1 / samplePeriod)
+    string label;           // guarded by the registry lock
+    size_t registrySlot;    // guarded by the registry lock
+
+    static thread_local double untilSample;
+
+    friend class MemoryRegistry;
+};
+
+#endif
@@ -0,0 +1,271 @@
+/**
+ * @file MemoryRegistry.cpp
+ * @brief Account registry, reports and periodic dumps
+ */
+
+#include "MemoryRegistry.h"
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+struct Registry
+{
+    mutex lock;
+    vector<MemoryAccount*> accounts;
+    FILE* dumpFile;
+    int64_t dumpIntervalMs;
+    int64_t lastDumpMs;
+    bool dumped;
+    size_t dumpTop;
+
+    Registry() : dumpFile(nullptr), dumpIntervalMs(0), lastDumpMs(0), dumped(false), dumpTop(10) {}
+};
+
+// Never destroyed: static rooms and users may unregister during exit
+Registry& registry()
+{
+    static Registry* instance = new Registry();
+    return *instance;
+}
+
+atomic<size_t> samplePeriod(1);
+
+bool largerFirst(const pair<int64_t, MemoryAccount*>& a, const pair<int64_t, MemoryAccount*>& b)
+{
+    return a.first > b.first;
+}
+
+bool usageLargerFirst(const MemoryUsage& a, const MemoryUsage& b)
+{
+    return a.totalBytes() > b.totalBytes();
+}
+
+void writeUsage(FILE* out, const MemoryUsage& usage)
+{
+    fprintf(out, "    %-20s #%-6llu %12lld B", usage.label.c_str(), static_cast<unsigned long long>(usage.id),
+            static_cast<long long>(usage.totalBytes()));
+    for (int i = 0; i < MEM_CATEGORY_COUNT; i++)
+    {
+        if (usage.bytes[i] || usage.objects[i])
+        {
+            fprintf(out, "  %s %lld B/%lld", memoryCategoryName(static_cast<MemoryCategory>(i)),
+                    static_cast<long long>(usage.bytes[i]), static_cast<long long>(usage.objects[i]));
+        }
+    }
+    if (usage.quota > 0)
+    {
+        fprintf(out, "  (quota %lld B)", static_cast<long long>(usage.quota));
+    }
+    fprintf(out, "\n");
+}
+
+int64_t steadyMs()
+{
+    return chrono::duration_cast<chrono::milliseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+void MemoryRegistry::attach(MemoryAccount* account)
+{
+    Registry& r = registry();
+    lock_guard<mutex> hold(r.lock);
+    account->registrySlot = r.accounts.size();
+    r.accounts.push_back(account);
+}
+
+void MemoryRegistry::detach(MemoryAccount* account)
+{
+    Registry& r = registry();
+    lock_guard<mutex> hold(r.lock);
+    MemoryAccount* last = r.accounts.back();
+    r.accounts[account->registrySlot] = last;
+    last->registrySlot = account->registrySlot;
+    r.accounts.pop_back();
+}
+
+void MemoryRegistry::relabel(MemoryAccount* account, const string& label)
+{
+    lock_guard<mutex> hold(registry().lock);
+    account->label = label;
+}
+
+void MemoryRegistry::setSamplePeriod(size_t bytes)
+{
+    samplePeriod.store(max<size_t>(bytes, 1), memory_order_relaxed);
+}
+
+size_t MemoryRegistry::getSamplePeriod()
+{
+    return samplePeriod.load(memory_order_relaxed);
+}
+
+size_t MemoryRegistry::accountCount()
+{
+    Registry& r = registry();
+    lock_guard<mutex> hold(r.lock);
+    return r.accounts.size();
+}
+
+MemoryUsage MemoryRegistry::usageOf(const MemoryAccount& account)
+{
+    MemoryUsage usage;
+    usage.id = account.id;
+    usage.kind = account.kind;
+    usage.label = account.label;
+    for (int i = 0; i < MEM_CATEGORY_COUNT; i++)
+    {
+        usage.bytes[i] = account.getBytes(static_cast<MemoryCategory>(i));
+        usage.objects[i] = account.getObjects(static_cast<MemoryCategory>(i));
+    }
+    usage.quota = account.getQuota();
+    return usage;
+}
+
+MemoryReport MemoryRegistry::report(size_t top)
+{
+    MemoryReport result;
+    for (int i = 0; i < MEM_CATEGORY_COUNT; i++)
+    {
+        result.bytes[i] = 0;
+        result.objects[i] = 0;
+    }
+    result.rooms = 0;
+    result.users = 0;
+    result.samplePeriod = getSamplePeriod();
+
+    // Rank by total first; only the owners that get listed are copied out
+    vector<pair<int64_t, MemoryAccount*> > rooms;
+    vector<pair<int64_t, MemoryAccount*> > users;
+    Registry& r = registry();
+    lock_guard<mutex> hold(r.lock);
+    for (MemoryAccount* account : r.accounts)
+    {
+        int64_t total = 0;
+        for (int i = 0; i < MEM_CATEGORY_COUNT; i++)
+        {
+            int64_t bytes = account->getBytes(static_cast<MemoryCategory>(i));
+            result.bytes[i] += bytes;
+            result.objects[i] += account->getObjects(static_cast<MemoryCategory>(i));
+            total += bytes;
+        }
+        if (account->kind == MemoryAccount::ROOM)
+        {
+            result.rooms++;
+            rooms.push_back(make_pair(total, account));
+        }
+        else if (account->kind == MemoryAccount::USER)
+        {
+            result.users++;
+            users.push_back(make_pair(total, account));
+        }
+        int64_t quota = account->getQuota();
+        if (quota > 0 && total > quota)
+        {
+            result.overQuota.push_back(usageOf(*account));
+        }
+    }
+
+    size_t roomsListed = min(top, rooms.size());
+    partial_sort(rooms.begin(), rooms.begin() + roomsListed, rooms.end(), largerFirst);
+    for (size_t i = 0; i < roomsListed; i++)
+    {
+        result.topRooms.push_back(usageOf(*rooms[i].second));
+    }
+    size_t usersListed = min(top, users.size());
+    partial_sort(users.begin(), users.begin() + usersListed, users.end(), largerFirst);
+    for (size_t i = 0; i < usersListed; i++)
+    {
+        result.topUsers.push_back(usageOf(*users[i].second));
+    }
+    sort(result.overQuota.begin(), result.overQuota.end(), usageLargerFirst);
+    return result;
+}
+
+vector<MemoryUsage> MemoryRegistry::overQuota()
+{
+    return report(0).overQuota;
+}
+
+void MemoryRegistry::writeReport(FILE* out, size_t top)
+{
+    MemoryReport snapshot = report(top);
+    fprintf(out, "memory: %lld B in %zu rooms and %zu users (%s", static_cast<long long>(snapshot.totalBytes()),
+            snapshot.rooms, snapshot.users, snapshot.samplePeriod > 1 ? "sampled every " : "exact");
+    if (snapshot.samplePeriod > 1)
+    {
+        fprintf(out, "%zu B", snapshot.samplePeriod);
+    }
+    fprintf(out, ")\n");
+    for (int i = 0; i < MEM_CATEGORY_COUNT; i++)
+    {
+        fprintf(out, "  %-14s %12lld B %10lld objects\n", memoryCategoryName(static_cast<MemoryCategory>(i)),
+                static_cast<long long>(snapshot.bytes[i]), static_cast<long long>(snapshot.objects[i]));
+    }
+    if (!snapshot.topRooms.empty())
+    {
+        fprintf(out, "  largest rooms:\n");
+        for (const MemoryUsage& usage : snapshot.topRooms)
+        {
+            writeUsage(out, usage);
+        }
+    }
+    if (!snapshot.topUsers.empty())
+    {
+        fprintf(out, "  largest users:\n");
+        for (const MemoryUsage& usage : snapshot.topUsers)
+        {
+            writeUsage(out, usage);
+        }
+    }
+    if (!snapshot.overQuota.empty())
+    {
+        fprintf(out, "  over quota:\n");
+        for (const MemoryUsage& usage : snapshot.overQuota)
+        {
+            writeUsage(out, usage);
+        }
+    }
+    fflush(out);
+}
+
+void MemoryRegistry::setPeriodicDump(FILE* out, int64_t intervalMs, size_t top)
+{
+    Registry& r = registry();
+    lock_guard<mutex> hold(r.lock);
+    r.dumpFile = out;
+    r.dumpIntervalMs = intervalMs;
+    r.dumpTop = top;
+    r.dumped = false;
+}
+
+bool MemoryRegistry::tick()
+{
+    return tick(steadyMs());
+}
+
+bool MemoryRegistry::tick(int64_t nowMs)
+{
+    FILE* out;
+    size_t top;
+    {
+        Registry& r = registry();
+        lock_guard<mutex> hold(r.lock);
+        if (!r.dumpFile || (r.dumped && nowMs - r.lastDumpMs < r.dumpIntervalMs))
+        {
+            return false;
+        }
+        r.lastDumpMs = nowMs;
+        r.dumped = true;
+        out = r.dumpFile;
+        top = r.dumpTop;
+    }
+    writeReport(out, top);
+    return true;
+}
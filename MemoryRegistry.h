@@ -0,0 +1,144 @@
+/**
+ * @file MemoryRegistry.h
+ * @brief Process-wide view of every MemoryAccount: reports, quotas and periodic dumps
+ */
+
+#ifndef MEMORYREGISTRY_H
+#define MEMORYREGISTRY_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "MemoryAccount.h"
+
+using namespace std;
+
+/**
+ * @struct MemoryUsage
+ * @brief One account's footprint at the time of a report
+ */
+struct MemoryUsage
+{
+    uint64_t id;
+    MemoryAccount::Kind kind;
+    string label;
+    int64_t bytes[MEM_CATEGORY_COUNT];
+    int64_t objects[MEM_CATEGORY_COUNT];
+    int64_t quota;              // 0 if none
+
+    int64_t totalBytes() const
+    {
+        int64_t total = 0;
+        for (int i = 0; i < MEM_CATEGORY_COUNT; i++)
+        {
+            total += bytes[i];
+        }
+        return total;
+    }
+};
+
+/**
+ * @struct MemoryReport
+ * @brief Totals and the largest owners of each kind
+ */
+struct MemoryReport
+{
+    int64_t bytes[MEM_CATEGORY_COUNT];      // over all accounts
+    int64_t objects[MEM_CATEGORY_COUNT];
+    size_t rooms;
+    size_t users;
+    size_t samplePeriod;                    // of new accounts; 1 means exact
+    vector<MemoryUsage> topRooms;           // largest first
+    vector<MemoryUsage> topUsers;
+    vector<MemoryUsage> overQuota;          // every account over its quota
+
+    int64_t totalBytes() const
+    {
+        int64_t total = 0;
+        for (int i = 0; i < MEM_CATEGORY_COUNT; i++)
+        {
+            total += bytes[i];
+        }
+        return total;
+    }
+};
+
+/**
+ * @class MemoryRegistry
+ * @brief Finds which rooms and users hold memory
+ *
+ * Accounts register themselves on construction. report() reads every
+ * account's counters under the registry lock (the counters themselves are
+ * relaxed atomics, so owners keep running while a report is taken).
+ * Dumps are driven by tick(), like PresenceChannel: call it from the main
+ * loop and it writes a report to the configured file once per interval.
+ */
+class MemoryRegistry
+{
+public:
+    /**
+     * @brief Set the sampling period for accounts created from now on
+     * @param bytes 1 (or 0) for exact accounting; larger values sample
+     *              allocations below this size (4096 is a good default)
+     */
+    static void setSamplePeriod(size_t bytes);
+    static size_t getSamplePeriod();
+
+    /**
+     * @brief Collect totals and the largest owners
+     * @param top How many rooms and users to list
+     * @return The report
+     */
+    static MemoryReport report(size_t top = 10);
+
+    /**
+     * @brief Get every account over its quota
+     * @return Usages, largest first
+     */
+    static vector<MemoryUsage> overQuota();
+
+    /**
+     * @brief Write a report in human-readable form
+     * @param out Destination
+     * @param top How many rooms and users to list
+     */
+    static void writeReport(FILE* out, size_t top = 10);
+
+    /**
+     * @brief Dump a report every interval from tick()
+     * @param out Destination (not closed), or nullptr to stop
+     * @param intervalMs Minimum time between dumps
+     * @param top How many rooms and users to list
+     */
+    static void setPeriodicDump(FILE* out, int64_t intervalMs, size_t top = 10);
+
+    /**
+     * @brief Dump if a periodic dump is configured and due
+     * @return true if a report was written
+     */
+    static bool tick();
+
+    /**
+     * @brief Dump if due (for callers with their own clock)
+     * @param nowMs Current time in milliseconds
+     * @return true if a report was written
+     */
+    static bool tick(int64_t nowMs);
+
+    /**
+     * @brief Get the number of registered accounts
+     * @return Accounts
+     */
+    static size_t accountCount();
+
+private:
+    static void attach(MemoryAccount* account);
+    static void detach(MemoryAccount* account);
+    static void relabel(MemoryAccount* account, const string& label);
+    static MemoryUsage usageOf(const MemoryAccount& account);
+
+    friend class MemoryAccount;
+};
+
+#endif
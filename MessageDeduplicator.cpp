@@ -0,0 +1,197 @@
+/**
+ * @file MessageDeduplicator.cpp
+ * @brief Implementation of the cuckoo filter and windowed deduplicator
+ */
+
+#include "MessageDeduplicator.h"
+#include <chrono>
+#include <cstdint>
+
+using namespace std;
+
+// ============================================================================
+// CuckooFilter
+// ============================================================================
+
+static uint64_t mix64(uint64_t x)
+{
+    // splitmix64 finalizer
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+CuckooFilter::CuckooFilter(size_t capacity) : count(0)
+{
+    size_t buckets = 1;
+    while (buckets * SLOTS_PER_BUCKET < capacity + capacity / 4)
+    {
+        buckets <<= 1;
+    }
+    bucketMask = buckets - 1;
+    slots.assign(buckets * SLOTS_PER_BUCKET, 0);
+}
+
+uint16_t CuckooFilter::fingerprint(uint64_t key)
+{
+    uint16_t fp = static_cast<uint16_t>(key >> 48);
+    return fp ? fp : 1;
+}
+
+size_t CuckooFilter::altBucket(size_t bucket, uint16_t fp) const
+{
+    return (bucket ^ static_cast<size_t>(mix64(fp))) & bucketMask;
+}
+
+bool CuckooFilter::bucketHas(size_t bucket, uint16_t fp) const
+{
+    const uint16_t* b = &slots[bucket * SLOTS_PER_BUCKET];
+    return b[0] == fp || b[1] == fp || b[2] == fp || b[3] == fp;
+}
+
+bool CuckooFilter::bucketAdd(size_t bucket, uint16_t fp)
+{
+    uint16_t* b = &slots[bucket * SLOTS_PER_BUCKET];
+    for (size_t i = 0; i < SLOTS_PER_BUCKET; i++)
+    {
+        if (b[i] == 0)
+        {
+            b[i] = fp;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CuckooFilter::insert(uint64_t key)
+{
+    uint16_t fp = fingerprint(key);
+    size_t i1 = static_cast<size_t>(key) & bucketMask;
+    size_t i2 = altBucket(i1, fp);
+    if (bucketAdd(i1, fp) || bucketAdd(i2, fp))
+    {
+        count++;
+        return true;
+    }
+
+    // Evict fingerprints along the cuckoo path until one finds a free slot
+    size_t bucket = (key & 1) ? i1 : i2;
+    for (int kick = 0; kick < MAX_KICKS; kick++)
+    {
+        uint16_t& victim = slots[bucket * SLOTS_PER_BUCKET + (kick % SLOTS_PER_BUCKET)];
+        uint16_t evicted = victim;
+        victim = fp;
+        fp = evicted;
+        bucket = altBucket(bucket, fp);
+        if (bucketAdd(bucket, fp))
+        {
+            count++;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CuckooFilter::contains(uint64_t key) const
+{
+    uint16_t fp = fingerprint(key);
+    size_t i1 = static_cast<size_t>(key) & bucketMask;
+    return bucketHas(i1, fp) || bucketHas(altBucket(i1, fp), fp);
+}
+
+void CuckooFilter::clear()
+{
+    slots.assign(slots.size(), 0);
+    count = 0;
+}
+
+// ============================================================================
+// MessageDeduplicator
+// ============================================================================
+
+MessageDeduplicator::MessageDeduplicator(int64_t window, size_t maxIds)
+    : windowMs(window), windowStart(nowMs()), capacity(maxIds),
+      current(maxIds), previous(maxIds),
+      checks(0), duplicates(0), filterPositives(0)
+{
+}
+
+int64_t MessageDeduplicator::nowMs()
+{
+    return chrono::duration_cast<chrono::milliseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t MessageDeduplicator::makeKey(uint64_t senderId, uint64_t messageId)
+{
+    return mix64(senderId * 0x9e3779b97f4a7c15ULL ^ messageId);
+}
+
+void MessageDeduplicator::rotateIfDue(int64_t now)
+{
+    if (now - windowStart >= windowMs || current.size() >= capacity)
+    {
+        // Swap buffers instead of copying; the old "previous" is recycled
+        swap(current, previous);
+        current.clear();
+        windowStart = now;
+    }
+}
+
+bool MessageDeduplicator::isDuplicate(uint64_t key)
+{
+    checks++;
+    rotateIfDue(nowMs());
+
+    if (!current.contains(key) && !previous.contains(key))
+    {
+        return false;
+    }
+
+    filterPositives++;
+    if (recentIndex.find(key) == recentIndex.end())
+    {
+        return false;
+    }
+    duplicates++;
+    return true;
+}
+
+void MessageDeduplicator::record(uint64_t key)
+{
+    rotateIfDue(nowMs());
+    current.insert(key);
+
+    unordered_map<uint64_t, RecentList::iterator>::iterator it = recentIndex.find(key);
+    if (it != recentIndex.end())
+    {
+        recent.splice(recent.begin(), recent, it->second);
+        return;
+    }
+    recent.push_front(key);
+    recentIndex[key] = recent.begin();
+    if (recent.size() > capacity)
+    {
+        recentIndex.erase(recent.back());
+        recent.pop_back();
+    }
+}
+
+DedupStats MessageDeduplicator::getStats() const
+{
+    DedupStats stats;
+    stats.checks = checks;
+    stats.duplicates = duplicates;
+    stats.filterPositives = filterPositives;
+
+    // List node (key + 2 links) plus one hash node (key, iterator, next) per ID
+    size_t perId = sizeof(uint64_t) + 2 * sizeof(void*)
+                 + sizeof(uint64_t) + sizeof(RecentList::iterator) + sizeof(void*);
+    stats.memoryBytes = current.memoryBytes() + previous.memoryBytes()
+                      + recent.size() * perId
+                      + recentIndex.bucket_count() * sizeof(void*);
+    return stats;
+}
@@ -0,0 +1,156 @@
+/**
+ * @file MessageDeduplicator.h
+ * @brief Time-windowed duplicate detection for client message IDs
+ */
+
+#ifndef MESSAGEDEDUPLICATOR_H
+#define MESSAGEDEDUPLICATOR_H
+
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @class CuckooFilter
+ * @brief Approximate set membership with 16-bit fingerprints, 4 per bucket
+ *
+ * Never reports a false negative for an inserted key; false positives
+ * are around 0.01%. Memory is fixed at construction.
+ */
+class CuckooFilter
+{
+public:
+    /**
+     * @brief Constructor
+     * @param capacity Expected number of keys (rounded up to a power-of-two bucket count)
+     */
+    explicit CuckooFilter(size_t capacity);
+
+    /**
+     * @brief Insert a key
+     * @param key The key hash
+     * @return false if the filter is too full to take the key
+     */
+    bool insert(uint64_t key);
+
+    /**
+     * @brief Check whether a key may have been inserted
+     * @param key The key hash
+     * @return false if the key was definitely never inserted
+     */
+    bool contains(uint64_t key) const;
+
+    /**
+     * @brief Remove every key
+     */
+    void clear();
+
+    /**
+     * @brief Get the number of keys inserted since the last clear
+     * @return Key count
+     */
+    size_t size() const { return count; }
+
+    /**
+     * @brief Get the memory held by the filter
+     * @return Bytes used by the bucket array
+     */
+    size_t memoryBytes() const { return slots.size() * sizeof(uint16_t); }
+
+private:
+    static const size_t SLOTS_PER_BUCKET = 4;
+    static const int MAX_KICKS = 500;
+
+    size_t bucketMask;
+    size_t count;
+    vector<uint16_t> slots; // 0 marks an empty slot
+
+    static uint16_t fingerprint(uint64_t key);
+    size_t altBucket(size_t bucket, uint16_t fp) const;
+    bool bucketHas(size_t bucket, uint16_t fp) const;
+    bool bucketAdd(size_t bucket, uint16_t fp);
+};
+
+/**
+ * @struct DedupStats
+ * @brief Snapshot of deduplicator counters
+ */
+struct DedupStats
+{
+    uint64_t checks;
+    uint64_t duplicates;
+    uint64_t filterPositives;  // lookups that had to consult the exact LRU
+    size_t memoryBytes;
+};
+
+/**
+ * @class MessageDeduplicator
+ * @brief Detects retried sends by (sender, client message ID)
+ *
+ * Two cuckoo filters cover the current and previous time window, so a
+ * fresh ID is rejected by the filters alone. A filter hit is confirmed
+ * against a small exact LRU, so a false positive never drops a new
+ * message. IDs older than two windows, or pushed out of the LRU, are
+ * forgotten. Memory is fixed by the capacity and reported by getStats().
+ */
+class MessageDeduplicator
+{
+public:
+    /**
+     * @brief Constructor
+     * @param windowMs Length of one dedupe window in milliseconds
+     * @param capacity IDs remembered per window (also the exact LRU size)
+     */
+    MessageDeduplicator(int64_t windowMs = 60000, size_t capacity = 4096);
+
+    /**
+     * @brief Check whether an ID was already recorded
+     * @param key Combined sender/message-ID key (see makeKey)
+     * @return true if the send is a retry
+     */
+    bool isDuplicate(uint64_t key);
+
+    /**
+     * @brief Record an ID after its message was delivered
+     * @param key Combined sender/message-ID key (see makeKey)
+     */
+    void record(uint64_t key);
+
+    /**
+     * @brief Get counters and memory use
+     * @return Current statistics
+     */
+    DedupStats getStats() const;
+
+    /**
+     * @brief Combine a sender and a client message ID into one key
+     * @param senderId The sender's SenderIdentity id (never reused, unlike its address)
+     * @param messageId Client-supplied message ID
+     * @return Well-mixed 64-bit key
+     */
+    static uint64_t makeKey(uint64_t senderId, uint64_t messageId);
+
+private:
+    typedef list<uint64_t> RecentList;
+
+    void rotateIfDue(int64_t nowMs);
+    static int64_t nowMs();
+
+    int64_t windowMs;
+    int64_t windowStart;
+    size_t capacity;
+    CuckooFilter current;
+    CuckooFilter previous;
+
+    RecentList recent;
+    unordered_map<uint64_t, RecentList::iterator> recentIndex;
+
+    uint64_t checks;
+    uint64_t duplicates;
+    uint64_t filterPositives;
+};
+
+#endif
@@ -0,0 +1,50 @@
+/**
+ * @file MessageFilter.h
+ * @brief Pre-delivery pipeline stage that can inspect, rewrite or reject a message
+ */
+
+#ifndef MESSAGEFILTER_H
+#define MESSAGEFILTER_H
+
+#include <string>
+
+using namespace std;
+
+class Users;
+class ChatRoom;
+
+/**
+ * @enum FilterVerdict
+ * @brief Outcome of running a message through a filter
+ */
+enum FilterVerdict
+{
+    FILTER_ALLOW,       // deliver unchanged
+    FILTER_REWRITTEN,   // deliver the modified text
+    FILTER_REJECT       // do not deliver or save
+};
+
+/**
+ * @class MessageFilter
+ * @brief One stage of a room's pre-delivery pipeline
+ *
+ * Rooms run their filters in order before any send or log command is
+ * created; the first FILTER_REJECT stops the message. Filters may be
+ * shared by several rooms, so inspect() must not keep per-message state.
+ */
+class MessageFilter
+{
+public:
+    virtual ~MessageFilter() {}
+
+    /**
+     * @brief Inspect a message before delivery
+     * @param message The message text; may be modified in place
+     * @param fromUser The sender
+     * @param room The room the message is sent to
+     * @return The verdict
+     */
+    virtual FilterVerdict inspect(string& message, Users* fromUser, ChatRoom* room) = 0;
+};
+
+#endif
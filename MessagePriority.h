@@ -0,0 +1,43 @@
+/**
+ * @file MessagePriority.h
+ * @brief Priority classes for commands and notifications
+ */
+
+#ifndef MESSAGEPRIORITY_H
+#define MESSAGEPRIORITY_H
+
+/**
+ * @enum MessagePriority
+ * @brief Delivery class of a command or notification, most urgent first
+ *
+ * CRITICAL is meant for moderation actions, HIGH for admin broadcasts and
+ * membership notifications, NORMAL for chat and BULK for backfill-style
+ * traffic that may wait behind everything else.
+ */
+enum MessagePriority
+{
+    PRIORITY_CRITICAL = 0,
+    PRIORITY_HIGH,
+    PRIORITY_NORMAL,
+    PRIORITY_BULK,
+    PRIORITY_CLASSES
+};
+
+/**
+ * @brief Get a printable name for a priority class
+ * @param priority The priority class
+ * @return Name of the class
+ */
+inline const char* priorityName(MessagePriority priority)
+{
+    switch (priority)
+    {
+    case PRIORITY_CRITICAL: return "critical";
+    case PRIORITY_HIGH:     return "high";
+    case PRIORITY_NORMAL:   return "normal";
+    case PRIORITY_BULK:     return "bulk";
+    default:                return "unknown";
+    }
+}
+
+#endif
@@ -0,0 +1,103 @@
+/**
+ * @file MessageVisibility.h
+ * @brief Audience metadata for targeted (direct, group and tag) messages
+ */
+
+#ifndef MESSAGEVISIBILITY_H
+#define MESSAGEVISIBILITY_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+class Users;
+
+/**
+ * @struct MessageVisibility
+ * @brief Describes who a message was addressed to
+ *
+ * ROOM messages are visible to every member. DIRECT and GROUP messages
+ * are visible to the sender and the listed recipients; TAG messages to
+ * the sender and the members carrying the tag at send time (resolved
+ * into recipients when the message is delivered).
+ */
+struct MessageVisibility
+{
+    enum Scope { ROOM, DIRECT, GROUP, TAG };
+
+    Scope scope;
+    Users* sender;
+    vector<Users*> recipients;
+    string tag;
+
+    MessageVisibility() : scope(ROOM), sender(nullptr) {}
+
+    /**
+     * @brief Visibility for a single recipient
+     * @param from The sender
+     * @param to The recipient
+     * @return DIRECT visibility
+     */
+    static MessageVisibility direct(Users* from, Users* to) {
+        MessageVisibility v;
+        v.scope = DIRECT;
+        v.sender = from;
+        v.recipients.push_back(to);
+        return v;
+    }
+
+    /**
+     * @brief Visibility for an explicit recipient list
+     * @param from The sender
+     * @param to The recipients
+     * @return GROUP visibility
+     */
+    static MessageVisibility group(Users* from, const vector<Users*>& to) {
+        MessageVisibility v;
+        v.scope = GROUP;
+        v.sender = from;
+        v.recipients = to;
+        return v;
+    }
+
+    /**
+     * @brief Visibility for every member carrying a tag
+     * @param from The sender
+     * @param tagName The role or tag name
+     * @return TAG visibility
+     */
+    static MessageVisibility tagged(Users* from, const string& tagName) {
+        MessageVisibility v;
+        v.scope = TAG;
+        v.sender = from;
+        v.tag = tagName;
+        return v;
+    }
+
+    /**
+     * @brief Check whether a user may see the message
+     * @param user The user to check
+     * @return true if the message is visible to the user
+     */
+    bool isVisibleTo(const Users* user) const {
+        if (scope == ROOM || user == sender) {
+            return true;
+        }
+        return find(recipients.begin(), recipients.end(), user) != recipients.end();
+    }
+
+    /**
+     * @brief Drop every reference to a user that is being destroyed
+     * @param user The user
+     */
+    void forget(const Users* user) {
+        if (sender == user) {
+            sender = nullptr;
+        }
+        recipients.erase(remove(recipients.begin(), recipients.end(), user), recipients.end());
+    }
+};
+
+#endif
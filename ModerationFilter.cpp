@@ -0,0 +1,107 @@
+/**
+ * @file ModerationFilter.cpp
+ * @brief Implementation of the blocklist filter and its hot reload
+ */
+
+#include "ModerationFilter.h"
+#include <fstream>
+#include <sys/stat.h>
+
+using namespace std;
+
+ModerationFilter::ModerationFilter(const vector<string>& patterns, Action onMatch, bool words)
+    : matcher(make_shared<PatternMatcher>(patterns, words)), action(onMatch), wholeWords(words),
+      watchedMtime(0), watchedSize(0), inspected(0), rejected(0), redacted(0), reloads(0)
+{
+}
+
+shared_ptr<const PatternMatcher> ModerationFilter::current() const
+{
+    return atomic_load(&matcher);
+}
+
+FilterVerdict ModerationFilter::inspect(string& message, Users* fromUser, ChatRoom* room)
+{
+    (void)fromUser;
+    (void)room;
+    inspected.fetch_add(1, memory_order_relaxed);
+
+    shared_ptr<const PatternMatcher> active = current();
+    if (action == REJECT)
+    {
+        if (active->contains(message.data(), message.size()))
+        {
+            rejected.fetch_add(1, memory_order_relaxed);
+            return FILTER_REJECT;
+        }
+        return FILTER_ALLOW;
+    }
+    if (active->redact(message) > 0)
+    {
+        redacted.fetch_add(1, memory_order_relaxed);
+        return FILTER_REWRITTEN;
+    }
+    return FILTER_ALLOW;
+}
+
+void ModerationFilter::reload(const vector<string>& patterns)
+{
+    // Compile before publishing; the previous matcher is freed by its last user
+    shared_ptr<const PatternMatcher> compiled = make_shared<PatternMatcher>(patterns, wholeWords);
+    atomic_store(&matcher, compiled);
+    reloads.fetch_add(1, memory_order_relaxed);
+}
+
+bool ModerationFilter::reloadFromFile(const string& path)
+{
+    ifstream in(path.c_str());
+    if (!in)
+    {
+        return false;
+    }
+    vector<string> patterns;
+    string line;
+    while (getline(in, line))
+    {
+        if (!line.empty() && line[line.size() - 1] == '\r')
+        {
+            line.erase(line.size() - 1);
+        }
+        if (!line.empty() && line[0] != '#')
+        {
+            patterns.push_back(line);
+        }
+    }
+
+    struct stat info;
+    watchedPath = path;
+    bool found = stat(path.c_str(), &info) == 0;
+    watchedMtime = found ? info.st_mtime : 0;
+    watchedSize = found ? info.st_size : 0;
+    reload(patterns);
+    return true;
+}
+
+bool ModerationFilter::reloadIfChanged()
+{
+    struct stat info;
+    if (watchedPath.empty() || stat(watchedPath.c_str(), &info) != 0 ||
+        (info.st_mtime == watchedMtime && info.st_size == watchedSize))
+    {
+        return false;
+    }
+    return reloadFromFile(watchedPath);
+}
+
+ModerationStats ModerationFilter::getStats() const
+{
+    shared_ptr<const PatternMatcher> active = current();
+    ModerationStats stats;
+    stats.inspected = inspected.load(memory_order_relaxed);
+    stats.rejected = rejected.load(memory_order_relaxed);
+    stats.redacted = redacted.load(memory_order_relaxed);
+    stats.reloads = reloads.load(memory_order_relaxed);
+    stats.patterns = active->patternCount();
+    stats.matcherBytes = active->memoryBytes();
+    return stats;
+}
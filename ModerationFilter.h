@@ -0,0 +1,101 @@
+/**
+ * @file ModerationFilter.h
+ * @brief Blocklist filter backed by a compiled PatternMatcher, reloadable at runtime
+ */
+
+#ifndef MODERATIONFILTER_H
+#define MODERATIONFILTER_H
+
+#include <atomic>
+#include <ctime>
+#include <sys/types.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "MessageFilter.h"
+#include "PatternMatcher.h"
+
+using namespace std;
+
+/**
+ * @struct ModerationStats
+ * @brief Counters of a ModerationFilter
+ */
+struct ModerationStats
+{
+    uint64_t inspected;
+    uint64_t rejected;
+    uint64_t redacted;
+    uint64_t reloads;
+    size_t patterns;
+    size_t matcherBytes;
+};
+
+/**
+ * @class ModerationFilter
+ * @brief Rejects or redacts messages containing blocklisted phrases
+ *
+ * The blocklist is compiled once into a PatternMatcher, so a message is
+ * scanned in a single pass whatever the list size. reload() compiles the
+ * new list off to the side and swaps it in atomically: messages being
+ * inspected at that moment finish against the old list, later ones see
+ * the new one, and sends never wait for a compile.
+ */
+class ModerationFilter : public MessageFilter
+{
+public:
+    enum Action { REJECT, REDACT };
+
+    /**
+     * @brief Constructor
+     * @param patterns Initial blocklist
+     * @param onMatch Reject the message, or mask the matched text
+     * @param wholeWords Only match whole words
+     */
+    ModerationFilter(const vector<string>& patterns, Action onMatch = REJECT, bool wholeWords = false);
+
+    FilterVerdict inspect(string& message, Users* fromUser, ChatRoom* room) override;
+
+    /**
+     * @brief Replace the blocklist
+     * @param patterns The new blocklist
+     */
+    void reload(const vector<string>& patterns);
+
+    /**
+     * @brief Replace the blocklist from a file (one pattern per line, '#' starts a comment)
+     * @param path The file
+     * @return false if the file could not be read (the old list stays active)
+     */
+    bool reloadFromFile(const string& path);
+
+    /**
+     * @brief Reload from the file last passed to reloadFromFile() if it changed
+     * @return true if a reload happened
+     */
+    bool reloadIfChanged();
+
+    /**
+     * @brief Get the filter's counters
+     * @return Counter snapshot
+     */
+    ModerationStats getStats() const;
+
+private:
+    shared_ptr<const PatternMatcher> current() const;
+
+    shared_ptr<const PatternMatcher> matcher; // accessed through atomic_load/atomic_store
+    Action action;
+    bool wholeWords;
+
+    string watchedPath;
+    time_t watchedMtime;
+    off_t watchedSize;      // catches rewrites within the same mtime second
+
+    atomic<uint64_t> inspected;
+    atomic<uint64_t> rejected;
+    atomic<uint64_t> redacted;
+    atomic<uint64_t> reloads;
+};
+
+#endif
@@ -0,0 +1,9 @@
+//NotifyCommand.cpp
+#include "NotifyCommand.h"
+#include "ChatRoom.h"
+
+void NotifyCommand::execute()
+{
+    // Deliver a notification that was queued behind the delivery scheduler
+    room->notifyNow(message, sourceName);
+}
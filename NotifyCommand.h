@@ -0,0 +1,20 @@
+//NotifyCommand.h
+#ifndef NOTIFYCOMMAND_H
+#define NOTIFYCOMMAND_H
+
+#include "Command.h"
+#include "ChatRoom.h"
+
+class NotifyCommand : public Command
+{
+private:
+    string sourceName;
+
+public:
+    NotifyCommand(ChatRoom* chatRoom, string msg, string roomName)
+        : Command(chatRoom, msg, nullptr), sourceName(roomName) {}
+    
+    void execute() override;
+};
+
+#endif
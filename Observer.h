@@ -11,6 +11,7 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include "TrackingAllocator.h"
 
 using namespace std;
 
@@ -37,6 +38,9 @@ public:
     virtual void update(const string& message, const string& roomName) = 0;
 };
 
+// A subject's observers, charged to its memory account
+typedef vector<Observer*, TrackingAllocator<Observer*> > ObserverList;
+
 /**
  * @class Subject
  * @brief Abstract subject interface for managing observers
@@ -44,9 +48,19 @@ public:
  */
 class Subject {
 protected:
-    vector<Observer*> observers;
+    // Declared first so it outlives every container charged to it
+    MemoryAccount memory;
+    ObserverList observers;
     
 public:
+    /**
+     * @brief Constructor
+     * @param kind What owns the subject's memory account
+     * @param label Name of the owner in memory reports
+     */
+    Subject(MemoryAccount::Kind kind = MemoryAccount::OTHER, const string& label = "subject")
+        : memory(kind, label), observers(ObserverList::allocator_type(&memory, MEM_OBSERVERS)) {}
+    
     /**
      * @brief Virtual destructor
      */
@@ -61,6 +75,7 @@ public:
         auto it = find(observers.begin(), observers.end(), observer);
         if (it == observers.end()) {
             observers.push_back(observer);
+            memory.addObjects(MEM_OBSERVERS, 1);
         }
     }
     
@@ -72,6 +87,7 @@ public:
         auto it = find(observers.begin(), observers.end(), observer);
         if (it != observers.end()) {
             observers.erase(it);
+            memory.addObjects(MEM_OBSERVERS, -1);
         }
     }
     
@@ -90,9 +106,17 @@ public:
      * @brief Get the list of observers
      * @return Reference to the observers vector
      */
-    vector<Observer*>& getObservers() {
+    ObserverList& getObservers() {
         return observers;
     }
+    
+    /**
+     * @brief Get the memory account charged by this subject's containers
+     * @return The account
+     */
+    MemoryAccount& getMemoryAccount() {
+        return memory;
+    }
 };
 
 #endif // OBSERVER_H
\ No newline at end of file
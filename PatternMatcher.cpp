@@ -0,0 +1,205 @@
+/**
+ * @file PatternMatcher.cpp
+ * @brief Aho-Corasick construction and DFA scanning
+ */
+
+#include "PatternMatcher.h"
+#include <cctype>
+#include <cstring>
+#include <deque>
+
+using namespace std;
+
+namespace {
+
+const uint32_t NO_STATE = 0xffffffffu;
+const uint32_t MATCH_BIT = 0x80000000u;     // set on transitions into an output state
+const size_t MAX_PATTERN_LENGTH = 0xffff;
+
+inline unsigned char foldCase(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<unsigned char>(c + ('a' - 'A')) : c;
+}
+
+inline bool isWordByte(char c)
+{
+    return isalnum(static_cast<unsigned char>(c)) != 0;
+}
+
+} // namespace
+
+PatternMatcher::PatternMatcher(const vector<string>& patternList, bool words)
+    : patterns(0), states(1), classes(1), wholeWords(words)
+{
+    // Byte classes: 0 for bytes no pattern uses, one class per distinct folded byte
+    memset(classOf, 0, sizeof(classOf));
+    for (const string& pattern : patternList)
+    {
+        for (unsigned char c : pattern)
+        {
+            unsigned char folded = foldCase(c);
+            if (classOf[folded] == 0)
+            {
+                classOf[folded] = static_cast<uint16_t>(classes++);
+            }
+        }
+    }
+    for (int c = 'A'; c <= 'Z'; c++)
+    {
+        classOf[c] = classOf[c + ('a' - 'A')];
+    }
+
+    // Trie of the folded patterns
+    delta.assign(classes, NO_STATE);
+    ownLength.assign(1, 0);
+    for (const string& pattern : patternList)
+    {
+        if (pattern.empty() || pattern.size() > MAX_PATTERN_LENGTH)
+        {
+            continue;
+        }
+        uint32_t state = 0;
+        for (unsigned char c : pattern)
+        {
+            uint32_t& edge = delta[state * classes + classOf[foldCase(c)]];
+            if (edge == NO_STATE)
+            {
+                edge = static_cast<uint32_t>(states++);
+                delta.resize(states * classes, NO_STATE);
+                ownLength.push_back(0);
+            }
+            state = delta[state * classes + classOf[foldCase(c)]];
+        }
+        ownLength[state] = static_cast<uint16_t>(pattern.size());
+        patterns++;
+    }
+    matchLength = ownLength;
+
+    // Breadth-first: fold failure links into the table so every state has
+    // a transition on every class, inherit outputs along failure links and
+    // link each state to the next state on its failure chain that has one
+    vector<uint32_t> fail(states, 0);
+    outputLink.assign(states, NO_STATE);
+    deque<uint32_t> queue;
+    for (size_t c = 0; c < classes; c++)
+    {
+        uint32_t& edge = delta[c];
+        if (edge == NO_STATE)
+        {
+            edge = 0;
+        }
+        else
+        {
+            fail[edge] = 0;
+            queue.push_back(edge);
+        }
+    }
+    while (!queue.empty())
+    {
+        uint32_t state = queue.front();
+        queue.pop_front();
+        if (matchLength[state] < matchLength[fail[state]])
+        {
+            matchLength[state] = matchLength[fail[state]];
+        }
+        outputLink[state] = ownLength[fail[state]] ? fail[state] : outputLink[fail[state]];
+        for (size_t c = 0; c < classes; c++)
+        {
+            uint32_t& edge = delta[state * classes + c];
+            uint32_t fallback = delta[fail[state] * classes + c];
+            if (edge == NO_STATE)
+            {
+                edge = fallback;
+            }
+            else
+            {
+                fail[edge] = fallback;
+                queue.push_back(edge);
+            }
+        }
+    }
+
+    // Store row offsets instead of state numbers (no multiply while
+    // scanning) and flag transitions that land on an output state
+    for (uint32_t& edge : delta)
+    {
+        uint32_t target = edge;
+        edge = static_cast<uint32_t>(target * classes) | (matchLength[target] ? MATCH_BIT : 0);
+    }
+}
+
+bool PatternMatcher::isBoundary(const char* text, size_t length, size_t begin, size_t end) const
+{
+    return (begin == 0 || !isWordByte(text[begin - 1])) && (end == length || !isWordByte(text[end]));
+}
+
+size_t PatternMatcher::wordMatch(const char* text, size_t length, uint32_t state, size_t end) const
+{
+    // Longest first: the state's own pattern, then shorter suffixes
+    for (uint32_t s = ownLength[state] ? state : outputLink[state]; s != NO_STATE; s = outputLink[s])
+    {
+        if (isBoundary(text, length, end - ownLength[s], end))
+        {
+            return ownLength[s];
+        }
+    }
+    return 0;
+}
+
+bool PatternMatcher::contains(const char* text, size_t length) const
+{
+    const uint32_t* table = delta.data();
+    uint32_t row = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        uint32_t next = table[row + classOf[static_cast<unsigned char>(text[i])]];
+        row = next & ~MATCH_BIT;
+        if (next & MATCH_BIT)
+        {
+            if (!wholeWords || wordMatch(text, length, row / classes, i + 1))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+size_t PatternMatcher::redact(string& text, char mask) const
+{
+    const uint32_t* table = delta.data();
+    uint32_t row = 0;
+    size_t found = 0;
+    size_t masked = 0; // text before this offset is already masked
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        uint32_t next = table[row + classOf[static_cast<unsigned char>(text[i])]];
+        row = next & ~MATCH_BIT;
+        if (!(next & MATCH_BIT))
+        {
+            continue;
+        }
+        size_t matched = wholeWords ? wordMatch(text.data(), text.size(), row / classes, i + 1)
+                                    : matchLength[row / classes];
+        if (matched == 0)
+        {
+            continue;
+        }
+        size_t begin = i + 1 - matched;
+        // The automaton keeps running on the original bytes: masking only
+        // touches positions it has already consumed
+        for (size_t j = begin > masked ? begin : masked; j <= i; j++)
+        {
+            text[j] = mask;
+        }
+        masked = i + 1;
+        found++;
+    }
+    return found;
+}
+
+size_t PatternMatcher::memoryBytes() const
+{
+    return (delta.capacity() + outputLink.capacity()) * sizeof(uint32_t) +
+           (matchLength.capacity() + ownLength.capacity()) * sizeof(uint16_t) + sizeof(classOf);
+}
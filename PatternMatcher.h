@@ -0,0 +1,83 @@
+/**
+ * @file PatternMatcher.h
+ * @brief Multi-pattern matcher compiled once into an Aho-Corasick DFA
+ */
+
+#ifndef PATTERNMATCHER_H
+#define PATTERNMATCHER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @class PatternMatcher
+ * @brief Finds any of a fixed set of patterns in one pass over the text
+ *
+ * The pattern set is compiled into a deterministic automaton: every state
+ * has a transition for every input class, with the Aho-Corasick failure
+ * links already folded in. Scanning therefore costs one table lookup per
+ * byte regardless of how many patterns there are. Bytes are mapped to a
+ * small number of classes first (letters case-folded, bytes that occur in
+ * no pattern share one class), which keeps the table compact.
+ *
+ * Matching is ASCII case-insensitive. With wholeWords set, a match only
+ * counts if it is not preceded or followed by a letter or digit; every
+ * pattern ending at a position is tried (via output links), not just the
+ * longest, so "x bad" failing a boundary does not hide "bad".
+ * Immutable after construction, so one instance may be shared by threads.
+ */
+class PatternMatcher
+{
+public:
+    /**
+     * @brief Compile a pattern set (empty patterns are ignored)
+     * @param patterns The patterns
+     * @param wholeWords Only match at word boundaries
+     */
+    explicit PatternMatcher(const vector<string>& patterns, bool wholeWords = false);
+
+    /**
+     * @brief Check whether the text contains any pattern (stops at the first)
+     * @param text The text
+     * @param length Text length in bytes
+     * @return true if a pattern occurs
+     */
+    bool contains(const char* text, size_t length) const;
+
+    /**
+     * @brief Overwrite every occurrence of every pattern
+     * @param text The text, modified in place
+     * @param mask Replacement byte
+     * @return Number of occurrences masked
+     */
+    size_t redact(string& text, char mask = '*') const;
+
+    size_t patternCount() const { return patterns; }
+    size_t stateCount() const { return states; }
+    size_t classCount() const { return classes; }
+
+    /**
+     * @brief Get the bytes held by the compiled tables
+     * @return Table bytes
+     */
+    size_t memoryBytes() const;
+
+private:
+    bool isBoundary(const char* text, size_t length, size_t begin, size_t end) const;
+    size_t wordMatch(const char* text, size_t length, uint32_t state, size_t end) const;
+
+    uint16_t classOf[256];
+    vector<uint32_t> delta;         // states x classes
+    vector<uint16_t> matchLength;   // longest pattern ending in each state, 0 if none
+    vector<uint16_t> ownLength;     // pattern spelled by the state itself, 0 if none
+    vector<uint32_t> outputLink;    // next shorter suffix state with a pattern, or none
+    size_t patterns;
+    size_t states;
+    size_t classes;
+    bool wholeWords;
+};
+
+#endif
@@ -0,0 +1,439 @@
+/**
+ * @file PayloadStore.cpp
+ * @brief Implementation of block compression for long history payloads
+ */
+
+#include "PayloadStore.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace {
+
+const size_t MIN_MATCH = 4;
+const size_t MAX_OFFSET = 65535;
+const int HASH_BITS = 13;
+
+inline uint32_t read32(const char* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint32_t hash4(const char* p)
+{
+    return (read32(p) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Lengths of 15 and more continue in bytes of 255 plus a final remainder
+void writeLength(string& out, size_t length)
+{
+    while (length >= 255)
+    {
+        out.push_back(static_cast<char>(255));
+        length -= 255;
+    }
+    out.push_back(static_cast<char>(length));
+}
+
+void emitSequence(string& out, const char* literals, size_t literalCount,
+                  size_t offset, size_t matchLength)
+{
+    size_t matchCode = matchLength ? matchLength - MIN_MATCH : 0;
+    out.push_back(static_cast<char>(((literalCount < 15 ? literalCount : 15) << 4) |
+                                    (matchCode < 15 ? matchCode : 15)));
+    if (literalCount >= 15)
+    {
+        writeLength(out, literalCount - 15);
+    }
+    out.append(literals, literalCount);
+    if (matchLength)
+    {
+        out.push_back(static_cast<char>(offset & 0xff));
+        out.push_back(static_cast<char>(offset >> 8));
+        if (matchCode >= 15)
+        {
+            writeLength(out, matchCode - 15);
+        }
+    }
+}
+
+bool readLength(const unsigned char*& in, const unsigned char* end, size_t& length)
+{
+    unsigned char byte;
+    do
+    {
+        if (in >= end)
+        {
+            return false;
+        }
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+} // namespace
+
+struct PayloadStore::ReaderSlot
+{
+    atomic<uint64_t> pinned;    // epoch the current read started in, UNPINNED between reads
+    atomic<bool> inUse;
+    ReaderSlot* next;
+};
+
+PayloadStore::PayloadStore()
+    : open(nullptr), retiredSize(0), epoch(0), slots(nullptr), compressedBytes(0), raw(0)
+{
+}
+
+PayloadStore::~PayloadStore()
+{
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        delete[] blocks[i].data;
+    }
+    Retired last = { open.load(), 0 };
+    retired.push_back(last);
+    for (const Retired& entry : retired)
+    {
+        if (entry.buffer)
+        {
+            delete[] entry.buffer->data;
+            delete entry.buffer;
+        }
+    }
+    ReaderSlot* slot = slots.load();
+    while (slot)
+    {
+        ReaderSlot* next = slot->next;
+        delete slot;
+        slot = next;
+    }
+}
+
+void PayloadStore::addReader(DecodeCache& reader) const
+{
+    // Slots are never freed while the store lives, so walking the list is safe
+    for (ReaderSlot* slot = slots.load(); slot; slot = slot->next)
+    {
+        bool idle = false;
+        if (slot->inUse.compare_exchange_strong(idle, true))
+        {
+            reader.slot = slot;
+            return;
+        }
+    }
+    ReaderSlot* slot = new ReaderSlot();
+    slot->pinned.store(UNPINNED);
+    slot->inUse.store(true);
+    slot->next = slots.load();
+    while (!slots.compare_exchange_weak(slot->next, slot))
+    {
+    }
+    reader.slot = slot;
+}
+
+void PayloadStore::removeReader(DecodeCache& reader) const
+{
+    if (reader.slot)
+    {
+        reader.slot->pinned.store(UNPINNED);
+        reader.slot->inUse.store(false);
+        reader.slot = nullptr;
+    }
+}
+
+void PayloadStore::add(const char* data, uint32_t length, uint32_t& block, uint32_t& offset)
+{
+    OpenBlock* current = open.load(memory_order_relaxed);
+    if (current && current->used + length > current->capacity)
+    {
+        seal();
+        current = nullptr;
+    }
+    if (!current)
+    {
+        reclaim();
+        current = new OpenBlock();
+        current->block = static_cast<uint32_t>(blocks.size());
+        current->used = 0;
+        current->capacity = static_cast<uint32_t>(length > BLOCK_SIZE ? length : BLOCK_SIZE);
+        current->data = new char[current->capacity];
+        open.store(current, memory_order_release);
+    }
+
+    // Bytes past `used` are invisible to readers until the record that
+    // refers to them is published
+    block = current->block;
+    offset = current->used;
+    memcpy(current->data + current->used, data, length);
+    current->used += length;
+    raw += length;
+}
+
+void PayloadStore::seal()
+{
+    OpenBlock* current = open.load(memory_order_relaxed);
+    Block sealed;
+    sealed.data = nullptr;
+    sealed.rawSize = current->used;
+    sealed.usesDictionary = !dictionary.empty();
+    sealed.isDictionary = false;
+    sealed.packed = false;
+    sealed.compressedSize = 0;
+
+    // The room's first block of long messages seeds the shared dictionary
+    string contents(current->data, current->used);
+    if (dictionary.empty() && contents.size() <= DICTIONARY_SIZE)
+    {
+        dictionary = contents;
+        sealed.isDictionary = true;
+    }
+    else
+    {
+        string packed;
+        compress(dictionary, contents, packed);
+        sealed.packed = packed.size() < contents.size();
+        const string& body = sealed.packed ? packed : contents;
+        char* copy = new char[body.size()];
+        memcpy(copy, body.data(), body.size());
+        sealed.data = copy;
+        sealed.compressedSize = static_cast<uint32_t>(body.size());
+        compressedBytes += body.size();
+        if (dictionary.empty())
+        {
+            dictionary = contents.substr(0, DICTIONARY_SIZE);
+        }
+    }
+
+    // Publish the sealed block before withdrawing the raw one, so a reader
+    // that no longer finds its block open always finds it sealed
+    blocks.push_back(sealed);
+    open.store(nullptr);
+    // A read that pins a later epoch started after the store above, so it
+    // can no longer find this buffer open
+    Retired entry = { current, epoch.fetch_add(1) };
+    retired.push_back(entry);
+    retiredSize += current->capacity;
+}
+
+uint64_t PayloadStore::oldestPin() const
+{
+    uint64_t oldest = UNPINNED;
+    for (ReaderSlot* slot = slots.load(); slot; slot = slot->next)
+    {
+        oldest = min(oldest, slot->pinned.load());
+    }
+    return oldest;
+}
+
+void PayloadStore::reclaim()
+{
+    if (retired.empty())
+    {
+        return;
+    }
+    // Retired in epoch order, so the reclaimable ones form a prefix
+    uint64_t oldest = oldestPin();
+    size_t freed = 0;
+    while (freed < retired.size() && retired[freed].epoch < oldest)
+    {
+        retiredSize -= retired[freed].buffer->capacity;
+        delete[] retired[freed].buffer->data;
+        delete retired[freed].buffer;
+        freed++;
+    }
+    retired.erase(retired.begin(), retired.begin() + freed);
+}
+
+bool PayloadStore::read(uint32_t block, uint32_t offset, uint32_t length, string& out) const
+{
+    return read(block, offset, length, out, cache);
+}
+
+bool PayloadStore::read(uint32_t block, uint32_t offset, uint32_t length, string& out,
+                        DecodeCache& reader) const
+{
+    // Pinned before open is loaded; both sequentially consistent (see seal)
+    struct Pin
+    {
+        ReaderSlot* slot;
+        ~Pin() {
+            if (slot) {
+                slot->pinned.store(UNPINNED);
+            }
+        }
+    } pin = { reader.slot };
+    if (pin.slot)
+    {
+        pin.slot->pinned.store(epoch.load());
+    }
+
+    OpenBlock* current = open.load();
+    if (current && current->block == block)
+    {
+        out.assign(current->data + offset, length);
+        return true;
+    }
+
+    const Block& entry = blocks[block];
+    if (entry.isDictionary)
+    {
+        out.assign(dictionary, offset, length);
+        return true;
+    }
+    if (block != reader.block)
+    {
+        if (!entry.packed)
+        {
+            reader.base = 0;
+            reader.decoded.assign(entry.data, entry.compressedSize);
+        }
+        else
+        {
+            reader.base = entry.usesDictionary ? dictionary.size() : 0;
+            reader.decoded.assign(dictionary, 0, reader.base);
+            reader.decoded.resize(reader.base + entry.rawSize);
+            if (!decompress(entry.data, entry.compressedSize, &reader.decoded[0], reader.base, entry.rawSize))
+            {
+                // The buffer holds a partial decode: never serve it as this block (or the last one)
+                reader.block = DecodeCache().block;
+                out.clear();
+                return false;
+            }
+        }
+        reader.block = block;
+        reader.decodes++;
+    }
+    out.assign(reader.decoded, reader.base + offset, length);
+    return true;
+}
+
+size_t PayloadStore::storedBytes() const
+{
+    OpenBlock* current = open.load(memory_order_relaxed);
+    return compressedBytes + (current ? current->capacity : 0) + retiredSize + dictionary.capacity() +
+           blocks.reservedBytes();
+}
+
+void PayloadStore::compress(const string& dict, const string& src, string& out)
+{
+    // Match against [dict][src] as one window so back-references may reach the dictionary
+    string window = dict + src;
+    const char* base = window.data();
+    size_t end = window.size();
+
+    vector<int32_t> table(1u << HASH_BITS, -1);
+    for (size_t pos = 0; pos + MIN_MATCH <= dict.size(); pos++)
+    {
+        table[hash4(base + pos)] = static_cast<int32_t>(pos);
+    }
+
+    out.clear();
+    out.reserve(src.size() / 2);
+    size_t anchor = dict.size();
+    size_t pos = dict.size();
+    while (pos + MIN_MATCH <= end)
+    {
+        uint32_t h = hash4(base + pos);
+        int32_t candidate = table[h];
+        table[h] = static_cast<int32_t>(pos);
+
+        if (candidate < 0 || pos - candidate > MAX_OFFSET ||
+            read32(base + candidate) != read32(base + pos))
+        {
+            pos++;
+            continue;
+        }
+
+        size_t length = MIN_MATCH;
+        while (pos + length < end && base[candidate + length] == base[pos + length])
+        {
+            length++;
+        }
+        emitSequence(out, base + anchor, pos - anchor, pos - candidate, length);
+
+        for (size_t skip = pos + 1; skip < pos + length && skip + MIN_MATCH <= end; skip++)
+        {
+            table[hash4(base + skip)] = static_cast<int32_t>(skip);
+        }
+        pos += length;
+        anchor = pos;
+    }
+    if (anchor < end)
+    {
+        emitSequence(out, base + anchor, end - anchor, 0, 0);
+    }
+}
+
+bool PayloadStore::decompress(const char* in, size_t inLength, char* window,
+                              size_t dictLength, size_t rawSize)
+{
+    const unsigned char* ip = reinterpret_cast<const unsigned char*>(in);
+    const unsigned char* ipEnd = ip + inLength;
+    char* op = window + dictLength;
+    char* opEnd = op + rawSize;
+
+    while (op < opEnd)
+    {
+        if (ip >= ipEnd)
+        {
+            return false;
+        }
+        unsigned token = *ip++;
+
+        size_t literals = token >> 4;
+        if (literals == 15 && !readLength(ip, ipEnd, literals))
+        {
+            return false;
+        }
+        if (literals > static_cast<size_t>(ipEnd - ip) || literals > static_cast<size_t>(opEnd - op))
+        {
+            return false;
+        }
+        memcpy(op, ip, literals);
+        op += literals;
+        ip += literals;
+        if (op == opEnd)
+        {
+            break;
+        }
+
+        if (ipEnd - ip < 2)
+        {
+            return false;
+        }
+        size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        size_t length = token & 15;
+        if (length == 15 && !readLength(ip, ipEnd, length))
+        {
+            return false;
+        }
+        length += MIN_MATCH;
+        if (offset == 0 || offset > static_cast<size_t>(op - window) ||
+            length > static_cast<size_t>(opEnd - op))
+        {
+            return false;
+        }
+
+        // Overlapping copies (offset < length) repeat the pattern byte by byte
+        const char* match = op - offset;
+        if (offset >= length)
+        {
+            memcpy(op, match, length);
+            op += length;
+        }
+        else
+        {
+            for (size_t i = 0; i < length; i++)
+            {
+                *op++ = *match++;
+            }
+        }
+    }
+    return true;
+}
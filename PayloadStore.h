@@ -0,0 +1,213 @@
+/**
+ * @file PayloadStore.h
+ * @brief Block-compressed storage for message text too long to inline
+ */
+
+#ifndef PAYLOADSTORE_H
+#define PAYLOADSTORE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "AppendLog.h"
+
+using namespace std;
+
+/**
+ * @class PayloadStore
+ * @brief Append-only text store that compresses fixed-size blocks
+ *
+ * Messages are appended to an open block; once it reaches BLOCK_SIZE it
+ * is sealed and compressed with a small LZ77 coder (LZ4-style sequences,
+ * 64 KiB window). The first sealed block becomes the store's dictionary
+ * (and is stored only once, as the dictionary): later blocks may refer
+ * back into it, so phrases a room keeps repeating
+ * cost a few bytes each even in short messages. A message never spans
+ * blocks. Reads decode a whole block and keep the last one decoded, so
+ * sequential readers decompress each block once.
+ *
+ * One thread appends; other threads may read messages whose records they
+ * saw published, each with its own DecodeCache, while registered through
+ * addReader(). Sealed blocks are immutable once published. The raw
+ * buffer of a sealed block may still be read by a reader that found it
+ * open, so it is reclaimed by epoch: sealing tags the buffer with the
+ * current epoch and advances it, each read pins the epoch it started in,
+ * and the buffer is freed once every pinned epoch is newer than its tag.
+ * Readers pin only for the duration of a read, so a reader that stays
+ * registered but idle holds nothing back.
+ */
+class PayloadStore
+{
+public:
+    static const size_t BLOCK_SIZE = 4096;
+    static const size_t DICTIONARY_SIZE = 4096;
+
+    /**
+     * @struct DecodeCache
+     * @brief The last block a reader decoded: [dictionary][raw block]
+     */
+    struct ReaderSlot;
+
+    struct DecodeCache
+    {
+        string decoded;
+        size_t base;
+        uint32_t block;
+        uint64_t decodes;
+        ReaderSlot* slot;   // set by addReader()
+
+        DecodeCache() : base(0), block(0xffffffffu), decodes(0), slot(nullptr) {}
+    };
+
+    PayloadStore();
+    ~PayloadStore();
+
+    /**
+     * @brief Append a message
+     * @param data The message bytes
+     * @param length Number of bytes
+     * @param block Receives the block the message was placed in
+     * @param offset Receives the message's offset inside that block
+     */
+    void add(const char* data, uint32_t length, uint32_t& block, uint32_t& offset);
+
+    /**
+     * @brief Read a message back
+     * @param block Block returned by add()
+     * @param offset Offset returned by add()
+     * @param length Message length
+     * @param out Receives the message (empty on failure)
+     * @return false if the block does not decompress
+     */
+    bool read(uint32_t block, uint32_t offset, uint32_t length, string& out) const;
+
+    /**
+     * @brief Read a message back from any thread (reader must be registered;
+     *        the read pins the current epoch until it returns)
+     * @param block Block returned by add()
+     * @param offset Offset returned by add()
+     * @param length Message length
+     * @param out Receives the message (empty on failure)
+     * @param cache The calling reader's decode cache
+     * @return false if the block does not decompress
+     */
+    bool read(uint32_t block, uint32_t offset, uint32_t length, string& out, DecodeCache& cache) const;
+
+    /**
+     * @brief Register a concurrent reader (gives it an epoch slot)
+     * @param reader The reader's decode cache, which keeps the slot
+     */
+    void addReader(DecodeCache& reader) const;
+
+    /**
+     * @brief Unregister a concurrent reader (its slot is reused by a later one)
+     * @param reader The decode cache passed to addReader()
+     */
+    void removeReader(DecodeCache& reader) const;
+
+    /**
+     * @brief Get the bytes held (compressed blocks, open block, dictionary, index)
+     * @return Stored bytes
+     */
+    size_t storedBytes() const;
+
+    /**
+     * @brief Get the uncompressed size of everything appended
+     * @return Raw bytes
+     */
+    size_t rawBytes() const { return raw; }
+
+    /**
+     * @brief Get the number of sealed blocks
+     * @return Block count
+     */
+    size_t sealedBlocks() const { return blocks.size(); }
+
+    /**
+     * @brief Get the raw buffers of sealed blocks that readers may still hold
+     * @return Bytes waiting to be reclaimed
+     */
+    size_t retiredBytes() const { return retiredSize; }
+
+    /**
+     * @brief Get the size of the shared dictionary
+     * @return Dictionary bytes (0 until the first block is sealed)
+     */
+    size_t dictionaryBytes() const { return dictionary.size(); }
+
+    /**
+     * @brief Get the number of block decodes performed (decode cache misses)
+     * @return Decode count
+     */
+    uint64_t getBlocksDecoded() const { return cache.decodes; }
+
+    /**
+     * @brief Compress with an optional dictionary the output may refer into
+     * @param dict Dictionary bytes (may be empty)
+     * @param src Bytes to compress
+     * @param out Receives the compressed sequences
+     */
+    static void compress(const string& dict, const string& src, string& out);
+
+    /**
+     * @brief Decompress into a buffer that already holds the dictionary
+     * @param in Compressed sequences
+     * @param inLength Compressed size
+     * @param window Dictionary followed by rawSize bytes of space for the output
+     * @param dictLength Dictionary bytes at the start of window
+     * @param rawSize Decompressed size
+     * @return false if the input is malformed
+     */
+    static bool decompress(const char* in, size_t inLength, char* window,
+                           size_t dictLength, size_t rawSize);
+
+private:
+    struct Block
+    {
+        const char* data;       // compressed bytes (raw if not packed; null for the dictionary)
+        uint32_t compressedSize;
+        uint32_t rawSize;
+        bool packed;            // false if compression did not help; stored as is
+        bool usesDictionary;
+        bool isDictionary;      // the block is the dictionary itself; nothing else stored
+    };
+
+    // The block being filled; its capacity is fixed, so appends never move it
+    struct OpenBlock
+    {
+        uint32_t block;
+        uint32_t used;
+        uint32_t capacity;
+        char* data;
+    };
+
+    struct Retired
+    {
+        OpenBlock* buffer;
+        uint64_t epoch;         // reads pinned at this epoch or earlier may hold it
+    };
+
+    static const uint64_t UNPINNED = UINT64_MAX;
+
+    PayloadStore(const PayloadStore&);
+    PayloadStore& operator=(const PayloadStore&);
+
+    void seal();
+    void reclaim();
+    uint64_t oldestPin() const;
+
+    AppendLog<Block, 16> blocks;    // sealed blocks; the open block is index blocks.size()
+    atomic<OpenBlock*> open;
+    vector<Retired> retired;        // sealed raw buffers readers may still hold, oldest first
+    size_t retiredSize;
+    atomic<uint64_t> epoch;
+    mutable atomic<ReaderSlot*> slots;  // every slot ever handed out, newest first
+    string dictionary;              // set once, before the first block that uses it
+    size_t compressedBytes;
+    size_t raw;
+
+    mutable DecodeCache cache;      // for reads on the writer's thread
+};
+
+#endif
@@ -0,0 +1,495 @@
+/**
+ * @file PerfMain.cpp
+ * @brief Performance regression harness and PGO training load for PetSpace
+ *
+ * Runs a fixed set of microbenchmarks (send fan-out, register/remove
+ * churn, notify, history iteration), each as several timed samples, and
+ * either records them as a baseline or compares them against one. The
+ * samples come from several fresh processes (--runs), since one process
+ * hides the run-to-run variation of heap layout and ASLR. A benchmark
+ * regresses when its median slowed down by more than its noise floor
+ * (the threshold, or the spread between per-process medians if that is
+ * larger) AND a one-sided Mann-Whitney U test says the slowdown is not
+ * noise. Exit status is 1 if anything regressed.
+ *
+ *   perf_main --record <file>    write a baseline
+ *   perf_main --compare <file>   compare against a baseline (default)
+ *   perf_main --train            run the workload once (PGO training)
+ *
+ * Options: --runs 3, --samples N (per run), --threshold 0.10, --alpha 0.01
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ChatRoom.h"
+#include "CtrlCat.h"
+#include "Dogorithm.h"
+#include "Users.h"
+
+using namespace std;
+
+typedef chrono::steady_clock PerfClock;
+
+// Keeps the optimizer from discarding benchmark loops
+static volatile size_t perfSink = 0;
+
+// Fixed sizes: a baseline is only comparable to runs of the same workload
+static const int FANOUT_MEMBERS = 200;
+static const int FANOUT_SENDS = 2000;
+static const int CHURN_MEMBERS = 1000;
+static const int CHURN_CYCLES = 5000;
+static const int NOTIFY_OBSERVERS = 1000;
+static const int NOTIFY_CALLS = 200;
+static const size_t HISTORY_MESSAGES = 100000;
+
+/**
+ * One benchmark: setup builds its state once, sample() times one batch
+ * of operations and returns nanoseconds per operation.
+ */
+class PerfCase
+{
+public:
+    virtual ~PerfCase() {}
+    virtual const char* name() const = 0;
+    virtual double sample() = 0;
+};
+
+static double nsPer(PerfClock::time_point start, size_t count) {
+    double ns = chrono::duration<double, nano>(PerfClock::now() - start).count();
+    return count ? ns / count : 0.0;
+}
+
+// ============================================================================
+// Benchmarks
+// ============================================================================
+
+class SendFanoutCase : public PerfCase
+{
+public:
+    SendFanoutCase() {
+        for (int i = 0; i < FANOUT_MEMBERS; i++) {
+            people.push_back(new Users("User" + to_string(i)));
+            room.registerUser(people.back());
+        }
+    }
+    ~SendFanoutCase() {
+        for (Users* user : people) {
+            delete user;
+        }
+    }
+    const char* name() const override { return "send_fanout_200"; }
+    double sample() override {
+        PerfClock::time_point start = PerfClock::now();
+        for (int i = 0; i < FANOUT_SENDS; i++) {
+            people[i % FANOUT_MEMBERS]->send("hello everyone", &room);
+        }
+        return nsPer(start, FANOUT_SENDS);
+    }
+
+private:
+    CtrlCat room;
+    vector<Users*> people;
+};
+
+class ChurnCase : public PerfCase
+{
+public:
+    ChurnCase() : visitor("Visitor") {
+        for (int i = 0; i < CHURN_MEMBERS; i++) {
+            people.push_back(new Users("User" + to_string(i)));
+            room.registerUser(people.back());
+        }
+    }
+    ~ChurnCase() {
+        for (Users* user : people) {
+            delete user;
+        }
+    }
+    const char* name() const override { return "register_remove_1000"; }
+    double sample() override {
+        PerfClock::time_point start = PerfClock::now();
+        for (int i = 0; i < CHURN_CYCLES; i++) {
+            room.registerUser(&visitor);
+            room.removeUser(&visitor);
+        }
+        return nsPer(start, CHURN_CYCLES);
+    }
+
+private:
+    Dogorithm room;
+    Users visitor;
+    vector<Users*> people;
+};
+
+class NotifyCase : public PerfCase
+{
+public:
+    NotifyCase() {
+        for (int i = 0; i < NOTIFY_OBSERVERS; i++) {
+            people.push_back(new Users("User" + to_string(i)));
+            room.subscribe(people.back());
+        }
+    }
+    ~NotifyCase() {
+        for (Users* user : people) {
+            delete user;
+        }
+    }
+    const char* name() const override { return "notify_1000"; }
+    double sample() override {
+        // Observers keep their notifications; start every sample from empty
+        for (Users* user : people) {
+            user->clearNotifications();
+        }
+        PerfClock::time_point start = PerfClock::now();
+        for (int i = 0; i < NOTIFY_CALLS; i++) {
+            room.notify("Someone has joined CtrlCat!", "CtrlCat");
+        }
+        return nsPer(start, NOTIFY_CALLS);
+    }
+
+private:
+    CtrlCat room;
+    vector<Users*> people;
+};
+
+class HistoryIterationCase : public PerfCase
+{
+public:
+    HistoryIterationCase() : sender("SomeoneWithAName") {
+        ChatHistory& history = room.getChatHistory();
+        for (size_t i = 0; i < HISTORY_MESSAGES; i++) {
+            history.append(&sender, i % 3 ? "message number " + to_string(i) : "ok");
+        }
+    }
+    const char* name() const override { return "history_iteration_100k"; }
+    double sample() override {
+        // Cold pages each time: the render path is what changes hurt
+        room.getChatHistory().setFormatter(&ChatHistory::defaultFormat);
+        PerfClock::time_point start = PerfClock::now();
+        for (const string& line : room.historyCursor()) {
+            perfSink += line.size();
+        }
+        return nsPer(start, HISTORY_MESSAGES);
+    }
+
+private:
+    CtrlCat room;
+    Users sender;
+};
+
+// ============================================================================
+// Statistics
+// ============================================================================
+
+static double median(vector<double> values) {
+    sort(values.begin(), values.end());
+    size_t n = values.size();
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+/**
+ * One-sided Mann-Whitney U test (normal approximation, mid-ranks for ties)
+ * @return p-value for "current is slower than baseline"
+ */
+static double slowerPValue(const vector<double>& baseline, const vector<double>& current) {
+    vector<pair<double, int> > pooled;
+    for (double value : baseline) {
+        pooled.push_back(make_pair(value, 0));
+    }
+    for (double value : current) {
+        pooled.push_back(make_pair(value, 1));
+    }
+    sort(pooled.begin(), pooled.end());
+
+    double rankSum = 0;
+    for (size_t i = 0; i < pooled.size();) {
+        size_t j = i;
+        while (j < pooled.size() && pooled[j].first == pooled[i].first) {
+            j++;
+        }
+        double midRank = (i + 1 + j) / 2.0;
+        for (size_t k = i; k < j; k++) {
+            if (pooled[k].second == 1) {
+                rankSum += midRank;
+            }
+        }
+        i = j;
+    }
+
+    double n1 = current.size();
+    double n2 = baseline.size();
+    double u = rankSum - n1 * (n1 + 1) / 2;
+    double mean = n1 * n2 / 2;
+    double sd = sqrt(n1 * n2 * (n1 + n2 + 1) / 12);
+    if (sd == 0) {
+        return 1.0;
+    }
+    double z = (u - mean) / sd;
+    return 0.5 * erfc(z / sqrt(2.0));
+}
+
+// ============================================================================
+// Baseline files: "# compiler ..." header, then "name s1 s2 ..." per line,
+// one line per process run
+// ============================================================================
+
+typedef map<string, vector<double> > Samples;
+typedef map<string, vector<vector<double> > > RunSamples;   // per benchmark, per process
+
+static vector<double> pooled(const vector<vector<double> >& runs) {
+    vector<double> all;
+    for (const vector<double>& run : runs) {
+        all.insert(all.end(), run.begin(), run.end());
+    }
+    return all;
+}
+
+/**
+ * Relative spread of the per-process medians. Heap layout, ASLR and
+ * frequency scaling move a benchmark between processes of the same
+ * binary; a change smaller than this is not evidence of a regression,
+ * however many samples each process took.
+ */
+static double runSpread(const vector<vector<double> >& runs) {
+    if (runs.size() < 2) {
+        return 0;
+    }
+    vector<double> medians;
+    for (const vector<double>& run : runs) {
+        medians.push_back(median(run));
+    }
+    double middle = median(medians);
+    if (middle <= 0) {
+        return 0;
+    }
+    return (*max_element(medians.begin(), medians.end()) - *min_element(medians.begin(), medians.end())) / middle;
+}
+
+static bool writeBaseline(const string& path, const RunSamples& samples) {
+    ofstream out(path.c_str());
+    if (!out) {
+        return false;
+    }
+    out << "# compiler " << __VERSION__ << "\n";
+    for (RunSamples::const_iterator it = samples.begin(); it != samples.end(); ++it) {
+        for (const vector<double>& run : it->second) {
+            out << it->first;
+            for (double value : run) {
+                out << " " << value;
+            }
+            out << "\n";
+        }
+    }
+    return true;
+}
+
+// Adds one run per "name s1 s2 ..." line
+static void parseSampleLine(const string& line, RunSamples& samples) {
+    istringstream fields(line);
+    string name;
+    double value;
+    if (!(fields >> name)) {
+        return;
+    }
+    vector<double> run;
+    while (fields >> value) {
+        run.push_back(value);
+    }
+    if (!run.empty()) {
+        samples[name].push_back(run);
+    }
+}
+
+static bool readBaseline(const string& path, RunSamples& samples, string& compiler) {
+    ifstream in(path.c_str());
+    if (!in) {
+        return false;
+    }
+    string line;
+    while (getline(in, line)) {
+        if (line.compare(0, 11, "# compiler ") == 0) {
+            compiler = line.substr(11);
+            continue;
+        }
+        parseSampleLine(line, samples);
+    }
+    return true;
+}
+
+// ============================================================================
+// Driver
+// ============================================================================
+
+static Samples runCases(int samples, int warmup) {
+    vector<PerfCase*> cases;
+    cases.push_back(new SendFanoutCase());
+    cases.push_back(new ChurnCase());
+    cases.push_back(new NotifyCase());
+    cases.push_back(new HistoryIterationCase());
+
+    // Interleave cases so slow drift (thermal, other load) hits all of them alike
+    Samples results;
+    for (int round = 0; round < warmup + samples; round++) {
+        for (PerfCase* perfCase : cases) {
+            double ns = perfCase->sample();
+            if (round >= warmup) {
+                results[perfCase->name()].push_back(ns);
+            }
+        }
+    }
+
+    for (PerfCase* perfCase : cases) {
+        delete perfCase;
+    }
+    return results;
+}
+
+/**
+ * Run the cases in fresh processes (this binary with --emit), one after
+ * another, so the samples cover process-to-process variation
+ * @return false if a run could not be started or failed
+ */
+static bool collectRuns(const string& self, int runs, int samples, RunSamples& results) {
+    string command = "'" + self + "' --emit --samples " + to_string(samples);
+    for (int run = 0; run < runs; run++) {
+        FILE* child = popen(command.c_str(), "r");
+        if (!child) {
+            return false;
+        }
+        char* line = nullptr;
+        size_t capacity = 0;
+        while (getline(&line, &capacity, child) != -1) {
+            parseSampleLine(line, results);
+        }
+        free(line);
+        if (pclose(child) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void usage() {
+    fprintf(stderr, "usage: perf_main [--record FILE | --compare FILE | --train]"
+                    " [--runs N] [--samples N] [--threshold F] [--alpha P]\n");
+}
+
+int main(int argc, char** argv) {
+    string mode = "compare";
+    string path = "perf_baseline.txt";
+    int runs = 3;
+    int samples = 15;
+    double threshold = 0.10;
+    double alpha = 0.01;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if ((arg == "--record" || arg == "--compare") && hasValue) {
+            mode = arg.substr(2);
+            path = argv[++i];
+        } else if (arg == "--train" || arg == "--emit") {
+            mode = arg.substr(2);
+        } else if (arg == "--runs" && hasValue) {
+            runs = max(1, atoi(argv[++i]));
+        } else if (arg == "--samples" && hasValue) {
+            samples = max(3, atoi(argv[++i]));
+        } else if (arg == "--threshold" && hasValue) {
+            threshold = atof(argv[++i]);
+        } else if (arg == "--alpha" && hasValue) {
+            alpha = atof(argv[++i]);
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    if (mode == "train" || mode == "emit") {
+        cout.setstate(ios::badbit); // silence room/user chatter while timing
+        Samples current = runCases(mode == "train" ? 3 : samples, mode == "train" ? 0 : 2);
+        if (mode == "train") {
+            printf("training run complete\n");
+            return 0;
+        }
+        for (Samples::const_iterator it = current.begin(); it != current.end(); ++it) {
+            printf("%s", it->first.c_str());
+            for (double value : it->second) {
+                printf(" %g", value);
+            }
+            printf("\n");
+        }
+        return 0;
+    }
+
+    RunSamples baseline;
+    string baselineCompiler;
+    if (mode == "compare" && !readBaseline(path, baseline, baselineCompiler)) {
+        fprintf(stderr, "perf_main: no baseline at %s (create one with --record, or `make perf_baseline`)\n",
+                path.c_str());
+        return 2;
+    }
+
+    RunSamples current;
+    if (!collectRuns(argv[0], runs, samples, current)) {
+        fprintf(stderr, "perf_main: a benchmark run failed\n");
+        return 2;
+    }
+
+    if (mode == "record") {
+        if (!writeBaseline(path, current)) {
+            fprintf(stderr, "perf_main: cannot write %s\n", path.c_str());
+            return 2;
+        }
+        for (RunSamples::const_iterator it = current.begin(); it != current.end(); ++it) {
+            printf("  %-28s %12.1f ns/op (median of %d runs x %d, spread %.1f%%)\n", it->first.c_str(),
+                   median(pooled(it->second)), runs, samples, runSpread(it->second) * 100);
+        }
+        printf("baseline written to %s\n", path.c_str());
+        return 0;
+    }
+
+    if (baselineCompiler != __VERSION__) {
+        printf("warning: baseline was recorded with compiler %s\n", baselineCompiler.c_str());
+    }
+    printf("  %-28s %12s %12s %8s %8s %10s\n", "benchmark", "baseline", "current", "change", "floor", "p");
+
+    int regressions = 0;
+    for (RunSamples::const_iterator it = current.begin(); it != current.end(); ++it) {
+        vector<double> after = pooled(it->second);
+        RunSamples::const_iterator base = baseline.find(it->first);
+        if (base == baseline.end() || base->second.empty()) {
+            printf("  %-28s %12s %12.1f %8s %8s %10s  new\n", it->first.c_str(), "-",
+                   median(after), "-", "-", "-");
+            continue;
+        }
+        vector<double> before = pooled(base->second);
+        double change = median(after) / median(before) - 1;
+        // Both conditions: the slowdown is significant, and larger than
+        // what a fresh process of either build shows on its own
+        double noiseFloor = max(threshold, max(runSpread(base->second), runSpread(it->second)));
+        double p = slowerPValue(before, after);
+        bool regressed = change > noiseFloor && p < alpha;
+        regressions += regressed;
+        printf("  %-28s %12.1f %12.1f %+7.1f%% %7.1f%% %10.2g  %s\n", it->first.c_str(), median(before),
+               median(after), change * 100, noiseFloor * 100, p, regressed ? "REGRESSED" : "ok");
+    }
+
+    if (regressions) {
+        printf("%d benchmark(s) regressed beyond their noise floor (at least %.0f%%, p < %g)\n",
+               regressions, threshold * 100, alpha);
+        return 1;
+    }
+    printf("no regressions (noise floor at least %.0f%%, p < %g)\n", threshold * 100, alpha);
+    return 0;
+}
@@ -0,0 +1,138 @@
+/**
+ * @file PresenceChannel.cpp
+ * @brief Implementation of the coalesced presence channel
+ */
+
+#include "PresenceChannel.h"
+#include "Users.h"
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+
+PresenceChannel::PresenceChannel(int64_t tick)
+    : tickMs(tick), lastFlush(0), updates(0), coalesced(0)
+{
+}
+
+void PresenceChannel::set(Users* user, PresenceState state)
+{
+    updates++;
+    Slot& slot = slots[user];
+    if (slot.current == state)
+    {
+        coalesced++;
+        return;
+    }
+    if (slot.dirty)
+    {
+        // An undelivered change is overwritten: only the latest state matters
+        coalesced++;
+    }
+    else
+    {
+        slot.dirty = true;
+        dirtyUsers.push_back(user);
+    }
+    slot.current = state;
+}
+
+void PresenceChannel::setStatus(Users* user, PresenceState::Status status)
+{
+    set(user, PresenceState(status, getState(user).typing()));
+}
+
+void PresenceChannel::setTyping(Users* user, bool typing)
+{
+    set(user, PresenceState(getState(user).status(), typing));
+}
+
+PresenceState PresenceChannel::getState(Users* user) const
+{
+    unordered_map<Users*, Slot>::const_iterator it = slots.find(user);
+    return it == slots.end() ? PresenceState() : it->second.current;
+}
+
+void PresenceChannel::addListener(PresenceListener* listener)
+{
+    if (find(listeners.begin(), listeners.end(), listener) == listeners.end())
+    {
+        listeners.push_back(listener);
+    }
+}
+
+void PresenceChannel::removeListener(PresenceListener* listener)
+{
+    vector<PresenceListener*>::iterator it = find(listeners.begin(), listeners.end(), listener);
+    if (it != listeners.end())
+    {
+        listeners.erase(it);
+    }
+}
+
+void PresenceChannel::forget(Users* user)
+{
+    unordered_map<Users*, Slot>::iterator slot = slots.find(user);
+    if (slot == slots.end())
+    {
+        return;
+    }
+    // Listeners last saw it present; the user may be gone by the next tick,
+    // so the update carries its identity rather than the pointer
+    if (slot->second.delivered != PresenceState())
+    {
+        PresenceUpdate update = { user->getIdentity(), PresenceState() };
+        departures.push_back(update);
+    }
+    slots.erase(slot);
+    vector<Users*>::iterator it = find(dirtyUsers.begin(), dirtyUsers.end(), user);
+    if (it != dirtyUsers.end())
+    {
+        dirtyUsers.erase(it);
+    }
+}
+
+size_t PresenceChannel::tick(ChatRoom* room)
+{
+    int64_t now = chrono::duration_cast<chrono::milliseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+    return tick(room, now);
+}
+
+size_t PresenceChannel::tick(ChatRoom* room, int64_t nowMs)
+{
+    if ((dirtyUsers.empty() && departures.empty()) || nowMs - lastFlush < tickMs)
+    {
+        return 0;
+    }
+    lastFlush = nowMs;
+
+    diff.swap(departures);
+    departures.clear();
+    for (Users* user : dirtyUsers)
+    {
+        Slot& slot = slots[user];
+        slot.dirty = false;
+        // Changes that were undone within the tick are never sent
+        if (slot.current != slot.delivered)
+        {
+            slot.delivered = slot.current;
+            PresenceUpdate update = { user->getIdentity(), slot.current };
+            diff.push_back(update);
+        }
+        else
+        {
+            coalesced++;
+        }
+    }
+    dirtyUsers.clear();
+
+    if (!diff.empty())
+    {
+        for (PresenceListener* listener : listeners)
+        {
+            listener->presenceChanged(room, diff);
+        }
+    }
+    return diff.size();
+}
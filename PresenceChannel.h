@@ -0,0 +1,178 @@
+/**
+ * @file PresenceChannel.h
+ * @brief Coalesced, lossy channel for presence and typing indicators
+ */
+
+#ifndef PRESENCECHANNEL_H
+#define PRESENCECHANNEL_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "SenderIdentity.h"
+
+using namespace std;
+
+class ChatRoom;
+class Users;
+
+/**
+ * @struct PresenceState
+ * @brief Ephemeral state of one user, packed into a single byte
+ */
+struct PresenceState
+{
+    enum Status { OFFLINE = 0, ONLINE = 1, AWAY = 2 };
+
+    uint8_t bits; // status in bits 0-1, typing in bit 2
+
+    PresenceState() : bits(OFFLINE) {}
+    PresenceState(Status status, bool typing)
+        : bits(static_cast<uint8_t>(status | (typing ? 4 : 0))) {}
+
+    Status status() const { return static_cast<Status>(bits & 3); }
+    bool typing() const { return (bits & 4) != 0; }
+    bool operator==(const PresenceState& other) const { return bits == other.bits; }
+    bool operator!=(const PresenceState& other) const { return bits != other.bits; }
+};
+
+/**
+ * @struct PresenceUpdate
+ * @brief One entry of a presence diff
+ */
+struct PresenceUpdate
+{
+    SenderHandle user;      // getUser() is nullptr if the user was destroyed since
+    PresenceState state;
+};
+
+/**
+ * @class PresenceListener
+ * @brief Receives coalesced presence diffs from a room
+ */
+class PresenceListener
+{
+public:
+    virtual ~PresenceListener() {}
+
+    /**
+     * @brief Called once per tick with every user whose state changed
+     * @param room The room the diff belongs to
+     * @param changes Latest state of each changed user
+     */
+    virtual void presenceChanged(ChatRoom* room, const vector<PresenceUpdate>& changes) = 0;
+};
+
+/**
+ * @class PresenceChannel
+ * @brief Keeps the latest presence per user and flushes diffs on a tick
+ *
+ * Updates only overwrite a per-user slot; nothing is formatted, stored in
+ * chat history or appended to notifications. tick() sends listeners the
+ * users whose state differs from what was last delivered, so a burst of
+ * typing on/off inside one interval costs nothing downstream. A user
+ * who leaves after listeners saw it present is reported OFFLINE in the
+ * next diff.
+ */
+class PresenceChannel
+{
+public:
+    /**
+     * @brief Constructor
+     * @param tickMs Minimum time between flushes in milliseconds
+     */
+    explicit PresenceChannel(int64_t tickMs = 100);
+
+    /**
+     * @brief Set a user's online/away/offline status
+     * @param user The user
+     * @param status The new status
+     */
+    void setStatus(Users* user, PresenceState::Status status);
+
+    /**
+     * @brief Set whether a user is typing
+     * @param user The user
+     * @param typing true while the user is typing
+     */
+    void setTyping(Users* user, bool typing);
+
+    /**
+     * @brief Get a user's latest state (delivered or not)
+     * @param user The user
+     * @return The latest state, OFFLINE if unknown
+     */
+    PresenceState getState(Users* user) const;
+
+    /**
+     * @brief Subscribe to presence diffs
+     * @param listener The listener to add
+     */
+    void addListener(PresenceListener* listener);
+
+    /**
+     * @brief Unsubscribe from presence diffs
+     * @param listener The listener to remove
+     */
+    void removeListener(PresenceListener* listener);
+
+    /**
+     * @brief Drop all state for a user (on leaving the room)
+     * @param user The user
+     *
+     * If listeners were last told anything but OFFLINE, the next tick
+     * reports the user OFFLINE.
+     */
+    void forget(Users* user);
+
+    /**
+     * @brief Flush pending changes if the tick interval has elapsed
+     * @param room The room passed on to listeners
+     * @return Number of users in the delivered diff
+     */
+    size_t tick(ChatRoom* room);
+
+    /**
+     * @brief Flush pending changes if the tick interval has elapsed
+     * @param room The room passed on to listeners
+     * @param nowMs Current time in milliseconds
+     * @return Number of users in the delivered diff
+     */
+    size_t tick(ChatRoom* room, int64_t nowMs);
+
+    /**
+     * @brief Get the number of updates absorbed without being delivered
+     * @return Coalesced update count
+     */
+    uint64_t getCoalescedCount() const { return coalesced; }
+
+    /**
+     * @brief Get the number of state updates received
+     * @return Update count
+     */
+    uint64_t getUpdateCount() const { return updates; }
+
+private:
+    struct Slot
+    {
+        PresenceState current;
+        PresenceState delivered;
+        bool dirty;
+
+        Slot() : dirty(false) {}
+    };
+
+    void set(Users* user, PresenceState state);
+
+    int64_t tickMs;
+    int64_t lastFlush;
+    unordered_map<Users*, Slot> slots;
+    vector<Users*> dirtyUsers;
+    vector<PresenceUpdate> departures;  // OFFLINE for users forgotten since the last flush
+    vector<PresenceListener*> listeners;
+    vector<PresenceUpdate> diff; // reused between ticks
+    uint64_t updates;
+    uint64_t coalesced;
+};
+
+#endif
@@ -0,0 +1,10 @@
+//PublishMessageCommand.cpp
+#include "PublishMessageCommand.h"
+#include "ChatRoom.h"
+#include "Users.h"
+
+void PublishMessageCommand::execute()
+{
+    // One history write; no per-member work at send time (Command pattern)
+    room->publishMessage(message, fromUser);
+}
@@ -0,0 +1,23 @@
+//PublishMessageCommand.h
+#ifndef PUBLISHMESSAGECOMMAND_H
+#define PUBLISHMESSAGECOMMAND_H
+
+#include "Command.h"
+#include "ChatRoom.h"
+#include "Users.h"
+
+/**
+ * Fan-out-on-read send for large rooms: the message is written once to
+ * the room's history and members pull it with ChatRoom::deliverPending.
+ * Replaces the SendMessageCommand/LogMessageCommand pair.
+ */
+class PublishMessageCommand : public Command
+{
+public:
+    PublishMessageCommand(ChatRoom* chatRoom, string msg, Users* user, uint64_t id = 0)
+        : Command(chatRoom, msg, user, id) {}
+    
+    void execute() override;
+};
+
+#endif
@@ -0,0 +1,71 @@
+/**
+ * @file RecipientSet.h
+ * @brief Dedup bitmap over dense user IDs
+ */
+
+#ifndef RECIPIENTSET_H
+#define RECIPIENTSET_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @class RecipientSet
+ * @brief Set of dense user IDs, one bit each, cleared in O(inserted)
+ *
+ * Used to merge the member lists of several rooms so every user is
+ * visited once. The bitmap only grows; clear() resets just the words
+ * that were touched, so a set can be reused for every broadcast without
+ * paying for its full size.
+ */
+class RecipientSet
+{
+private:
+    vector<uint64_t> bits;
+    vector<uint32_t> inserted;
+
+public:
+    /**
+     * @brief Add an ID
+     * @param id Dense user ID (Users::getDenseId)
+     * @return true if the ID was not in the set yet
+     */
+    bool insert(uint32_t id) {
+        size_t word = id >> 6;
+        if (word >= bits.size()) {
+            bits.resize(word + 1 > 2 * bits.size() ? word + 1 : 2 * bits.size(), 0);
+        }
+        uint64_t mask = uint64_t(1) << (id & 63);
+        if (bits[word] & mask) {
+            return false;
+        }
+        bits[word] |= mask;
+        inserted.push_back(id);
+        return true;
+    }
+
+    /**
+     * @brief Get the number of distinct IDs inserted
+     * @return Set size
+     */
+    size_t size() const { return inserted.size(); }
+
+    /**
+     * @brief Empty the set
+     */
+    void clear() {
+        if (inserted.size() > bits.size()) {
+            memset(bits.data(), 0, bits.size() * sizeof(uint64_t));
+        } else {
+            for (uint32_t id : inserted) {
+                bits[id >> 6] = 0;
+            }
+        }
+        inserted.clear();
+    }
+};
+
+#endif
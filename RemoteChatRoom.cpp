@@ -0,0 +1,143 @@
+//RemoteChatRoom.cpp
+#include "RemoteChatRoom.h"
+#include "FederationHost.h"
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+RemoteChatRoom::RemoteChatRoom(FederationHost* federation, int workerIndex, uint32_t id, const string& name)
+    : ChatRoom(name), host(federation), worker(workerIndex), roomId(id), savesPosted(0), syncing(false)
+{
+}
+
+void RemoteChatRoom::defineUser(Users* user)
+{
+    // The worker only knows users by ID; send the display name once
+    if (definedUsers.insert(make_pair(FederationHost::userId(user), user->getIdentity())).second)
+    {
+        // Worker-side output is the only place it shows, so a cut name is enough
+        host->post(worker, FederationFrame::DEFINE_USER, roomId,
+                   FederationHost::userId(user), 0, user->getName().substr(0, host->maxTextBytes()));
+    }
+}
+
+void RemoteChatRoom::registerUser(Users *user)
+{
+    // Membership is mirrored here so lookups never cross processes
+    if (!isMember(user))
+    {
+        users.push_back(user);
+        indexMember(user);
+        user->addChatRoom(this);
+        defineUser(user);
+        host->post(worker, FederationFrame::REGISTER, roomId, FederationHost::userId(user), 0, "");
+        cout << "[" << roomName << " @worker " << worker << "]: " << user->getName() << " has joined the room!" << endl;
+
+        // Notify all subscribers that a new user joined (Observer pattern)
+        notify(user->getName() + " has joined " + roomName + "!", roomName);
+    }
+}
+
+void RemoteChatRoom::removeUser(Users *user)
+{
+    auto it = find(users.begin(), users.end(), user);
+    if (it != users.end())
+    {
+        cout << "[" << roomName << " @worker " << worker << "]: " << user->getName() << " has left the room." << endl;
+        users.erase(it);
+        unindexMember(user);
+        user->removeChatRoom(this);
+        host->post(worker, FederationFrame::REMOVE, roomId, FederationHost::userId(user), 0, "");
+
+        // Notify all subscribers that user left (Observer pattern)
+        notify(user->getName() + " has left " + roomName + "!", roomName);
+    }
+}
+
+void RemoteChatRoom::detachUser(Users *user)
+{
+    bool member = isMember(user);
+    ChatRoom::detachUser(user);
+    // Otherwise the worker keeps fanning out to it; frames already on their
+    // way back are dropped by knownUser()
+    if (member)
+    {
+        host->post(worker, FederationFrame::REMOVE, roomId, FederationHost::userId(user), 0, "");
+    }
+}
+
+FilterVerdict RemoteChatRoom::screenMessage(string& message, Users *fromUser)
+{
+    FilterVerdict verdict = ChatRoom::screenMessage(message, fromUser);
+    // Checked after the filters, which may have made it longer
+    if (verdict != FILTER_REJECT && message.size() > host->maxTextBytes())
+    {
+        return FILTER_REJECT;
+    }
+    return verdict;
+}
+
+void RemoteChatRoom::sendMessage(string message, Users *fromUser)
+{
+    // Fan-out runs in the worker; deliveries come back through FederationHost::pump
+    defineUser(fromUser);
+    host->post(worker, FederationFrame::SEND, roomId, FederationHost::userId(fromUser), 0, message);
+}
+
+void RemoteChatRoom::saveMessage(string message, Users *fromUser)
+{
+    defineUser(fromUser);
+    if (!host->post(worker, FederationFrame::SAVE, roomId, FederationHost::userId(fromUser), 0, message))
+    {
+        return; // too long; screenMessage() rejects it before it gets here
+    }
+    savesPosted++;
+    recordSaved(fromUser, message);
+}
+
+void RemoteChatRoom::saveMessage(string message, Users *fromUser, const MessageVisibility& visibility)
+{
+    size_t before = savesPosted;
+    saveMessage(message, fromUser);
+    // Saves reach the worker in posting order, so its history index is known here
+    if (visibility.scope != MessageVisibility::ROOM && savesPosted != before)
+    {
+        restrictedHistory[savesPosted - 1] = visibility;
+    }
+}
+
+void RemoteChatRoom::syncHistory()
+{
+    // A delivery handled while waiting may read this history again
+    if (syncing)
+    {
+        return;
+    }
+    syncing = true;
+    host->fetchHistory(this);
+    syncing = false;
+}
+
+void RemoteChatRoom::refreshHistory()
+{
+    // Every save reaches the worker's history, so a full mirror needs no round trip
+    if (chatHistory.size() < savesPosted)
+    {
+        syncHistory();
+    }
+}
+
+void RemoteChatRoom::mirrorHistoryEntry(uint64_t senderId, int64_t timestampUs, uint64_t sequence,
+                                        const string& message)
+{
+    // The identity outlives its user, so entries keep the sender's name
+    unordered_map<uint64_t, SenderHandle>::const_iterator found = definedUsers.find(senderId);
+    chatHistory.append(found != definedUsers.end() ? found->second : SenderHandle(), message, timestampUs, sequence);
+}
+
+Users* RemoteChatRoom::knownUser(uint64_t id) const
+{
+    unordered_map<uint64_t, SenderHandle>::const_iterator found = definedUsers.find(id);
+    return found != definedUsers.end() ? found->second->getUser() : nullptr;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file RemoteChatRoom.h
+ * @brief Proxy for a chat room hosted in a federation worker process
+ */
+
+#ifndef REMOTECHATROOM_H
+#define REMOTECHATROOM_H
+
+#include <unordered_map>
+#include "ChatRoom.h"
+
+class FederationHost;
+
+/**
+ * @class RemoteChatRoom
+ * @brief Forwards ChatRoom operations to a worker over shared memory
+ * Role: Proxy for a ConcreteMediator
+ *
+ * Membership is mirrored locally so getUsers(), isMember() and the
+ * Observer notifications keep working in this process. Fan-out and
+ * history writes happen in the worker; reading the history (getChatHistory(),
+ * historyCursor(), ...) first pulls in any saves the mirror has not seen,
+ * with the timestamps and sequence numbers the worker gave them.
+ */
+class RemoteChatRoom : public ChatRoom
+{
+public:
+    /**
+     * @brief Constructor (use FederationHost::createRoom)
+     * @param federation The host that owns the worker
+     * @param worker Index of the worker hosting the room
+     * @param id Room ID on the worker
+     * @param name The room type/name
+     */
+    RemoteChatRoom(FederationHost* federation, int worker, uint32_t id, const string& name);
+
+    void registerUser(Users* user) override;
+    void removeUser(Users* user) override;
+    void detachUser(Users* user) override;
+    void sendMessage(string message, Users* fromUser) override;
+    void saveMessage(string message, Users* fromUser) override;
+    void saveMessage(string message, Users* fromUser, const MessageVisibility& visibility) override;
+
+    using ChatRoom::sendMessage;
+
+    // Also rejects messages too long for one federation frame
+    FilterVerdict screenMessage(string& message, Users* fromUser) override;
+
+    // Members are reached through the worker, never by local receive() calls
+    bool fansOutLocally() const override { return false; }
+
+    /**
+     * @brief Pull history entries saved in the worker since the last sync
+     *
+     * History reads call this when saves are outstanding; calling it
+     * directly is only needed to force a round trip.
+     */
+    void syncHistory();
+
+    /**
+     * @brief Append an entry fetched from the worker (used by FederationHost)
+     * @param senderId The sender's wire ID
+     * @param timestampUs When the worker saved it
+     * @param sequence The worker's sequence number for it
+     * @param message The raw message
+     */
+    void mirrorHistoryEntry(uint64_t senderId, int64_t timestampUs, uint64_t sequence, const string& message);
+
+    /**
+     * @brief Get the number of entries mirrored so far (used by FederationHost)
+     * @return Entry count, without syncing
+     */
+    size_t mirroredEntries() const { return chatHistory.size(); }
+
+    /**
+     * @brief Resolve a wire ID from a worker frame (used by FederationHost)
+     * @param id The user's wire ID
+     * @return The user, or nullptr if it was destroyed or never seen here
+     */
+    Users* knownUser(uint64_t id) const;
+
+    int getWorker() const { return worker; }
+    uint32_t getRoomId() const { return roomId; }
+
+protected:
+    void refreshHistory() override;
+
+private:
+    void defineUser(Users* user);
+
+    FederationHost* host;
+    int worker;
+    uint32_t roomId;
+    size_t savesPosted;
+    bool syncing;
+    unordered_map<uint64_t, SenderHandle> definedUsers;   // by wire ID; kept after a user is destroyed
+};
+
+#endif
@@ -0,0 +1,188 @@
+/**
+ * @file ReplayMain.cpp
+ * @brief Record/playback driver for PetSpace operation traces
+ *
+ * Replays a trace written by TraceRecorder against the current build,
+ * for profiling and for comparing optimizations on the same workload.
+ * --synthesize records a trace from a generated workload, for trying
+ * the tool without production traffic.
+ *
+ *   replay_main --play <file> [--threads N] [--original-timing] [--speed X] [--verbose]
+ *   replay_main --synthesize <file> [--ops N]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "ChatRoom.h"
+#include "CtrlCat.h"
+#include "Dogorithm.h"
+#include "TracePlayer.h"
+#include "TraceRecorder.h"
+#include "Users.h"
+
+using namespace std;
+
+// A few rooms of mixed size, members joining and leaving, bursts of chat
+static bool synthesize(const string& path, size_t operations)
+{
+    TraceRecorder recorder(path);
+    if (!recorder.isOpen())
+    {
+        return false;
+    }
+    vector<ChatRoom*> rooms;
+    for (int i = 0; i < 8; i++)
+    {
+        rooms.push_back(i % 2 ? static_cast<ChatRoom*>(new Dogorithm()) : new CtrlCat());
+        rooms.back()->setTraceRecorder(&recorder);
+    }
+    vector<Users*> people;
+    for (int i = 0; i < 400; i++)
+    {
+        people.push_back(new Users("User" + to_string(i)));
+    }
+
+    size_t seed = 42;
+    while (recorder.getRecordCount() < operations)
+    {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        ChatRoom* room = rooms[(seed >> 60) % rooms.size()];
+        Users* user = people[(seed >> 33) % people.size()];
+        int dice = static_cast<int>((seed >> 20) % 100);
+        if (!room->isMember(user) || dice < 2)
+        {
+            if (room->isMember(user))
+            {
+                room->removeUser(user);
+            }
+            else
+            {
+                room->registerUser(user);
+                if (dice < 30)
+                {
+                    room->subscribe(user);
+                }
+            }
+        }
+        else if (dice < 3)
+        {
+            room->notify("Scheduled maintenance tonight", room->getRoomName());
+        }
+        else
+        {
+            user->send(dice < 90 ? "hi all" : "a somewhat longer message about the weekend adoption event", room);
+        }
+    }
+
+    for (ChatRoom* room : rooms)
+    {
+        delete room;
+    }
+    for (Users* user : people)
+    {
+        delete user;
+    }
+    return true;
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: replay_main --play FILE [--threads N] [--original-timing] [--speed X] [--verbose]\n"
+                    "       replay_main --synthesize FILE [--ops N]\n");
+}
+
+int main(int argc, char** argv)
+{
+    string mode;
+    string path;
+    PlaybackOptions options;
+    size_t operations = 200000;
+    bool verbose = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if ((arg == "--play" || arg == "--synthesize") && hasValue)
+        {
+            mode = arg.substr(2);
+            path = argv[++i];
+        }
+        else if (arg == "--threads" && hasValue)
+        {
+            options.threads = max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--original-timing")
+        {
+            options.originalTiming = true;
+        }
+        else if (arg == "--speed" && hasValue)
+        {
+            options.speed = atof(argv[++i]);
+        }
+        else if (arg == "--ops" && hasValue)
+        {
+            operations = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--verbose")
+        {
+            verbose = true;
+        }
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+
+    if (mode == "synthesize")
+    {
+        cout.setstate(ios::badbit);
+        bool ok = synthesize(path, operations);
+        cout.clear();
+        if (!ok)
+        {
+            fprintf(stderr, "replay_main: cannot write %s\n", path.c_str());
+            return 2;
+        }
+        printf("recorded %zu operations to %s\n", operations, path.c_str());
+        return 0;
+    }
+    if (mode != "play")
+    {
+        usage();
+        return 2;
+    }
+
+    TracePlayer player;
+    if (!player.load(path))
+    {
+        fprintf(stderr, "replay_main: %s is not a readable trace\n", path.c_str());
+        return 2;
+    }
+    size_t sends = player.count(TraceOp::SEND) + player.count(TraceOp::SEND_TARGETED) +
+                   player.count(TraceOp::BROADCAST);
+    printf("trace: %zu operations (%zu sends), %zu rooms, %zu users, %.3f s recorded\n",
+           player.getOperations().size(), sends, player.roomCount(), player.userCount(), player.durationUs() / 1e6);
+
+    if (!verbose)
+    {
+        cout.setstate(ios::badbit); // room/user chatter would dominate the timing
+    }
+    PlaybackStats stats = player.play(options);
+    cout.clear();
+
+    printf("replayed %llu operations on %d thread(s) in %.3f s: %.0f ops/s\n",
+           static_cast<unsigned long long>(stats.operations), options.threads, stats.elapsedSeconds,
+           stats.operationsPerSecond());
+    printf("  %llu messages saved, %llu members at the end\n",
+           static_cast<unsigned long long>(stats.messagesSaved), static_cast<unsigned long long>(stats.finalMembers));
+    if (options.originalTiming)
+    {
+        printf("  original timing x%.2f, worst lag behind schedule %.0f us\n", options.speed, stats.maxLagUs);
+    }
+    return 0;
+}
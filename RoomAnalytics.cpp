@@ -0,0 +1,352 @@
+/**
+ * @file RoomAnalytics.cpp
+ * @brief Streaming sketches behind RoomAnalytics
+ */
+
+#include "RoomAnalytics.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+
+// splitmix64 finaliser: spreads sequential ids over the whole word
+inline uint64_t mixBits(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+// t-digest k1 scale: centroids near the tails stay small
+inline double scale(double q)
+{
+    return RoomAnalytics::DIGEST_COMPRESSION / (2 * PI) * asin(2 * q - 1);
+}
+
+inline double inverseScale(double k)
+{
+    return (sin(k * 2 * PI / RoomAnalytics::DIGEST_COMPRESSION) + 1) / 2;
+}
+
+} // namespace
+
+RoomAnalytics::RoomAnalytics()
+    : messages(0), joins(0), leaves(0), notifications(0), topSequence(0), topUsed(0),
+      buffered(0), digest(make_shared<Digest>())
+{
+    for (int i = 0; i < RATE_WINDOW; i++)
+    {
+        rateSecond[i].store(-1, memory_order_relaxed);
+        rateCount[i].store(0, memory_order_relaxed);
+    }
+    for (int i = 0; i < TOP_K; i++)
+    {
+        topSender[i].store(0, memory_order_relaxed);
+        topCount[i].store(0, memory_order_relaxed);
+        topError[i].store(0, memory_order_relaxed);
+    }
+    for (int i = 0; i < (1 << HLL_BITS); i++)
+    {
+        registers[i].store(0, memory_order_relaxed);
+    }
+}
+
+int64_t RoomAnalytics::nowNs()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void RoomAnalytics::recordMessage(const SenderHandle& sender, size_t bytes)
+{
+    recordMessage(sender, bytes, nowNs());
+}
+
+void RoomAnalytics::recordMessage(const SenderHandle& sender, size_t bytes, int64_t now)
+{
+    messages.fetch_add(1, memory_order_relaxed);
+
+    // Rate: the first message of a new second takes over its ring slot
+    int64_t second = now / 1000000000;
+    int slot = static_cast<int>(second % RATE_WINDOW);
+    if (rateSecond[slot].load(memory_order_relaxed) != second)
+    {
+        rateCount[slot].store(0, memory_order_relaxed);
+        rateSecond[slot].store(second, memory_order_relaxed);
+    }
+    rateCount[slot].fetch_add(1, memory_order_relaxed);
+
+    countSender(sender);
+
+    // HyperLogLog: register = top HLL_BITS of the hash, rank = leading zeros of the rest + 1
+    uint64_t hash = mixBits(sender->getId());
+    uint64_t rest = (hash << HLL_BITS) | (uint64_t(1) << (HLL_BITS - 1));
+    uint8_t rank = 1;
+    while (!(rest & 0x8000000000000000ull))
+    {
+        rest <<= 1;
+        rank++;
+    }
+    atomic<uint8_t>& reg = registers[hash >> (64 - HLL_BITS)];
+    if (reg.load(memory_order_relaxed) < rank)
+    {
+        reg.store(rank, memory_order_relaxed);
+    }
+
+    sizeBuffer[buffered++] = static_cast<double>(bytes);
+    if (buffered == DIGEST_BUFFER)
+    {
+        flush();
+    }
+}
+
+void RoomAnalytics::countSender(const SenderHandle& sender)
+{
+    // Space-Saving: bump the sender's counter, or take over the smallest one.
+    // TOP_K is a small constant, so the scans are a fixed cost
+    uint64_t id = sender->getId();
+    int found = -1;
+    int smallest = 0;
+    for (int i = 0; i < topUsed; i++)
+    {
+        if (topSender[i].load(memory_order_relaxed) == id)
+        {
+            found = i;
+            break;
+        }
+        if (topCount[i].load(memory_order_relaxed) < topCount[smallest].load(memory_order_relaxed))
+        {
+            smallest = i;
+        }
+    }
+
+    uint32_t sequence = topSequence.load(memory_order_relaxed);
+    topSequence.store(sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    if (found >= 0)
+    {
+        topCount[found].store(topCount[found].load(memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+    else if (topUsed < TOP_K)
+    {
+        // Handles change only when a sender enters the list, never on a bump
+        topSender[topUsed].store(id, memory_order_relaxed);
+        atomic_store(&topHandle[topUsed], sender);
+        topCount[topUsed].store(1, memory_order_relaxed);
+        topError[topUsed].store(0, memory_order_relaxed);
+        topUsed++;
+    }
+    else
+    {
+        uint64_t floor = topCount[smallest].load(memory_order_relaxed);
+        topSender[smallest].store(id, memory_order_relaxed);
+        atomic_store(&topHandle[smallest], sender);
+        topCount[smallest].store(floor + 1, memory_order_relaxed);
+        topError[smallest].store(floor, memory_order_relaxed);
+    }
+    topSequence.store(sequence + 2, memory_order_release);
+}
+
+void RoomAnalytics::flush()
+{
+    if (buffered == 0)
+    {
+        return;
+    }
+    shared_ptr<const Digest> previous = currentDigest();
+
+    // The published centroids are already sorted: sort the buffer, then merge
+    sort(sizeBuffer, sizeBuffer + buffered);
+    vector<Centroid> points;
+    points.reserve(previous->centroids.size() + buffered);
+    vector<Centroid>::const_iterator old = previous->centroids.begin();
+    for (size_t i = 0; i < buffered; i++)
+    {
+        for (; old != previous->centroids.end() && old->mean < sizeBuffer[i]; ++old)
+        {
+            points.push_back(*old);
+        }
+        Centroid point = { sizeBuffer[i], 1 };
+        points.push_back(point);
+    }
+    points.insert(points.end(), old, previous->centroids.end());
+
+    double total = previous->total + buffered;
+    double low = previous->total > 0 ? min(previous->min, sizeBuffer[0]) : sizeBuffer[0];
+    double high = previous->total > 0 ? max(previous->max, sizeBuffer[buffered - 1]) : sizeBuffer[buffered - 1];
+    buffered = 0;
+
+    // Merge neighbours while the combined centroid stays within one unit of k
+    shared_ptr<Digest> merged = make_shared<Digest>();
+    merged->centroids.reserve(DIGEST_COMPRESSION);
+    merged->total = total;
+    merged->min = low;
+    merged->max = high;
+    Centroid current = points[0];
+    double before = 0;
+    double limit = total * inverseScale(scale(0) + 1);
+    for (size_t i = 1; i < points.size(); i++)
+    {
+        if (before + current.weight + points[i].weight <= limit)
+        {
+            current.mean += (points[i].mean - current.mean) * points[i].weight / (current.weight + points[i].weight);
+            current.weight += points[i].weight;
+        }
+        else
+        {
+            before += current.weight;
+            merged->centroids.push_back(current);
+            limit = total * inverseScale(scale(before / total) + 1);
+            current = points[i];
+        }
+    }
+    merged->centroids.push_back(current);
+
+    atomic_store(&digest, shared_ptr<const Digest>(merged));
+}
+
+shared_ptr<const RoomAnalytics::Digest> RoomAnalytics::currentDigest() const
+{
+    return atomic_load(&digest);
+}
+
+double RoomAnalytics::messageRate(int windowSeconds) const
+{
+    return messageRate(windowSeconds, nowNs());
+}
+
+double RoomAnalytics::messageRate(int windowSeconds, int64_t now) const
+{
+    if (windowSeconds <= 0)
+    {
+        return 0;
+    }
+    windowSeconds = min(windowSeconds, static_cast<int>(RATE_WINDOW));
+    int64_t second = now / 1000000000;
+    uint64_t count = 0;
+    for (int i = 0; i < RATE_WINDOW; i++)
+    {
+        int64_t slotSecond = rateSecond[i].load(memory_order_relaxed);
+        if (slotSecond > second - windowSeconds && slotSecond <= second)
+        {
+            count += rateCount[i].load(memory_order_relaxed);
+        }
+    }
+    return static_cast<double>(count) / windowSeconds;
+}
+
+double RoomAnalytics::distinctSenders() const
+{
+    const double m = 1 << HLL_BITS;
+    double sum = 0;
+    int zeros = 0;
+    for (int i = 0; i < (1 << HLL_BITS); i++)
+    {
+        uint8_t reg = registers[i].load(memory_order_relaxed);
+        sum += ldexp(1.0, -reg);
+        zeros += reg == 0;
+    }
+    double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    // Small cardinalities: linear counting on the empty registers is more accurate
+    if (estimate <= 2.5 * m && zeros > 0)
+    {
+        estimate = m * log(m / zeros);
+    }
+    return estimate;
+}
+
+vector<SenderCount> RoomAnalytics::topSenders() const
+{
+    vector<SenderCount> top;
+    for (;;)
+    {
+        top.clear();
+        uint32_t before = topSequence.load(memory_order_acquire);
+        if (before & 1)
+        {
+            continue;
+        }
+        for (int i = 0; i < TOP_K; i++)
+        {
+            uint64_t id = topSender[i].load(memory_order_relaxed);
+            if (id == 0)
+            {
+                continue;
+            }
+            SenderCount entry = { atomic_load(&topHandle[i]), topCount[i].load(memory_order_relaxed),
+                                  topError[i].load(memory_order_relaxed) };
+            // A handle stored after the id was read fails this check or the sequence one
+            if (entry.sender && entry.sender->getId() == id)
+            {
+                top.push_back(entry);
+            }
+        }
+        atomic_thread_fence(memory_order_acquire);
+        if (topSequence.load(memory_order_relaxed) == before)
+        {
+            break;
+        }
+    }
+    sort(top.begin(), top.end(), [](const SenderCount& a, const SenderCount& b) { return a.count > b.count; });
+    return top;
+}
+
+double RoomAnalytics::sizeQuantile(double q) const
+{
+    shared_ptr<const Digest> snapshot = currentDigest();
+    const vector<Centroid>& c = snapshot->centroids;
+    if (c.empty())
+    {
+        return 0;
+    }
+    q = min(max(q, 0.0), 1.0);
+    double target = q * snapshot->total;
+
+    // Each centroid's weight is centred on its mean; interpolate between centres,
+    // and between the extreme centres and the observed min/max
+    if (target < c[0].weight / 2)
+    {
+        return snapshot->min + (c[0].mean - snapshot->min) * target / (c[0].weight / 2);
+    }
+    double cumulative = c[0].weight / 2;
+    for (size_t i = 0; i + 1 < c.size(); i++)
+    {
+        double gap = (c[i].weight + c[i + 1].weight) / 2;
+        if (cumulative + gap > target)
+        {
+            return c[i].mean + (c[i + 1].mean - c[i].mean) * (target - cumulative) / gap;
+        }
+        cumulative += gap;
+    }
+    const Centroid& last = c.back();
+    double tail = min(1.0, (target - cumulative) / (last.weight / 2));
+    return last.mean + (snapshot->max - last.mean) * tail;
+}
+
+AnalyticsSnapshot RoomAnalytics::getSnapshot() const
+{
+    AnalyticsSnapshot snapshot;
+    snapshot.messages = messages.load(memory_order_relaxed);
+    snapshot.joins = joins.load(memory_order_relaxed);
+    snapshot.leaves = leaves.load(memory_order_relaxed);
+    snapshot.notifications = notifications.load(memory_order_relaxed);
+    snapshot.messagesPerSecond = messageRate();
+    snapshot.distinctSenders = distinctSenders();
+    snapshot.topSenders = topSenders();
+    snapshot.sizeP50 = sizeQuantile(0.5);
+    snapshot.sizeP90 = sizeQuantile(0.9);
+    snapshot.sizeP99 = sizeQuantile(0.99);
+    return snapshot;
+}
+
+size_t RoomAnalytics::memoryBytes() const
+{
+    return sizeof(*this) + sizeof(Digest) + currentDigest()->centroids.capacity() * sizeof(Centroid);
+}
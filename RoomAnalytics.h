@@ -0,0 +1,207 @@
+/**
+ * @file RoomAnalytics.h
+ * @brief Fixed-size streaming statistics for one chat room
+ */
+
+#ifndef ROOMANALYTICS_H
+#define ROOMANALYTICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "SenderIdentity.h"
+
+using namespace std;
+
+/**
+ * @struct SenderCount
+ * @brief One entry of the top-senders list
+ */
+struct SenderCount
+{
+    SenderHandle sender;    // still names the sender after it is destroyed
+    uint64_t count;     // upper bound on the sender's messages
+    uint64_t error;     // count - error is a lower bound
+};
+
+/**
+ * @struct AnalyticsSnapshot
+ * @brief A room's statistics at one moment
+ */
+struct AnalyticsSnapshot
+{
+    uint64_t messages;
+    uint64_t joins;
+    uint64_t leaves;
+    uint64_t notifications;
+    double messagesPerSecond;       // over the last RATE_WINDOW seconds
+    double distinctSenders;         // estimate
+    vector<SenderCount> topSenders; // most active first
+    double sizeP50;
+    double sizeP90;
+    double sizeP99;
+};
+
+/**
+ * @class RoomAnalytics
+ * @brief Message rate, top senders, distinct senders and size quantiles
+ *
+ * Every statistic is a streaming sketch with memory fixed at construction
+ * and constant work per event, so a busy room pays the same per message
+ * whether it has ten members or a million:
+ * - rate: per-second counters in a ring covering the last RATE_WINDOW seconds
+ * - top senders: Space-Saving with TOP_K counters (counts are upper bounds,
+ *   exact for any sender that never left the list)
+ * - distinct senders: HyperLogLog with 2^HLL_BITS registers (~1.6% error)
+ * - message sizes: a merging t-digest; samples are buffered and merged
+ *   every DIGEST_BUFFER messages
+ *
+ * The room's thread records events; any thread may query at any time
+ * without blocking it. Counters and registers are atomics, the top-K
+ * list is read under a sequence lock (readers retry, the writer never
+ * waits), and each t-digest merge is published as an immutable snapshot,
+ * so quantiles trail by at most DIGEST_BUFFER messages.
+ *
+ * Senders are counted by SenderIdentity id, so a user created at a
+ * destroyed one's address is a new sender. The top-K list keeps each
+ * sender's handle, which stays valid after the user is gone.
+ */
+class RoomAnalytics
+{
+public:
+    static const int RATE_WINDOW = 60;
+    static const int TOP_K = 16;
+    static const int HLL_BITS = 12;
+    static const size_t DIGEST_BUFFER = 256;
+    static const int DIGEST_COMPRESSION = 100;
+
+    RoomAnalytics();
+
+    /**
+     * @brief Record a saved message (writer thread)
+     * @param sender The sender's identity
+     * @param bytes Message size
+     */
+    void recordMessage(const SenderHandle& sender, size_t bytes);
+
+    /**
+     * @brief Record a saved message at a given time (writer thread)
+     * @param sender The sender's identity
+     * @param bytes Message size
+     * @param nowNs Steady-clock time in nanoseconds
+     */
+    void recordMessage(const SenderHandle& sender, size_t bytes, int64_t nowNs);
+
+    void recordJoin() { joins.fetch_add(1, memory_order_relaxed); }
+    void recordLeave() { leaves.fetch_add(1, memory_order_relaxed); }
+    void recordNotification() { notifications.fetch_add(1, memory_order_relaxed); }
+
+    /**
+     * @brief Merge buffered sizes into the published digest now (writer thread)
+     */
+    void flush();
+
+    /**
+     * @brief Get the message rate
+     * @param windowSeconds Seconds to average over (at most RATE_WINDOW)
+     * @return Messages per second over the last windowSeconds
+     */
+    double messageRate(int windowSeconds = RATE_WINDOW) const;
+
+    /**
+     * @brief Get the message rate as of a given time
+     * @param windowSeconds Seconds to average over (at most RATE_WINDOW)
+     * @param nowNs Steady-clock time in nanoseconds
+     * @return Messages per second over the windowSeconds before nowNs
+     */
+    double messageRate(int windowSeconds, int64_t nowNs) const;
+
+    /**
+     * @brief Estimate the number of distinct users who sent a message
+     * @return HyperLogLog estimate
+     */
+    double distinctSenders() const;
+
+    /**
+     * @brief Get the most active senders
+     * @return Up to TOP_K entries, highest count first
+     */
+    vector<SenderCount> topSenders() const;
+
+    /**
+     * @brief Estimate a message-size quantile
+     * @param q Quantile in [0, 1]
+     * @return Size in bytes (0 before the first merge)
+     */
+    double sizeQuantile(double q) const;
+
+    /**
+     * @brief Get the total number of messages recorded
+     * @return Message count
+     */
+    uint64_t messageCount() const { return messages.load(memory_order_relaxed); }
+
+    /**
+     * @brief Collect every statistic
+     * @return Snapshot
+     */
+    AnalyticsSnapshot getSnapshot() const;
+
+    /**
+     * @brief Get the bytes held by the sketches
+     * @return Fixed footprint plus the current digest
+     */
+    size_t memoryBytes() const;
+
+    /**
+     * @brief Current steady-clock time in nanoseconds
+     */
+    static int64_t nowNs();
+
+private:
+    struct Centroid
+    {
+        double mean;
+        double weight;
+    };
+
+    struct Digest
+    {
+        vector<Centroid> centroids;
+        double total;
+        double min;
+        double max;
+    };
+
+    RoomAnalytics(const RoomAnalytics&);
+    RoomAnalytics& operator=(const RoomAnalytics&);
+
+    void countSender(const SenderHandle& sender);
+    shared_ptr<const Digest> currentDigest() const;
+
+    atomic<uint64_t> messages;
+    atomic<uint64_t> joins;
+    atomic<uint64_t> leaves;
+    atomic<uint64_t> notifications;
+
+    // Rate: count of the second stored alongside it, reused every RATE_WINDOW seconds
+    atomic<int64_t> rateSecond[RATE_WINDOW];
+    atomic<uint64_t> rateCount[RATE_WINDOW];
+
+    // Space-Saving counters, guarded by topSequence (odd while being written)
+    atomic<uint32_t> topSequence;
+    atomic<uint64_t> topSender[TOP_K];     // identity id, 0 if unused
+    SenderHandle topHandle[TOP_K];          // accessed through atomic_load/atomic_store
+    atomic<uint64_t> topCount[TOP_K];
+    atomic<uint64_t> topError[TOP_K];
+    int topUsed; // writer only
+
+    atomic<uint8_t> registers[1 << HLL_BITS];
+
+    double sizeBuffer[DIGEST_BUFFER];       // writer only
+    size_t buffered;
+    shared_ptr<const Digest> digest;        // accessed through atomic_load/atomic_store
+};
+
+#endif
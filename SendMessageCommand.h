@@ -9,8 +9,8 @@
 class SendMessageCommand : public Command
 {
 public:
-    SendMessageCommand(ChatRoom* chatRoom, string msg, Users* user)
-        : Command(chatRoom, msg, user) {}
+    SendMessageCommand(ChatRoom* chatRoom, string msg, Users* user, uint64_t id = 0)
+        : Command(chatRoom, msg, user, id) {}
     
     void execute() override;
 };
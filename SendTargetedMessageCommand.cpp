@@ -0,0 +1,10 @@
+//SendTargetedMessageCommand.cpp
+#include "SendTargetedMessageCommand.h"
+#include "ChatRoom.h"
+#include "Users.h"
+
+void SendTargetedMessageCommand::execute()
+{
+    // Deliver only to the resolved audience, not the whole room (Command pattern)
+    room->sendMessage(message, fromUser, visibility);
+}
@@ -0,0 +1,28 @@
+//SendTargetedMessageCommand.h
+#ifndef SENDTARGETEDMESSAGECOMMAND_H
+#define SENDTARGETEDMESSAGECOMMAND_H
+
+#include "Command.h"
+#include "ChatRoom.h"
+#include "Users.h"
+#include "MessageVisibility.h"
+
+class SendTargetedMessageCommand : public Command
+{
+private:
+    MessageVisibility visibility;
+
+public:
+    SendTargetedMessageCommand(ChatRoom* chatRoom, string msg, Users* user, const MessageVisibility& audience)
+        : Command(chatRoom, msg, user), visibility(audience) {}
+    
+    void execute() override;
+    
+    // Drop the sender's commands; a destroyed recipient is just left out
+    bool forgetUser(const Users* user) override {
+        visibility.forget(user);
+        return Command::forgetUser(user);
+    }
+};
+
+#endif
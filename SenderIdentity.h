@@ -0,0 +1,82 @@
+/**
+ * @file SenderIdentity.h
+ * @brief Who sent a history entry, valid after the user is destroyed
+ */
+
+#ifndef SENDERIDENTITY_H
+#define SENDERIDENTITY_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+using namespace std;
+
+class Users;
+
+/**
+ * @class SenderIdentity
+ * @brief Shared between a user and every history it wrote to
+ *
+ * The user renames it with setName() and retires it in its destructor.
+ * Histories keep it alive, so an entry still knows its sender's last
+ * name; getUser() is only a live handle and returns nullptr once the
+ * user is gone. getId() is unique for the life of the process (addresses
+ * are reused), so it can name a user outside it, e.g. on federation rings.
+ */
+class SenderIdentity
+{
+public:
+    SenderIdentity(Users* user, const string& userName) : id(nextId()), live(user), name(userName) {}
+
+    /**
+     * @brief Get the ID, never reused by another user
+     * @return ID (never 0)
+     */
+    uint64_t getId() const { return id; }
+
+    /**
+     * @brief Get the user, if it still exists
+     * @return The user, or nullptr after it was destroyed
+     */
+    Users* getUser() const { return live.load(memory_order_acquire); }
+
+    /**
+     * @brief Get the current name (the last one once the user is gone)
+     * @return Display name
+     */
+    string getName() const {
+        lock_guard<mutex> hold(lock);
+        return name;
+    }
+
+    void rename(const string& userName) {
+        lock_guard<mutex> hold(lock);
+        name = userName;
+    }
+
+    /**
+     * @brief Detach the live handle (called by ~Users)
+     */
+    void retire() { live.store(nullptr, memory_order_release); }
+
+private:
+    SenderIdentity(const SenderIdentity&);
+    SenderIdentity& operator=(const SenderIdentity&);
+
+    static uint64_t nextId() {
+        static atomic<uint64_t> counter(1);
+        return counter.fetch_add(1, memory_order_relaxed);
+    }
+
+    const uint64_t id;
+    atomic<Users*> live;
+    mutable mutex lock;
+    string name;
+};
+
+typedef shared_ptr<SenderIdentity> SenderHandle;
+
+#endif
@@ -0,0 +1,101 @@
+/**
+ * @file ShmRing.cpp
+ * @brief Implementation of the shared-memory frame ring
+ */
+
+#include "ShmRing.h"
+#include <cstring>
+#include <new>
+#include <sys/mman.h>
+
+using namespace std;
+
+static size_t align8(size_t n)
+{
+    return (n + 7) & ~static_cast<size_t>(7);
+}
+
+ShmRing* ShmRing::create(size_t capacityBytes)
+{
+    size_t capacity = 4096;
+    while (capacity < capacityBytes)
+    {
+        capacity <<= 1;
+    }
+    size_t bytes = sizeof(Control) + capacity;
+    void* mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+        return nullptr;
+    }
+    return new ShmRing(mapping, bytes, capacity);
+}
+
+ShmRing::ShmRing(void* map, size_t mapBytes, size_t capacityBytes)
+    : mapping(map), mappingBytes(mapBytes), mask(capacityBytes - 1)
+{
+    control = new (mapping) Control();
+    control->head.store(0, memory_order_relaxed);
+    control->tail.store(0, memory_order_relaxed);
+    data = static_cast<char*>(mapping) + sizeof(Control);
+}
+
+ShmRing::~ShmRing()
+{
+    munmap(mapping, mappingBytes);
+}
+
+bool ShmRing::tryPush(const void* header, size_t headerLen, const void* body, size_t bodyLen)
+{
+    uint32_t length = static_cast<uint32_t>(headerLen + bodyLen);
+    size_t frame = align8(sizeof(uint32_t) + length);
+    uint64_t tail = control->tail.load(memory_order_relaxed);
+    uint64_t head = control->head.load(memory_order_acquire);
+
+    // Frames never straddle the end of the buffer: skip to the start instead
+    size_t offset = static_cast<size_t>(tail) & mask;
+    size_t skip = (offset + frame > capacity()) ? capacity() - offset : 0;
+    if (frame + skip > capacity() - static_cast<size_t>(tail - head))
+    {
+        return false;
+    }
+    if (skip)
+    {
+        memcpy(data + offset, &WRAP, sizeof(uint32_t));
+        tail += skip;
+        offset = 0;
+    }
+
+    memcpy(data + offset, &length, sizeof(uint32_t));
+    memcpy(data + offset + sizeof(uint32_t), header, headerLen);
+    if (bodyLen)
+    {
+        memcpy(data + offset + sizeof(uint32_t) + headerLen, body, bodyLen);
+    }
+    control->tail.store(tail + frame, memory_order_release);
+    return true;
+}
+
+bool ShmRing::tryPop(vector<char>& out)
+{
+    uint64_t head = control->head.load(memory_order_relaxed);
+    uint64_t tail = control->tail.load(memory_order_acquire);
+    if (head == tail)
+    {
+        return false;
+    }
+
+    size_t offset = static_cast<size_t>(head) & mask;
+    uint32_t length;
+    memcpy(&length, data + offset, sizeof(uint32_t));
+    if (length == WRAP)
+    {
+        head += capacity() - offset;
+        offset = 0;
+        memcpy(&length, data, sizeof(uint32_t));
+    }
+
+    out.assign(data + offset + sizeof(uint32_t), data + offset + sizeof(uint32_t) + length);
+    control->head.store(head + align8(sizeof(uint32_t) + length), memory_order_release);
+    return true;
+}
@@ -0,0 +1,90 @@
+/**
+ * @file ShmRing.h
+ * @brief Lock-free single-producer/single-consumer ring in shared memory
+ */
+
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @class ShmRing
+ * @brief Byte ring carrying variable-length frames between two processes
+ *
+ * The ring lives in an anonymous MAP_SHARED mapping, so it must be
+ * created before fork() and is then visible to both parent and child.
+ * Exactly one process pushes and one process pops. head/tail are
+ * monotonically increasing byte counters on separate cache lines; the
+ * producer publishes a frame with a release store of tail and the
+ * consumer frees it with a release store of head.
+ */
+class ShmRing
+{
+public:
+    /**
+     * @brief Map a new ring
+     * @param capacityBytes Size of the data area (rounded up to a power of two)
+     * @return The ring, or nullptr if the mapping failed
+     */
+    static ShmRing* create(size_t capacityBytes);
+
+    /**
+     * @brief Unmap the ring (in the calling process only)
+     */
+    ~ShmRing();
+
+    /**
+     * @brief Append one frame made of a fixed header and a body
+     * @param header Frame header bytes
+     * @param headerLen Header length
+     * @param body Body bytes (may be nullptr if bodyLen is 0)
+     * @param bodyLen Body length
+     * @return false if the ring does not have room right now (always, for a
+     *         frame larger than maxFrameBytes())
+     */
+    bool tryPush(const void* header, size_t headerLen, const void* body, size_t bodyLen);
+
+    /**
+     * @brief Remove the oldest frame
+     * @param out Receives the frame bytes (header followed by body)
+     * @return false if the ring is empty
+     */
+    bool tryPop(vector<char>& out);
+
+    /**
+     * @brief Get the size of the data area
+     * @return Capacity in bytes
+     */
+    size_t capacity() const { return mask + 1; }
+
+    /**
+     * @brief Get the largest frame (header plus body) a push can wait for
+     * @return Bytes; a larger frame may never fit, since frames do not wrap
+     */
+    size_t maxFrameBytes() const { return capacity() / 2 - sizeof(uint32_t); }
+
+private:
+    struct Control
+    {
+        alignas(64) atomic<uint64_t> head; // consumer position
+        alignas(64) atomic<uint64_t> tail; // producer position
+    };
+
+    static const uint32_t WRAP = 0xffffffffu;
+
+    ShmRing(void* mapping, size_t mappingBytes, size_t capacityBytes);
+
+    void* mapping;
+    size_t mappingBytes;
+    size_t mask;
+    Control* control;
+    char* data;
+};
+
+#endif
@@ -0,0 +1,198 @@
+/**
+ * @file SlabArena.h
+ * @brief Slab allocator with generational handles
+ */
+
+#ifndef SLABARENA_H
+#define SLABARENA_H
+
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @struct Handle
+ * @brief Index + generation reference to an object in a SlabArena
+ * @tparam T The type of object referred to
+ *
+ * A handle stays cheap to copy and never dangles: once its object is
+ * destroyed the slot's generation moves on and lookups return nullptr.
+ */
+template <typename T>
+struct Handle
+{
+    uint32_t index;
+    uint32_t generation; // 0 is never issued, so a zeroed handle is null
+
+    Handle() : index(0), generation(0) {}
+    Handle(uint32_t i, uint32_t g) : index(i), generation(g) {}
+
+    bool isNull() const { return generation == 0; }
+    bool operator==(const Handle& other) const {
+        return index == other.index && generation == other.generation;
+    }
+    bool operator!=(const Handle& other) const { return !(*this == other); }
+};
+
+/**
+ * @class SlabArena
+ * @brief Stores objects of one type contiguously in fixed-size slabs
+ * @tparam T The type of object stored
+ * @tparam SLAB Objects per slab
+ *
+ * Objects never move once created, so raw pointers obtained through
+ * get() stay valid until the object is destroyed. Freed slots are reused
+ * (most recently freed first) to keep live objects packed. clear()
+ * destroys every live object in one pass.
+ */
+template <typename T, size_t SLAB = 256>
+class SlabArena
+{
+private:
+    struct Slot
+    {
+        typename aligned_storage<sizeof(T), alignof(T)>::type storage;
+        uint32_t generation;
+        uint32_t nextFree;
+        bool live;
+    };
+
+    static const uint32_t NO_SLOT = 0xffffffffu;
+
+    vector<Slot*> slabs;
+    uint32_t freeHead;
+    uint32_t slotCount;
+    size_t liveCount;
+
+    Slot& slot(uint32_t index) const {
+        return slabs[index / SLAB][index % SLAB];
+    }
+
+    T* object(Slot& s) const {
+        return reinterpret_cast<T*>(&s.storage);
+    }
+
+public:
+    SlabArena() : freeHead(NO_SLOT), slotCount(0), liveCount(0) {}
+
+    ~SlabArena() {
+        clear();
+        for (Slot* slab : slabs) {
+            delete[] slab;
+        }
+    }
+
+    /**
+     * @brief Construct a new object in the arena
+     * @param args Constructor arguments for T
+     * @return Handle to the new object
+     */
+    template <typename... Args>
+    Handle<T> create(Args&&... args) {
+        uint32_t index;
+        if (freeHead != NO_SLOT) {
+            index = freeHead;
+            freeHead = slot(index).nextFree;
+        } else {
+            if (slotCount % SLAB == 0) {
+                Slot* slab = new Slot[SLAB];
+                for (size_t i = 0; i < SLAB; i++) {
+                    slab[i].generation = 1;
+                    slab[i].live = false;
+                }
+                slabs.push_back(slab);
+            }
+            index = slotCount++;
+        }
+        Slot& s = slot(index);
+        new (&s.storage) T(std::forward<Args>(args)...);
+        s.live = true;
+        liveCount++;
+        return Handle<T>(index, s.generation);
+    }
+
+    /**
+     * @brief Resolve a handle in O(1)
+     * @param handle The handle
+     * @return The object, or nullptr if the handle is null or stale
+     */
+    T* get(Handle<T> handle) const {
+        if (handle.index >= slotCount) {
+            return nullptr;
+        }
+        Slot& s = slot(handle.index);
+        return (s.live && s.generation == handle.generation) ? object(s) : nullptr;
+    }
+
+    /**
+     * @brief Destroy the object a handle refers to
+     * @param handle The handle
+     * @return false if the handle was already stale
+     */
+    bool destroy(Handle<T> handle) {
+        if (!get(handle)) {
+            return false;
+        }
+        Slot& s = slot(handle.index);
+        object(s)->~T();
+        s.live = false;
+        s.generation++;
+        s.nextFree = freeHead;
+        freeHead = handle.index;
+        liveCount--;
+        return true;
+    }
+
+    /**
+     * @brief Destroy every live object (all outstanding handles become stale)
+     */
+    void clear() {
+        for (uint32_t i = 0; i < slotCount; i++) {
+            Slot& s = slot(i);
+            if (s.live) {
+                object(s)->~T();
+                s.live = false;
+                s.generation++;
+            }
+        }
+        // Rebuild the free list so low indices are reused first
+        freeHead = NO_SLOT;
+        for (uint32_t i = slotCount; i > 0; i--) {
+            slot(i - 1).nextFree = freeHead;
+            freeHead = i - 1;
+        }
+        liveCount = 0;
+    }
+
+    /**
+     * @brief Visit every live object in storage order
+     * @param fn Callable taking T&
+     */
+    template <typename Fn>
+    void forEach(Fn fn) {
+        for (uint32_t i = 0; i < slotCount; i++) {
+            Slot& s = slot(i);
+            if (s.live) {
+                fn(*object(s));
+            }
+        }
+    }
+
+    /**
+     * @brief Get the number of live objects
+     * @return Live object count
+     */
+    size_t size() const { return liveCount; }
+
+    /**
+     * @brief Get the bytes reserved by the slabs
+     * @return Reserved bytes
+     */
+    size_t reservedBytes() const { return slabs.size() * SLAB * sizeof(Slot); }
+};
+
+#endif
@@ -5,14 +5,27 @@
  * @date 29-09-2025
  */
 
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <string>
+#include <thread>
 #include "Iterator.h"
 #include "Observer.h"
 #include "ChatRoom.h"
 #include "CtrlCat.h"
 #include "Dogorithm.h"
 #include "Users.h"
+#include "AdmissionController.h"
+#include "FederationHost.h"
+#include "ChatSession.h"
+#include "DeliveryScheduler.h"
+#include "ModerationFilter.h"
+#include "MemoryRegistry.h"
+#include "TracePlayer.h"
+#include "TraceRecorder.h"
 
 using namespace std;
 
@@ -259,6 +272,1421 @@ int main() {
     
     cout << "\n✓ All patterns working together seamlessly" << endl;
 
+    // ========================================================================
+    // Test 13: Iterator Pattern - Cursors and Batches
+    // ========================================================================
+    printSection("Test 13: Iterator Pattern - Cursors and Batches");
+    
+    cout << "Cursors are value types: no new/delete, whole pages per batch\n" << endl;
+    
+    cout << "Dogorithm History (range-for over cursor):" << endl;
+    count = 1;
+    for (const string& entry : dogorithm->historyCursor()) {
+        cout << "  " << count++ << ". " << entry << endl;
+    }
+    
+    HistoryCursor cursor = dogorithm->historyCursor();
+    HistoryBatch batch;
+    size_t fetched = 0;
+    size_t batches = 0;
+    size_t n;
+    while ((n = cursor.nextBatch(batch, 2)) > 0) {
+        fetched += n;
+        batches++;
+    }
+    cout << "\nFetched " << fetched << " messages in " << batches << " batches of up to 2" << endl;
+    
+    UserCursor members = ctrlCat->userCursor();
+    size_t memberCount = 0;
+    while (members.hasNext()) {
+        members.next();
+        memberCount++;
+    }
+    cout << "CtrlCat members via cursor: " << memberCount << endl;
+    
+    if (fetched != dogorithm->getChatHistory().size() || 
+        memberCount != ctrlCat->getUsers().size()) {
+        cout << "✗ Cursor counts do not match" << endl;
+        return 1;
+    }
+    
+    {
+        // A batch must outlive the cursor leaving its page and the cache evicting it
+        ChatHistory longHistory;
+        Users archivist("Archivist");
+        size_t pages = ChatHistory::CACHED_PAGES + 2;
+        for (size_t i = 0; i < pages * ChatHistory::PAGE_SIZE; i++) {
+            longHistory.append(&archivist, "entry " + to_string(i));
+        }
+        HistoryCursor pager = longHistory.cursor();
+        HistoryBatch firstPage;
+        pager.nextBatch(firstPage, ChatHistory::PAGE_SIZE);
+        HistoryBatch laterPage;
+        while (pager.nextBatch(laterPage, ChatHistory::PAGE_SIZE) > 0) {
+        }
+        string crossed = pager.hasNext() ? "" : firstPage[1];
+        
+        HistoryCursor single = longHistory.cursor();
+        string kept;
+        for (size_t i = 0; i <= ChatHistory::PAGE_SIZE; i++) {
+            string line = single.next();
+            if (i == 0) kept = line;
+        }
+        
+        cout << "Batch from page 0 after evicting it: " << crossed << endl;
+        if (crossed != "Archivist: entry 1" || kept != "Archivist: entry 0" ||
+            firstPage.size() != ChatHistory::PAGE_SIZE) {
+            cout << "✗ A cursor batch did not survive its page leaving the cache" << endl;
+            return 1;
+        }
+    }
+    
+    cout << "\n✓ Cursors traverse the same data; batches keep their pages alive" << endl;
+
+    // ========================================================================
+    // Test 14: Mediator Pattern - Targeted Delivery
+    // ========================================================================
+    printSection("Test 14: Mediator Pattern - Targeted Delivery");
+    
+    cout << "Direct, group and tag messages reach only their audience\n" << endl;
+    
+    cout << "Alice sends a direct message to Diana in CtrlCat:" << endl;
+    alice->sendDirect("Just between us, Diana", diana, ctrlCat);
+    size_t dmIndex = ctrlCat->getChatHistory().size() - 1;
+    
+    cout << "\nDiana is tagged as a moderator, Alice messages the mods:" << endl;
+    ctrlCat->tagUser(diana, "mods");
+    alice->sendToTag("Mods, please pin this", "mods", ctrlCat);
+    
+    cout << "\nCharlie messages an explicit list in Dogorithm (Alice listed twice, one copy):" << endl;
+    vector<Users*> recipients;
+    recipients.push_back(alice);
+    recipients.push_back(alice);
+    charlie->sendToUsers("Alice only, via a list", recipients, dogorithm);
+    const MessageVisibility& listed = dogorithm->getVisibility(dogorithm->getChatHistory().size() - 1);
+    
+    const MessageVisibility& dm = ctrlCat->getVisibility(dmIndex);
+    if (dm.scope != MessageVisibility::DIRECT || !dm.isVisibleTo(diana) ||
+        !dm.isVisibleTo(alice) || dm.isVisibleTo(bob) ||
+        ctrlCat->getTagMembers("mods").size() != 1 ||
+        listed.scope != MessageVisibility::GROUP || listed.recipients.size() != 1) {
+        cout << "✗ Targeted delivery metadata is wrong" << endl;
+        return 1;
+    }
+    
+    cout << "\n✓ Targeted messages are logged with their visibility" << endl;
+
+    // ========================================================================
+    // Test 15: Command Pattern - Admission Control
+    // ========================================================================
+    printSection("Test 15: Command Pattern - Admission Control");
+    
+    cout << "A token bucket per user stops floods before commands are created\n" << endl;
+    
+    AdmissionController::Config limits;
+    limits.userRate = 1;     // one message per second...
+    limits.userBurst = 2;    // ...after a burst of two
+    AdmissionController shedder(limits);
+    dogorithm->setAdmissionController(&shedder);
+    
+    int accepted = 0;
+    for (int i = 0; i < 4; i++) {
+        if (charlie->send("Flood #" + to_string(i + 1), dogorithm) == SEND_DELIVERED) {
+            accepted++;
+        }
+    }
+    AdmissionStats shedStats = shedder.getStats();
+    cout << "\nCharlie tried 4 sends: " << accepted << " admitted, " 
+         << shedStats.rejectedUser << " shed by the user bucket" << endl;
+    
+    limits.userRate = 50;    // slow enough that back-to-back sends never earn a token
+    limits.userBurst = 1;
+    limits.policy = AdmissionController::QUEUE;
+    AdmissionController queuer(limits);
+    dogorithm->setAdmissionController(&queuer);
+    
+    cout << "\nQueue mode: Alice's second message waits for a token:" << endl;
+    alice->send("First in line", dogorithm);
+    alice->send("Queued behind", dogorithm);
+    size_t waiting = queuer.getQueuedCount();
+    this_thread::sleep_for(chrono::milliseconds(25));
+    size_t drained = queuer.drainDeferred();
+    
+    // A parked send must not outlive its sender
+    Users* dropout = new Users("Dropout");
+    dogorithm->registerUser(dropout);
+    dropout->send("First try", dogorithm);
+    dropout->send("Parked, then abandoned", dogorithm);
+    size_t parked = queuer.getQueuedCount();
+    delete dropout;
+    this_thread::sleep_for(chrono::milliseconds(25));
+    size_t abandoned = queuer.drainDeferred();
+    
+    dogorithm->setAdmissionController(nullptr);
+    
+    if (accepted != 2 || shedStats.rejectedUser != 2 || waiting != 1 || drained != 1 ||
+        parked != 1 || abandoned != 0 || queuer.getQueuedCount() != 0 || queuer.getStats().dropped != 1) {
+        cout << "✗ Admission control counters are wrong" << endl;
+        return 1;
+    }
+    
+    {
+        // Direct, group and tag sends go through the same gate and dedupe
+        Dogorithm backRoom;
+        Users whisperer("Whisperer");
+        Users listener("Listener");
+        Users bystander("Bystander");
+        backRoom.registerUser(&whisperer);
+        backRoom.registerUser(&listener);
+        backRoom.registerUser(&bystander);
+        AdmissionController::Config dmLimits;
+        dmLimits.userRate = 50;
+        dmLimits.userBurst = 1;
+        dmLimits.policy = AdmissionController::QUEUE;
+        AdmissionController dmGate(dmLimits);
+        backRoom.setAdmissionController(&dmGate);
+        
+        SendResult first = whisperer.sendDirect("psst", &listener, &backRoom, 5);
+        SendResult second = whisperer.sendDirect("still there?", &listener, &backRoom);
+        SendResult retried = whisperer.sendDirect("psst", &listener, &backRoom, 5);
+        this_thread::sleep_for(chrono::milliseconds(25));
+        size_t drainedDirect = dmGate.drainDeferred();
+        backRoom.setAdmissionController(nullptr);
+        
+        if (first != SEND_DELIVERED || second != SEND_QUEUED || retried != SEND_DELIVERED || drainedDirect != 1 || backRoom.getChatHistory().size() != 2 ||
+            !backRoom.getVisibility(1).isVisibleTo(&listener) || backRoom.getVisibility(1).isVisibleTo(&bystander)) {
+            cout << "✗ Targeted sends bypassed admission control" << endl;
+            return 1;
+        }
+    }
+    
+    {
+        // A flooding sender at the head of the queue must not hold up others
+        Dogorithm busyRoom;
+        Users spammer("Spammer");
+        Users polite("Polite");
+        busyRoom.registerUser(&spammer);
+        busyRoom.registerUser(&polite);
+        AdmissionController::Config fairLimits;
+        fairLimits.userRate = 20;
+        fairLimits.userBurst = 1;
+        fairLimits.policy = AdmissionController::QUEUE;
+        fairLimits.maxQueuedPerUser = 2;
+        AdmissionController fairGate(fairLimits);
+        busyRoom.setAdmissionController(&fairGate);
+        
+        spammer.send("Buy now", &busyRoom);
+        spammer.send("Buy now!", &busyRoom);
+        spammer.send("Buy now!!", &busyRoom);
+        SendResult overCap = spammer.send("Buy now!!!", &busyRoom);
+        polite.send("Hello", &busyRoom);
+        SendResult politeParked = polite.send("Hello again", &busyRoom);
+        this_thread::sleep_for(chrono::milliseconds(60));
+        fairGate.drainDeferred();
+        busyRoom.setAdmissionController(nullptr);
+        
+        bool politeDelivered = false;
+        ChatHistory& busyHistory = busyRoom.getChatHistory();
+        for (size_t i = 0; i < busyHistory.size(); i++) {
+            politeDelivered = politeDelivered || busyHistory.payload(i) == "Hello again";
+        }
+        if (overCap != SEND_SHED || politeParked != SEND_QUEUED || !politeDelivered) {
+            cout << "✗ A flooding sender blocked or crowded out a polite one" << endl;
+            return 1;
+        }
+    }
+    
+    cout << "\n✓ Rate limits shed or queue excess sends and count rejections" << endl;
+
+    // ========================================================================
+    // Test 16: Command Pattern - Idempotent Send
+    // ========================================================================
+    printSection("Test 16: Command Pattern - Idempotent Send");
+    
+    cout << "Retries carrying the same client message ID are delivered once\n" << endl;
+    
+    size_t historyBefore = dogorithm->getChatHistory().size();
+    charlie->send("Sent with ID 42", dogorithm, 42);
+    cout << "\nRetrying the same ID twice (no output expected):" << endl;
+    charlie->send("Sent with ID 42", dogorithm, 42);
+    charlie->send("Sent with ID 42", dogorithm, 42);
+    cout << "\nAlice may reuse ID 42, IDs are per sender:" << endl;
+    alice->send("Alice's own ID 42", dogorithm, 42);
+    
+    // A new user may get a destroyed one's address, but not its IDs
+    Users* former = new Users("Former");
+    dogorithm->registerUser(former);
+    former->send("Sent with ID 7", dogorithm, 7);
+    delete former;
+    Users* successor = new Users("Successor");
+    dogorithm->registerUser(successor);
+    SendResult successorSent = successor->send("Also sent with ID 7", dogorithm, 7);
+    dogorithm->removeUser(successor);
+    delete successor;
+    
+    DedupStats dedupStats = dogorithm->getDeduplicator().getStats();
+    cout << "\nDuplicates dropped: " << dedupStats.duplicates 
+         << ", dedupe window memory: " << dedupStats.memoryBytes << " bytes" << endl;
+    
+    if (dogorithm->getChatHistory().size() != historyBefore + 4 || dedupStats.duplicates != 2 ||
+        successorSent != SEND_DELIVERED) {
+        cout << "✗ Retried sends were not deduplicated" << endl;
+        return 1;
+    }
+    
+    {
+        // The first copy may still be queued or parked when the retry comes
+        DeliveryScheduler scheduler;
+        CtrlCat queuedRoom;
+        Users retrier("Retrier");
+        queuedRoom.registerUser(&retrier);
+        queuedRoom.setDeliveryScheduler(&scheduler);
+        retrier.send("Waiting in the scheduler", &queuedRoom, 7);
+        retrier.send("Waiting in the scheduler", &queuedRoom, 7);
+        
+        AdmissionController::Config parking;
+        parking.userRate = 1000;
+        parking.userBurst = 1;
+        parking.policy = AdmissionController::QUEUE;
+        AdmissionController gate(parking);
+        queuedRoom.setAdmissionController(&gate);
+        retrier.send("Admitted", &queuedRoom, 8);
+        retrier.send("Parked, then retried", &queuedRoom, 9);
+        this_thread::sleep_for(chrono::milliseconds(5));
+        retrier.send("Parked, then retried", &queuedRoom, 9);
+        size_t replayed = gate.drainDeferred();
+        queuedRoom.setAdmissionController(nullptr);
+        scheduler.drain();
+        
+        if (queuedRoom.getChatHistory().size() != 3 || replayed != 0) {
+            cout << "✗ A retry overtook its queued original" << endl;
+            return 1;
+        }
+    }
+    
+    cout << "\n✓ Client message IDs make send idempotent" << endl;
+
+    // ========================================================================
+    // Test 17: Observer Pattern - Presence Channel
+    // ========================================================================
+    printSection("Test 17: Observer Pattern - Presence Channel");
+    
+    cout << "Presence and typing updates are coalesced into one diff per tick\n" << endl;
+    
+    PresenceChannel& ctrlCatPresence = ctrlCat->getPresence();
+    ctrlCatPresence.addListener(diana);
+    size_t notificationsBefore = diana->getNotifications().size();
+    size_t historyBeforePresence = ctrlCat->getChatHistory().size();
+    
+    ctrlCatPresence.setStatus(alice, PresenceState::ONLINE);
+    for (int i = 0; i < 10; i++) {
+        ctrlCatPresence.setTyping(alice, i % 2 == 0);   // flickers, ends not typing
+    }
+    ctrlCatPresence.setTyping(alice, true);
+    ctrlCatPresence.setStatus(diana, PresenceState::AWAY);
+    
+    size_t diffSize = ctrlCatPresence.tick(ctrlCat, 1000);
+    size_t emptyTick = ctrlCatPresence.tick(ctrlCat, 2000);
+    cout << "\n13 updates delivered as a diff of " << diffSize << " users, " 
+         << ctrlCatPresence.getCoalescedCount() << " coalesced" << endl;
+    
+    ctrlCatPresence.removeListener(diana);
+    
+    if (diffSize != 2 || emptyTick != 0 || 
+        diana->getNotifications().size() != notificationsBefore ||
+        ctrlCat->getChatHistory().size() != historyBeforePresence) {
+        cout << "✗ Presence channel leaked into history or notifications" << endl;
+        return 1;
+    }
+    
+    // Members who leave, or are destroyed, after being seen online go OFFLINE
+    ctrlCatPresence.addListener(diana);
+    Users* leaver = new Users("Leaver");
+    Users* vanisher = new Users("Vanisher");
+    ctrlCat->registerUser(leaver);
+    ctrlCat->registerUser(vanisher);
+    ctrlCatPresence.setStatus(leaver, PresenceState::ONLINE);
+    ctrlCatPresence.setStatus(vanisher, PresenceState::ONLINE);
+    ctrlCatPresence.tick(ctrlCat, 3000);
+    ctrlCat->removeUser(leaver);
+    delete vanisher;
+    size_t departedDiff = ctrlCatPresence.tick(ctrlCat, 4000);
+    bool departedOffline = ctrlCatPresence.getState(leaver).status() == PresenceState::OFFLINE;
+    delete leaver;
+    ctrlCatPresence.removeListener(diana);
+    
+    if (departedDiff != 2 || !departedOffline) {
+        cout << "✗ Departed members were never reported offline" << endl;
+        return 1;
+    }
+    
+    cout << "\n✓ Presence never touches chat history or notifications" << endl;
+
+    // ========================================================================
+    // Test 18: Iterator Pattern - Lazy History Rendering
+    // ========================================================================
+    printSection("Test 18: Iterator Pattern - Lazy History Rendering");
+    
+    cout << "History stores raw records and renders display strings when visited\n" << endl;
+    
+    Users* eve = new Users("Eve");
+    dogorithm->registerUser(eve);
+    eve->send("Hi, I'm new here", dogorithm);
+    size_t eveIndex = dogorithm->getChatHistory().size() - 1;
+    
+    cout << "\nBefore rename: " << dogorithm->getChatHistory().at(eveIndex) << endl;
+    eve->setName("Evelyn");
+    string renamed = dogorithm->getChatHistory().at(eveIndex);
+    cout << "After rename:  " << renamed << endl;
+    
+    dogorithm->getChatHistory().setFormatter(
+        [](const string& sender, const string& message) { return "<" + sender + "> " + message; });
+    string reformatted = dogorithm->getChatHistory().at(eveIndex);
+    cout << "New format:    " << reformatted << endl;
+    dogorithm->getChatHistory().setFormatter(&ChatHistory::defaultFormat);
+    
+    if (renamed != "Evelyn: Hi, I'm new here" || reformatted != "<Evelyn> Hi, I'm new here" ||
+        dogorithm->getChatHistory().payload(eveIndex) != "Hi, I'm new here") {
+        cout << "✗ History was not re-rendered" << endl;
+        return 1;
+    }
+    dogorithm->removeUser(eve);
+    
+    // Entries outlive their sender: they render with its last name
+    {
+        CtrlCat den;
+        Users host("Host");
+        Users* guest = new Users("Guest");
+        den.registerUser(&host);
+        den.registerUser(guest);
+        guest->send("Thanks for having me", &den);
+        delete guest;
+        Iterator<string>* it = den.createChatHistoryIterator();
+        string last;
+        while (it->hasNext()) {
+            last = it->next();
+        }
+        delete it;
+        cout << "After the sender was destroyed: " << last << endl;
+        if (last != "Guest: Thanks for having me" || den.getChatHistory().sender(0) != nullptr ||
+            den.getChatHistory().senderName(0) != "Guest") {
+            cout << "✗ History lost track of a destroyed sender" << endl;
+            return 1;
+        }
+    }
+    
+    cout << "\n✓ Renames and format changes apply to existing history" << endl;
+
+    // ========================================================================
+    // Test 19: Mediator Pattern - Rooms in Worker Processes
+    // ========================================================================
+    printSection("Test 19: Mediator Pattern - Rooms in Worker Processes");
+    
+    cout << "A remote room is a ChatRoom proxy; fan-out runs in a worker process\n" << endl;
+    
+    size_t federatedHistory = 0;
+    uint64_t federatedDeliveries = 0;
+    uint64_t lateDeliveries = 0;
+    bool oversizedSent = true;
+    bool workerTimestamps = false;
+    {
+        FederationHost federation(2);
+        if (!federation.ok()) {
+            cout << "✗ Federation workers did not start" << endl;
+            return 1;
+        }
+        ChatRoom* remoteCats = federation.createRoom("CtrlCat");
+        ChatRoom* remoteDogs = federation.createRoom("Dogorithm");
+        
+        remoteCats->registerUser(alice);
+        remoteCats->registerUser(charlie);
+        remoteDogs->registerUser(charlie);
+        
+        auto wallUs = []() {
+            return chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+        };
+        int64_t sentAfter = wallUs();
+        alice->send("Hello from another process!", remoteCats);
+        charlie->send("Dogs live on worker 0", remoteDogs);   // nobody else to receive it
+        federation.sync();
+        int64_t savedBefore = wallUs();
+        this_thread::sleep_for(chrono::milliseconds(5));
+        
+        // Reading the history pulls it from the worker; no explicit sync
+        cout << "\nRemote CtrlCat history (fetched from its worker):" << endl;
+        for (const string& entry : remoteCats->historyCursor()) {
+            cout << "  " << entry << endl;
+        }
+        federatedHistory = remoteCats->getChatHistory().size();
+        if (federatedHistory == 1) {
+            // Stamped when the worker saved it, not when it was fetched
+            int64_t stamped = remoteCats->getChatHistory().record(0).timestampUs;
+            workerTimestamps = stamped >= sentAfter && stamped <= savedBefore;
+        }
+        federatedDeliveries = federation.getDelivered();
+        
+        // The worker must stop delivering to a member destroyed on this side
+        Users* visitor = new Users("Visitor");
+        remoteCats->registerUser(visitor);
+        delete visitor;
+        alice->send("Only Charlie is left to hear this", remoteCats);
+        federation.sync();
+        lateDeliveries = federation.getDelivered() - federatedDeliveries;
+        
+        // No frame can carry this: it must be refused, not spin in post()
+        oversizedSent = alice->send(string(federation.maxTextBytes() + 1, 'x'), remoteCats) == SEND_DELIVERED;
+        
+        remoteCats->removeUser(alice);
+        remoteCats->removeUser(charlie);
+        remoteDogs->removeUser(charlie);
+    }
+    
+    if (federatedHistory != 1 || !workerTimestamps || federatedDeliveries != 1 || lateDeliveries != 1 || oversizedSent) {
+        cout << "✗ Federated room lost a message" << endl;
+        return 1;
+    }
+    
+    cout << "\n✓ Users::send works unchanged against rooms in other processes" << endl;
+
+    // ========================================================================
+    // Test 20: Ownership - Arena-Backed Sessions and Handles
+    // ========================================================================
+    printSection("Test 20: Ownership - Arena-Backed Sessions and Handles");
+    
+    cout << "Rooms and users outlive each other safely; stale handles resolve to null\n" << endl;
+    
+    {
+        ChatSession session;
+        UserHandle frankHandle = session.createUser("Frank");
+        UserHandle ginaHandle = session.createUser("Gina");
+        CtrlCatHandle loungeHandle = session.createCtrlCat();
+        DogorithmHandle parkHandle = session.createDogorithm();
+        
+        Users* frank = session.get(frankHandle);
+        session.get(loungeHandle)->registerUser(frank);
+        session.get(loungeHandle)->registerUser(session.get(ginaHandle));
+        session.get(parkHandle)->registerUser(frank);
+        frank->send("Arena-allocated hello", session.get(loungeHandle));
+        
+        // Destroying a room must unlink it from its members
+        session.destroy(parkHandle);
+        if (session.get(parkHandle) != nullptr || frank->getChatRooms().size() != 1) {
+            cout << "✗ Destroyed room still reachable" << endl;
+            return 1;
+        }
+        
+        // Destroying a user must unlink it from its rooms
+        session.destroy(ginaHandle);
+        if (session.get(ginaHandle) != nullptr || session.get(loungeHandle)->getUsers().size() != 1) {
+            cout << "✗ Destroyed user still a member" << endl;
+            return 1;
+        }
+        
+        // A recycled slot must not revive the old handle
+        UserHandle henryHandle = session.createUser("Henry");
+        if (henryHandle.index != ginaHandle.index || session.get(ginaHandle) != nullptr) {
+            cout << "✗ Stale handle resolved after slot reuse" << endl;
+            return 1;
+        }
+        cout << "Stale handles rejected after destroy and slot reuse" << endl;
+        
+        session.clear();
+        if (session.userCount() != 0 || session.roomCount() != 0 || session.get(frankHandle) != nullptr) {
+            cout << "✗ Bulk teardown left objects behind" << endl;
+            return 1;
+        }
+    }
+    
+    // Heap-allocated objects follow the same rules in either deletion order
+    {
+        Users* ivan = new Users("Ivan");
+        CtrlCat* tempRoom = new CtrlCat();
+        tempRoom->registerUser(ivan);
+        tempRoom->subscribe(ivan);
+        delete tempRoom;
+        if (!ivan->getChatRooms().empty()) {
+            cout << "✗ User kept a pointer to a deleted room" << endl;
+            return 1;
+        }
+        
+        tempRoom = new CtrlCat();
+        tempRoom->registerUser(ivan);
+        tempRoom->subscribe(ivan);
+        delete ivan;
+        if (!tempRoom->getUsers().empty() || !tempRoom->getObservers().empty()) {
+            cout << "✗ Room kept a pointer to a deleted user" << endl;
+            return 1;
+        }
+        
+        // An observer that left the room is still unsubscribed when destroyed
+        Users* formerMember = new Users("Former");
+        Users* observerOnly = new Users("Watcher");
+        tempRoom->registerUser(formerMember);
+        tempRoom->subscribe(formerMember);
+        tempRoom->removeUser(formerMember);
+        tempRoom->subscribe(observerOnly);
+        delete formerMember;
+        delete observerOnly;
+        Users* newcomer = new Users("Newcomer");
+        tempRoom->registerUser(newcomer);   // notifies the remaining observers
+        bool observersDropped = tempRoom->getObservers().empty();
+        delete newcomer;
+        if (!observersDropped) {
+            cout << "✗ Room kept a deleted observer that had left" << endl;
+            return 1;
+        }
+        
+        // And a deleted room is dropped from an observer that is not a member
+        Users* watcher = new Users("Watcher");
+        tempRoom->subscribe(watcher);
+        delete tempRoom;
+        delete watcher;
+    }
+    
+    cout << "\n✓ No dangling room or user pointers in either teardown order" << endl;
+
+    // ========================================================================
+    // Test 21: Command Pattern - Priority-Aware Delivery Scheduler
+    // ========================================================================
+    printSection("Test 21: Command Pattern - Priority-Aware Delivery Scheduler");
+    
+    cout << "Queued commands run by priority class, then round-robin across rooms\n" << endl;
+    
+    {
+        DeliveryScheduler scheduler;
+        CtrlCat busyRoom;
+        Dogorithm quietRoom;
+        busyRoom.setDeliveryScheduler(&scheduler);
+        quietRoom.setDeliveryScheduler(&scheduler);
+        
+        Users chatter("Chatter");
+        Users admin("Admin");
+        Users moderator("Moderator");
+        admin.setSendPriority(PRIORITY_HIGH);
+        moderator.setSendPriority(PRIORITY_CRITICAL);
+        
+        busyRoom.subscribe(&admin);
+        busyRoom.registerUser(&chatter);   // join notification is queued (HIGH)
+        busyRoom.registerUser(&admin);
+        busyRoom.registerUser(&moderator);
+        quietRoom.registerUser(&admin);
+        scheduler.drain();
+        
+        for (int i = 0; i < 5; i++) {
+            chatter.send("chatter " + to_string(i), &busyRoom);
+        }
+        admin.send("Server restarts in 5 minutes", &busyRoom);
+        moderator.send("Message removed by moderator", &busyRoom);
+        cout << "Queued " << scheduler.pending() << " commands" << endl;
+        
+        // The critical send/log pair runs first, then the admin broadcast
+        scheduler.drain(4);
+        ChatHistory& busyHistory = busyRoom.getChatHistory();
+        if (busyHistory.size() != 2 || busyHistory.payload(0) != "Message removed by moderator" ||
+            busyHistory.payload(1) != "Server restarts in 5 minutes") {
+            cout << "✗ High-priority commands waited behind bulk chatter" << endl;
+            return 1;
+        }
+        
+        // One message in a quiet room is not stuck behind the busy room's backlog
+        admin.setSendPriority(PRIORITY_NORMAL);
+        admin.send("Anyone here?", &quietRoom);
+        scheduler.drain(4);
+        if (quietRoom.getChatHistory().size() != 1) {
+            cout << "✗ Quiet room starved by a busy room in the same class" << endl;
+            return 1;
+        }
+        scheduler.drain();
+        
+        PriorityClassStats high = scheduler.getStats(PRIORITY_HIGH);
+        PriorityClassStats normal = scheduler.getStats(PRIORITY_NORMAL);
+        cout << "high:   " << high.executed << " run, max depth " << high.maxDepth
+             << ", p99 <= " << high.p99LatencyUs << "us" << endl;
+        cout << "normal: " << normal.executed << " run, max depth " << normal.maxDepth
+             << ", p99 <= " << normal.p99LatencyUs << "us" << endl;
+        if (busyHistory.size() != 7 || scheduler.pending() != 0 || admin.getNotifications().size() != 3 ||
+            high.executed != 6 || normal.executed != 12) {
+            cout << "✗ Scheduler lost or duplicated commands" << endl;
+            return 1;
+        }
+        
+        // A destroyed user's queued sends are dropped; messages to it skip it
+        Users* leaver = new Users("Leaver");
+        busyRoom.registerUser(leaver);
+        scheduler.drain();
+        leaver->send("Sent just before logging off", &busyRoom);
+        admin.sendDirect("See you tomorrow", leaver, &busyRoom);
+        size_t queuedBefore = scheduler.pending();
+        delete leaver;
+        size_t queuedAfter = scheduler.pending();
+        scheduler.drain();
+        if (queuedBefore != 4 || queuedAfter != 2 || busyHistory.size() != 8 ||
+            busyRoom.getVisibility(7).isVisibleTo(leaver)) {
+            cout << "✗ Scheduler kept commands of a destroyed user" << endl;
+            return 1;
+        }
+    }
+    
+    cout << "\n✓ Critical and admin traffic overtakes queued chatter" << endl;
+
+    // ========================================================================
+    // Test 22: Iterator Pattern - Compact History Storage
+    // ========================================================================
+    printSection("Test 22: Iterator Pattern - Compact History Storage");
+    
+    cout << "Short messages are stored inline; long ones in compressed blocks\n" << endl;
+    
+    {
+        ChatHistory archive;
+        vector<string> sent;
+        for (int i = 0; i < 3000; i++) {
+            if (i % 3 == 0) {
+                sent.push_back("ok " + to_string(i));
+            } else {
+                sent.push_back("Reminder: the weekly PetSpace meetup is at the dog park, bring treats! #" +
+                               to_string(i));
+            }
+        }
+        sent.push_back(string(2 * PayloadStore::BLOCK_SIZE, 'z'));   // larger than a block
+        for (const string& message : sent) {
+            archive.append(alice, message);
+        }
+        
+        bool intact = true;
+        for (size_t i = 0; i < sent.size(); i++) {
+            intact = intact && archive.payload(i) == sent[i];
+        }
+        size_t rendered = 0;
+        for (const string& line : archive.cursor()) {
+            intact = intact && line == "Alice: " + sent[rendered];
+            rendered++;
+        }
+        
+        HistoryStorageStats stats = archive.getStorageStats();
+        cout << stats.messages << " messages, " << stats.inlineMessages << " inline, "
+             << stats.sealedBlocks << " sealed blocks" << endl;
+        cout << "Payload text: " << double(stats.payloadBytes) / stats.messages << " bytes/message" << endl;
+        cout << "Stored:       " << stats.bytesPerMessage() << " bytes/message ("
+             << double(stats.storedBytes - stats.recordBytes) / stats.messages << " outside records)" << endl;
+        
+        // A damaged block is reported, not decoded into garbage
+        string packed;
+        PayloadStore::compress("", sent[1] + sent[2] + sent[4], packed);
+        size_t rawSize = sent[1].size() + sent[2].size() + sent[4].size();
+        string window(rawSize, '\0');
+        bool rejectsTruncated = PayloadStore::decompress(packed.data(), packed.size(), &window[0], 0, rawSize) &&
+                                !PayloadStore::decompress(packed.data(), packed.size() / 2, &window[0], 0, rawSize);
+        
+        if (!intact || rendered != sent.size() || !rejectsTruncated) {
+            cout << "✗ Stored history did not round-trip" << endl;
+            return 1;
+        }
+        if (stats.inlineMessages != 1000 || stats.sealedBlocks == 0 ||
+            stats.storedBytes - stats.recordBytes >= stats.payloadBytes / 2) {
+            cout << "✗ History storage is not compact" << endl;
+            return 1;
+        }
+    }
+    
+    cout << "\n✓ History reads back exactly from inline and compressed storage" << endl;
+
+    // ========================================================================
+    // Test 23: Iterator Pattern - Concurrent History Readers
+    // ========================================================================
+    printSection("Test 23: Iterator Pattern - Concurrent History Readers");
+    
+    cout << "Reader threads iterate a published prefix while the writer appends\n" << endl;
+    
+    {
+        const size_t entries = 50000;
+        const int readerThreads = 3;
+        ChatHistory shared;
+        auto expected = [](size_t i) {
+            return i % 4 == 0 ? "m" + to_string(i)
+                              : "entry " + to_string(i) + " is long enough to leave the record";
+        };
+        
+        atomic<bool> corrupt(false);
+        vector<size_t> verified(readerThreads, 0);
+        HistoryReader idle = shared.reader();   // registered throughout, never reads
+        vector<thread> readers;
+        for (int r = 0; r < readerThreads; r++) {
+            readers.push_back(thread([&, r]() {
+                HistoryReader view = shared.reader();
+                string text;
+                size_t next = 0;
+                while (next < entries) {
+                    if (view.refresh() == next) {
+                        this_thread::yield();
+                        continue;
+                    }
+                    for (; next < view.size(); next++) {
+                        if (!view.payload(next, text) || text != expected(next) || view.sender(next) != alice) {
+                            corrupt = true;
+                        }
+                    }
+                }
+                verified[r] = next;
+            }));
+        }
+        
+        thread writer([&]() {
+            for (size_t i = 0; i < entries; i++) {
+                shared.append(alice, expected(i));
+            }
+        });
+        writer.join();
+        for (thread& reader : readers) {
+            reader.join();
+        }
+        
+        HistoryStorageStats stats = shared.getStorageStats();
+        cout << readerThreads << " readers each verified " << verified[0] << " entries ("
+             << stats.sealedBlocks << " blocks sealed meanwhile)" << endl;
+        if (corrupt || verified[1] != entries || verified[2] != entries) {
+            cout << "✗ Reader saw a torn or inconsistent history" << endl;
+            return 1;
+        }
+        
+        // Only reads in progress hold sealed raw buffers back, not registrations
+        shared.append(alice, string(PayloadStore::BLOCK_SIZE, 'x'));
+        if (shared.getStorageStats().retiredBytes != 0) {
+            cout << "✗ An idle reader kept sealed buffers alive" << endl;
+            return 1;
+        }
+    }
+    
+    cout << "\n✓ Readers never block the writer or see a partial entry" << endl;
+
+    // ========================================================================
+    // Test 24: Command Pattern - Moderation Filter Pipeline
+    // ========================================================================
+    printSection("Test 24: Command Pattern - Moderation Filter Pipeline");
+    
+    cout << "Filters run before the send/log commands are created\n" << endl;
+    
+    {
+        PatternMatcher overlapping(vector<string>{"he", "she", "hers"});
+        string ushers = "USHERS";
+        overlapping.redact(ushers);
+        if (ushers != "U*****" || overlapping.contains("hi", 2)) {
+            cout << "✗ Overlapping patterns matched incorrectly: " << ushers << endl;
+            return 1;
+        }
+        
+        // A longer pattern failing the word test must not hide a shorter one
+        PatternMatcher nested(vector<string>{"bad", "x bad"}, true);
+        string nestedText = "yx bad";
+        if (!nested.contains(nestedText.data(), nestedText.size()) || nested.redact(nestedText) != 1 ||
+            nestedText != "yx ***") {
+            cout << "✗ Whole-word match missed a shorter pattern: " << nestedText << endl;
+            return 1;
+        }
+        
+        CtrlCat moderated;
+        Users poster("Poster");
+        Users reader("Reader");
+        moderated.registerUser(&poster);
+        moderated.registerUser(&reader);
+        
+        ModerationFilter blocklist(vector<string>{"spoiler", "buy followers"});
+        ModerationFilter profanity(vector<string>{"darn"}, ModerationFilter::REDACT, true);
+        moderated.addFilter(&blocklist);
+        moderated.addFilter(&profanity);
+        
+        bool rejected = poster.send("Huge SPOILER: the dog did it", &moderated) == SEND_REJECTED;
+        poster.send("Darn it, Darnell took my seat", &moderated);
+        if (!rejected || moderated.getChatHistory().size() != 1 ||
+            moderated.getChatHistory().payload(0) != "**** it, Darnell took my seat") {
+            cout << "✗ Blocklist or redaction not applied" << endl;
+            return 1;
+        }
+        
+        // Hot reload: the new list applies to the next send
+        blocklist.reload(vector<string>{"ending"});
+        bool spoilerAllowed = poster.send("No spoiler here", &moderated) == SEND_DELIVERED;
+        bool endingRejected = poster.send("The ending is great", &moderated) == SEND_REJECTED;
+        
+        const char* listFile = "moderation_test_blocklist.txt";
+        {
+            ofstream list(listFile);
+            list << "# reloaded from disk\nfree kibble\n";
+        }
+        bool fileLoaded = blocklist.reloadFromFile(listFile);
+        bool kibbleRejected = poster.send("FREE KIBBLE click here", &moderated) == SEND_REJECTED;
+        remove(listFile);
+        
+        ModerationStats stats = blocklist.getStats();
+        cout << "Inspected " << stats.inspected << ", rejected " << stats.rejected
+             << ", reloads " << stats.reloads << endl;
+        if (!spoilerAllowed || !endingRejected || !fileLoaded || !kibbleRejected ||
+            stats.rejected != 3 || stats.reloads != 2) {
+            cout << "✗ Hot reload did not take effect" << endl;
+            return 1;
+        }
+    }
+    
+    cout << "\n✓ Rejected messages are neither delivered nor saved" << endl;
+
+    // ========================================================================
+    // Test 25: Iterator Pattern - Time-Indexed History Seeks
+    // ========================================================================
+    printSection("Test 25: Iterator Pattern - Time-Indexed History Seeks");
+    
+    cout << "Each saved message carries a timestamp and sequence number\n" << endl;
+    
+    {
+        Users archivist("Archivist");
+        ChatHistory timeline;
+        const int64_t start = 1700000000000000LL;
+        const size_t entries = 1000; // spans several index blocks
+        for (size_t i = 0; i < entries; i++) {
+            // One message per second, in bursts of two with the same timestamp
+            timeline.append(&archivist, "tick " + to_string(i), start + (i / 2) * 1000000);
+        }
+        // An out-of-order import is clamped, never breaking the ordering
+        timeline.append(&archivist, "late arrival", start);
+        
+        bool ordered = true;
+        for (size_t i = 1; i < timeline.size(); i++) {
+            const HistoryRecord& previous = timeline.record(i - 1);
+            const HistoryRecord& current = timeline.record(i);
+            ordered = ordered && current.timestampUs >= previous.timestampUs &&
+                      current.sequence > previous.sequence;
+        }
+        
+        int64_t last = start + (entries / 2 - 1) * 1000000;
+        bool seeksCorrect = timeline.seek(start - 1) == 0 &&
+                            timeline.seek(start + 300 * 1000000) == 600 &&
+                            timeline.seek(start + 300 * 1000000 + 1) == 602 &&
+                            timeline.seek(last) == entries - 2 &&
+                            timeline.seek(last + 1) == timeline.size();
+        
+        HistoryCursor window = timeline.cursorBetween(start + 100 * 1000000, start + 110 * 1000000);
+        string firstLine = window.hasNext() ? window.next() : "";
+        HistoryReader view = timeline.reader();
+        
+        cout << "Entries 600.. start at t+300s; window [100s, 110s) holds " << window.size()
+             << " entries" << endl;
+        if (!ordered || !seeksCorrect || window.size() != 20 || firstLine != "Archivist: tick 200" ||
+            view.seek(start + 499 * 1000000) != entries - 2 ||
+            timeline.record(entries).timestampUs != last) {
+            cout << "✗ Time index returned the wrong position" << endl;
+            return 1;
+        }
+        
+        // Rooms stamp live messages with the current time
+        CtrlCat live;
+        Users talker("Talker");
+        live.registerUser(&talker);
+        int64_t before = ChatHistory::nowUs();
+        talker.send("fresh message", &live);
+        if (live.historySince(before).size() != 1 || live.historySince(ChatHistory::nowUs() + 1).size() != 0) {
+            cout << "✗ historySince did not find the live message" << endl;
+            return 1;
+        }
+    }
+    
+    cout << "\n✓ Seeks by time land on the first matching entry" << endl;
+
+    // ========================================================================
+    // Test 26: Mediator Pattern - Hybrid Fan-out for Large Rooms
+    // ========================================================================
+    printSection("Test 26: Mediator Pattern - Hybrid Fan-out for Large Rooms");
+    
+    cout << "Above the threshold a send is written once and members pull it\n" << endl;
+    
+    {
+        struct CountingUser : public Users {
+            size_t received;
+            explicit CountingUser(const string& userName) : Users(userName), received(0) {}
+            void receive(string message, Users* fromUser, ChatRoom* room) override {
+                received++;
+                Users::receive(message, fromUser, room);
+            }
+        };
+        
+        Dogorithm lobby;
+        lobby.setFanoutThreshold(3);
+        CountingUser host("Host");
+        CountingUser early("Early");
+        CountingUser idle("Idle");
+        lobby.registerUser(&host);
+        lobby.registerUser(&early);
+        lobby.registerUser(&idle);
+        
+        // Three members: still at the threshold, so the send is pushed
+        host.send("Welcome, small crowd", &lobby);
+        bool pushed = early.received == 1 && idle.received == 1;
+        
+        CountingUser late("Late");
+        lobby.registerUser(&late);
+        host.send("The room got big", &lobby);
+        early.send("Hello from Early", &lobby);
+        bool deferred = early.received == 1 && idle.received == 1 && late.received == 0 &&
+                        lobby.getChatHistory().size() == 3 && lobby.pendingFor(&idle) == 2;
+        
+        // Early becomes active: it pulls the host's message but not its own
+        size_t earlyPulled = early.catchUp(&lobby);
+        size_t idlePulled = idle.catchUp(&lobby);
+        size_t pulledAgain = idle.catchUp(&lobby);
+        size_t latePulled = late.catchUp(&lobby);
+        
+        cout << "Early pulled " << earlyPulled << ", Idle pulled " << idlePulled
+             << ", Late pulled " << latePulled << endl;
+        if (!pushed || !deferred || earlyPulled != 1 || idlePulled != 2 || pulledAgain != 0 ||
+            latePulled != 2 || early.received != 2 || idle.received != 3 || lobby.pendingFor(&idle) != 0) {
+            cout << "✗ Hybrid delivery sent the wrong messages" << endl;
+            return 1;
+        }
+        
+        // Joining after a publish does not pull the backlog
+        CountingUser newcomer("Newcomer");
+        lobby.registerUser(&newcomer);
+        if (newcomer.catchUp(&lobby) != 0) {
+            cout << "✗ A new member received messages from before it joined" << endl;
+            return 1;
+        }
+    }
+    
+    cout << "\n✓ Large rooms deliver on read, small rooms still push" << endl;
+
+    // ========================================================================
+    // Test 27: Observer Pattern - Streaming Room Analytics
+    // ========================================================================
+    printSection("Test 27: Observer Pattern - Streaming Room Analytics");
+    
+    cout << "Fixed-size sketches updated on every join, leave, save and notify\n" << endl;
+    
+    {
+        // Sketch accuracy on a known stream: 10 s of traffic from 500 senders,
+        // one of whom sends a third of all messages, sizes uniform in 1..1000
+        vector<Users*> crowd;
+        for (int i = 0; i < 500; i++) {
+            crowd.push_back(new Users("Fan" + to_string(i)));
+        }
+        RoomAnalytics stream;
+        const int64_t second = 1000000000;
+        const int64_t base = 1000 * second;
+        const int total = 30000;
+        uint64_t heaviest = 0;
+        for (int i = 0; i < total; i++) {
+            Users* sender = i % 3 == 0 ? crowd[0] : crowd[(i * 7919) % 500];
+            heaviest += sender == crowd[0];
+            stream.recordMessage(sender->getIdentity(), 1 + (i * 104729LL) % 1000, base + i * (10 * second / total));
+        }
+        stream.flush();
+        
+        double rate = stream.messageRate(10, base + 10 * second - 1);
+        double distinct = stream.distinctSenders();
+        double median = stream.sizeQuantile(0.5);
+        double p99 = stream.sizeQuantile(0.99);
+        vector<SenderCount> top = stream.topSenders();
+        cout << "rate " << rate << "/s, distinct ~" << static_cast<int>(distinct) << ", p50 " << median
+             << " B, p99 " << p99 << " B, top sender " << top[0].sender->getName() << endl;
+        bool accurate = rate == total / 10.0 && distinct > 460 && distinct < 540 &&
+                        median > 480 && median < 520 && p99 > 980 && p99 <= 1000 &&
+                        top[0].sender == crowd[0]->getIdentity() && top[0].count - top[0].error <= heaviest &&
+                        top[0].count >= heaviest && stream.memoryBytes() < 16384;
+        for (Users* user : crowd) {
+            delete user;
+        }
+        
+        // A user created at a departed sender's address is a different sender
+        RoomAnalytics turnover;
+        Users* departed = new Users("Departed");
+        turnover.recordMessage(departed->getIdentity(), 10, base);
+        turnover.recordMessage(departed->getIdentity(), 10, base);
+        delete departed;
+        Users* arrival = new Users("Arrival");
+        turnover.recordMessage(arrival->getIdentity(), 10, base);
+        vector<SenderCount> turnoverTop = turnover.topSenders();
+        bool separate = turnoverTop.size() == 2 && turnoverTop[0].count == 2 &&
+                        turnoverTop[0].sender->getName() == "Departed" && turnoverTop[0].sender->getUser() == nullptr &&
+                        turnoverTop[1].sender->getUser() == arrival && turnover.distinctSenders() > 1.9;
+        delete arrival;
+        
+        if (!accurate) {
+            cout << "✗ Sketch estimates out of tolerance" << endl;
+            return 1;
+        }
+        if (!separate) {
+            cout << "✗ Analytics merged two senders that shared an address" << endl;
+            return 1;
+        }
+        
+        // Wired into a room: queries run on another thread while it saves
+        CtrlCat observed;
+        RoomAnalytics& stats = observed.enableAnalytics();
+        Users chatty("Chatty");
+        Users quiet("Quiet");
+        observed.registerUser(&chatty);
+        observed.registerUser(&quiet);
+        
+        atomic<bool> done(false);
+        uint64_t lastSeen = 0;
+        bool monotonic = true;
+        thread dashboard([&]() {
+            while (!done) {
+                AnalyticsSnapshot view = observed.getAnalytics()->getSnapshot();
+                monotonic = monotonic && view.messages >= lastSeen;
+                lastSeen = view.messages;
+            }
+        });
+        cout.setstate(ios::badbit);
+        for (int i = 0; i < 2000; i++) {
+            (i % 4 ? chatty : quiet).send("message " + to_string(i), &observed);
+        }
+        cout.clear();
+        done = true;
+        dashboard.join();
+        observed.removeUser(&quiet);
+        
+        AnalyticsSnapshot view = stats.getSnapshot();
+        cout << "CtrlCat: " << view.messages << " messages, " << view.joins << " joins, " << view.leaves
+             << " leaves, " << view.notifications << " notifications, top sender "
+             << view.topSenders[0].sender->getName() << " (" << view.topSenders[0].count << ")" << endl;
+        if (!monotonic || view.messages != 2000 || view.joins != 2 || view.leaves != 1 ||
+            view.notifications != 3 || view.topSenders[0].sender != chatty.getIdentity() ||
+            view.topSenders[0].count != 1500 || view.distinctSenders < 1.9 || view.distinctSenders > 2.1) {
+            cout << "✗ Room analytics missed events" << endl;
+            return 1;
+        }
+    }
+    
+    cout << "\n✓ Room statistics without scanning history or members" << endl;
+
+    // ========================================================================
+    // Test 28: Mediator Pattern - Multi-Room Broadcast
+    // ========================================================================
+    printSection("Test 28: Mediator Pattern - Multi-Room Broadcast");
+    
+    cout << "One payload, one delivery per distinct member, one save per room\n" << endl;
+    
+    {
+        struct CountingUser : public Users {
+            size_t received;
+            explicit CountingUser(const string& userName) : Users(userName), received(0) {}
+            void receive(string message, Users* fromUser, ChatRoom* room) override {
+                received++;
+                Users::receive(message, fromUser, room);
+            }
+        };
+        
+        CtrlCat cats;
+        Dogorithm dogs;
+        CtrlCat annex;
+        CountingUser herald("Herald");
+        CountingUser both("Both");
+        CountingUser catsOnly("CatsOnly");
+        CountingUser everywhere("Everywhere");
+        for (ChatRoom* room : vector<ChatRoom*>{&cats, &dogs, &annex}) {
+            room->registerUser(&herald);
+            room->registerUser(&everywhere);
+        }
+        cats.registerUser(&both);
+        dogs.registerUser(&both);
+        cats.registerUser(&catsOnly);
+        
+        size_t posted = herald.broadcastToAllRooms("Adoption day on Saturday!");
+        bool merged = posted == 3 && both.received == 1 && catsOnly.received == 1 &&
+                      everywhere.received == 1 && herald.received == 0 &&
+                      cats.getChatHistory().size() == 1 && dogs.getChatHistory().size() == 1 &&
+                      annex.getChatHistory().size() == 1;
+        
+        // Filters still apply per room: rejected rooms are skipped, rewritten
+        // rooms get their own version
+        ModerationFilter noDates(vector<string>{"saturday"});
+        ModerationFilter maskDates(vector<string>{"saturday"}, ModerationFilter::REDACT);
+        annex.addFilter(&noDates);
+        dogs.addFilter(&maskDates);
+        posted = herald.broadcast("Moved to Saturday", vector<ChatRoom*>{&cats, &dogs, &annex, &cats});
+        annex.removeFilter(&noDates);
+        dogs.removeFilter(&maskDates);
+        
+        cout << "Both received " << both.received << ", Everywhere received " << everywhere.received << endl;
+        if (!merged || posted != 2 || annex.getChatHistory().size() != 1 ||
+            dogs.getChatHistory().payload(1) != "Moved to ********" ||
+            cats.getChatHistory().payload(1) != "Moved to Saturday" ||
+            both.received != 3 || everywhere.received != 3) {
+            cout << "✗ Broadcast delivered duplicates or ignored a filter" << endl;
+            return 1;
+        }
+        
+        // A rewritten version for a pull room is published, not pushed
+        dogs.setFanoutThreshold(1);
+        dogs.addFilter(&maskDates);
+        herald.broadcast("Saturday it is", vector<ChatRoom*>{&dogs});
+        dogs.removeFilter(&maskDates);
+        bool published = both.received == 3 && dogs.pendingFor(&both) == 1 &&
+                         dogs.getChatHistory().payload(2) == "******** it is";
+        dogs.setFanoutThreshold(SIZE_MAX);
+        
+        // A member that broadcasts from receive() must not reset the outer fan-out
+        struct EchoUser : public CountingUser {
+            vector<ChatRoom*> echoRooms;
+            explicit EchoUser(const string& userName) : CountingUser(userName) {}
+            void receive(string message, Users* fromUser, ChatRoom* room) override {
+                CountingUser::receive(message, fromUser, room);
+                if (received == 1) {
+                    broadcast("Echo: " + message, echoRooms);
+                }
+            }
+        };
+        CtrlCat upstairs;
+        CtrlCat downstairs;
+        CountingUser caller("Caller");
+        EchoUser echo("Echo");
+        CountingUser listener("Listener");
+        echo.echoRooms = vector<ChatRoom*>{&upstairs, &downstairs};
+        for (ChatRoom* room : echo.echoRooms) {
+            room->registerUser(&caller);
+            room->registerUser(&echo);
+            room->registerUser(&listener);
+        }
+        caller.broadcast("Anyone home?", echo.echoRooms);
+        if (!published || echo.received != 1 || listener.received != 2 || caller.received != 1) {
+            cout << "✗ Rewritten pull room was pushed or a nested broadcast leaked" << endl;
+            return 1;
+        }
+        
+        // A shared controller admits the whole broadcast once: one token, one slot
+        AdmissionController::Config oneAtATime;
+        oneAtATime.userRate = 1;
+        oneAtATime.userBurst = 1;
+        oneAtATime.maxInFlight = 1;
+        oneAtATime.policy = AdmissionController::QUEUE;
+        AdmissionController sharedGate(oneAtATime);
+        CtrlCat north;
+        CtrlCat south;
+        Dogorithm west;
+        CountingUser crier("Crier");
+        CountingUser roamer("Roamer");
+        vector<ChatRoom*> gated{&north, &south, &west};
+        for (ChatRoom* room : gated) {
+            room->registerUser(&crier);
+            room->registerUser(&roamer);
+            room->setAdmissionController(&sharedGate);
+        }
+        size_t gatedPosted = crier.broadcast("Town meeting at noon", gated);
+        size_t againPosted = crier.broadcast("Town meeting moved", gated);
+        size_t parkedBroadcasts = sharedGate.getQueuedCount();
+        for (ChatRoom* room : gated) {
+            room->setAdmissionController(nullptr);
+        }
+        if (gatedPosted != 3 || againPosted != 0 || parkedBroadcasts != 0 || roamer.received != 1 ||
+            sharedGate.getStats().admitted != 1 || west.getChatHistory().size() != 1) {
+            cout << "✗ Broadcast was admitted per room instead of once per controller" << endl;
+            return 1;
+        }
+    }
+    
+    cout << "\n✓ Members of several rooms receive a broadcast once" << endl;
+
+    // ========================================================================
+    // Test 29: Observer Pattern - Trace Record and Playback
+    // ========================================================================
+    printSection("Test 29: Observer Pattern - Trace Record and Playback");
+    
+    cout << "Record room activity to a trace, then replay it on fresh rooms\n" << endl;
+    
+    {
+        const string tracePath = "test_session.trace";
+        size_t savedCats = 0;
+        size_t savedDogs = 0;
+        size_t membersLeft = 0;
+        {
+            TraceRecorder recorder(tracePath);
+            CtrlCat cats;
+            Dogorithm dogs;
+            cats.setTraceRecorder(&recorder);
+            dogs.setTraceRecorder(&recorder);
+            Users alice("Alice");
+            Users bob("Bob");
+            Users carol("Carol");
+            
+            cats.registerUser(&alice);
+            cats.registerUser(&bob);
+            dogs.registerUser(&bob);
+            dogs.registerUser(&carol);
+            cats.subscribe(&alice);
+            alice.send("Anyone seen my laser pointer?", &cats);
+            bob.send("Check under the couch", &cats);
+            carol.send("Walk at 5?", &dogs);
+            dogs.notify("Park closes early today", dogs.getRoomName());
+            alice.sendDirect("Found it, thanks", &bob, &cats, 7);
+            alice.sendDirect("Found it, thanks", &bob, &cats, 7);   // retry: not recorded
+            bob.broadcast("Treats for everyone", vector<ChatRoom*>{&cats, &dogs});
+            cats.unsubscribe(&alice);
+            cats.removeUser(&bob);
+            bob.send("Count me in", &dogs);
+            
+            savedCats = cats.getChatHistory().size();
+            savedDogs = dogs.getChatHistory().size();
+            membersLeft = cats.getUsers().size() + dogs.getUsers().size();
+            cats.setTraceRecorder(nullptr);
+            dogs.setTraceRecorder(nullptr);
+            if (!recorder.isOpen() || recorder.getRecordCount() != 14) {
+                cout << "✗ Recorder captured " << recorder.getRecordCount() << " operations" << endl;
+                return 1;
+            }
+        }
+        
+        TracePlayer player;
+        bool loaded = player.load(tracePath);
+        bool counted = loaded && player.roomCount() == 2 && player.userCount() == 3 &&
+                       player.count(TraceOp::JOIN) == 4 && player.count(TraceOp::LEAVE) == 1 &&
+                       player.count(TraceOp::SUBSCRIBE) == 1 && player.count(TraceOp::UNSUBSCRIBE) == 1 &&
+                       player.count(TraceOp::SEND) == 4 && player.count(TraceOp::NOTIFY) == 1 &&
+                       player.count(TraceOp::SEND_TARGETED) == 1 && player.count(TraceOp::BROADCAST) == 1;
+        for (const TraceOp& entry : player.getOperations()) {
+            if (entry.op == TraceOp::SEND_TARGETED) {
+                counted = counted && entry.messageId == 7 && entry.targets.size() == 1;
+            }
+        }
+        cout << "Trace: " << player.getOperations().size() << " operations, "
+             << player.roomCount() << " rooms, " << player.userCount() << " users" << endl;
+        
+        // Playback prints the rooms' chatter; keep the test log readable
+        PlaybackOptions options;
+        cout.setstate(ios::badbit);
+        PlaybackStats single = player.play(options);
+        options.threads = 2;
+        PlaybackStats split = player.play(options);
+        options.threads = 1;
+        options.originalTiming = true;
+        options.speed = 1000.0;
+        PlaybackStats timed = player.play(options);
+        cout.clear();
+        
+        bool truncated = player.parse(string(TRACE_MAGIC, sizeof(TRACE_MAGIC)) + "\x06\x00\x00");
+        remove(tracePath.c_str());
+        
+        size_t saved = savedCats + savedDogs;
+        cout << "Replayed " << single.operations << " operations: " << single.messagesSaved
+             << " messages saved (recorded " << saved << ")" << endl;
+        if (!counted || single.messagesSaved != saved || single.finalMembers != membersLeft ||
+            split.messagesSaved != saved || split.finalMembers != membersLeft || split.sends != 6 ||
+            timed.messagesSaved != saved || truncated) {
+            cout << "✗ Replay diverged from the recorded session" << endl;
+            return 1;
+        }
+    }
+    
+    cout << "\n✓ A recorded trace replays to the same rooms and histories" << endl;
+
+    // ========================================================================
+    // Test 30: Observer Pattern - Memory Accounting per Room and User
+    // ========================================================================
+    printSection("Test 30: Observer Pattern - Memory Accounting per Room and User");
+    
+    cout << "Tracked containers charge their owner's account by category\n" << endl;
+    
+    {
+        size_t accountsBefore = MemoryRegistry::accountCount();
+        bool ledgersMatch = true;
+        {
+            CtrlCat lounge;
+            Users quiet("Quiet");
+            Users chatty("Chatty");
+            MemoryAccount& room = lounge.getMemoryAccount();
+            MemoryAccount& listener = quiet.getMemoryAccount();
+            
+            lounge.registerUser(&quiet);
+            lounge.registerUser(&chatty);
+            lounge.subscribe(&quiet);
+            for (int i = 0; i < 300; i++) {
+                chatty.send("Message number " + to_string(i) + " from a rather talkative member of the lounge", &lounge);
+            }
+            lounge.notify("Lounge closes at midnight", lounge.getRoomName());
+            
+            ledgersMatch = room.getObjects(MEM_MEMBERS) == 2 && room.getBytes(MEM_MEMBERS) > 0 &&
+                           room.getObjects(MEM_OBSERVERS) == static_cast<int64_t>(lounge.getObservers().size()) &&
+                           room.getBytes(MEM_OBSERVERS) >= static_cast<int64_t>(lounge.getObservers().size() * sizeof(Observer*)) &&
+                           room.getObjects(MEM_HISTORY) == 300 &&
+                           room.getBytes(MEM_HISTORY) == static_cast<int64_t>(lounge.getChatHistory().storedBytes()) &&
+                           listener.getObjects(MEM_NOTIFICATIONS) == static_cast<int64_t>(quiet.getNotifications().size()) &&
+                           listener.getBytes(MEM_NOTIFICATIONS) > 0;
+            cout << "Lounge: " << room.totalBytes() << " bytes (history " << room.getBytes(MEM_HISTORY)
+                 << ", members " << room.getBytes(MEM_MEMBERS) << ", observers " << room.getBytes(MEM_OBSERVERS)
+                 << "); Quiet: " << listener.getBytes(MEM_NOTIFICATIONS) << " bytes of notifications" << endl;
+            
+            // The report ranks owners; a quota flags the room without enforcing anything
+            room.setQuota(1024);
+            MemoryReport snapshot = MemoryRegistry::report(3);
+            bool listed = false;
+            for (const MemoryUsage& usage : snapshot.overQuota) {
+                listed = listed || usage.id == room.getId();
+            }
+            ledgersMatch = ledgersMatch && listed && !snapshot.topRooms.empty() &&
+                           snapshot.topRooms[0].totalBytes() >= room.totalBytes() &&
+                           snapshot.bytes[MEM_HISTORY] >= room.getBytes(MEM_HISTORY);
+            
+            // Periodic dumps are tick-driven
+            FILE* dump = tmpfile();
+            MemoryRegistry::setPeriodicDump(dump, 1000, 3);
+            bool dumps = MemoryRegistry::tick(0) && !MemoryRegistry::tick(500) && MemoryRegistry::tick(1000);
+            MemoryRegistry::setPeriodicDump(nullptr, 0);
+            dumps = dumps && !MemoryRegistry::tick(5000) && ftell(dump) > 0;
+            fclose(dump);
+            
+            lounge.removeUser(&quiet);
+            lounge.removeUser(&chatty);
+            quiet.clearNotifications();
+            ledgersMatch = ledgersMatch && dumps && listener.getBytes(MEM_NOTIFICATIONS) == 0 &&
+                           listener.getObjects(MEM_NOTIFICATIONS) == 0 && room.getObjects(MEM_MEMBERS) == 0;
+        }
+        
+        // Sampling charges few allocations but keeps the total unbiased
+        const size_t population = 5000;
+        int64_t totals[2] = { 0, 0 };
+        for (int pass = 0; pass < 2; pass++) {
+            MemoryRegistry::setSamplePeriod(pass == 0 ? 1 : 4096);
+            vector<Users*> crowd;
+            for (size_t i = 0; i < population; i++) {
+                crowd.push_back(new Users("Crowd" + to_string(i)));
+                crowd.back()->update("A notification long enough to need its own buffer", "Plaza");
+                crowd.back()->update("Another notification, also far too long for SSO", "Plaza");
+                totals[pass] += crowd.back()->getMemoryAccount().getBytes(MEM_NOTIFICATIONS);
+            }
+            for (Users* user : crowd) {
+                delete user;
+            }
+        }
+        
+        // One user's buffers are freed and reallocated at the same addresses;
+        // the estimate must still average out, and every free must undo its charge
+        const int cycles = 4000;
+        int64_t churned[2] = { 0, 0 };
+        bool drained = true;
+        for (int pass = 0; pass < 2; pass++) {
+            MemoryRegistry::setSamplePeriod(pass == 0 ? 1 : 4096);
+            Users churner("Churner");
+            for (int i = 0; i < cycles; i++) {
+                churner.update("A notification long enough to need its own buffer", "Plaza");
+                churner.update("Another notification, also far too long for SSO", "Plaza");
+                churned[pass] += churner.getMemoryAccount().getBytes(MEM_NOTIFICATIONS);
+                churner.clearNotifications();
+                drained = drained && churner.getMemoryAccount().getBytes(MEM_NOTIFICATIONS) == 0;
+            }
+        }
+        MemoryRegistry::setSamplePeriod(1);
+        double ratio = static_cast<double>(totals[1]) / totals[0];
+        double churnRatio = static_cast<double>(churned[1]) / churned[0];
+        cout << "Notifications of " << population << " users: " << totals[0] << " bytes exact, "
+             << totals[1] << " bytes sampled" << endl;
+        cout << "Same buffers reused " << cycles << " times: " << churned[0] << " bytes exact, "
+             << churned[1] << " bytes sampled" << endl;
+        
+        if (!ledgersMatch || MemoryRegistry::accountCount() != accountsBefore || ratio < 0.75 || ratio > 1.25 ||
+            churnRatio < 0.75 || churnRatio > 1.25 || !drained) {
+            cout << "✗ Memory accounts disagree with the containers they track" << endl;
+            return 1;
+        }
+    }
+    
+    cout << "\n✓ Rooms and users report what they hold, exactly or by sampling" << endl;
+
     // ========================================================================
     // Pattern Summary
     // ========================================================================
@@ -273,11 +1701,13 @@ int main() {
     cout << "  - SendMessageCommand & LogMessageCommand encapsulate actions" << endl;
     cout << "  - Users (Invokers) create and execute commands" << endl;
     cout << "  - Commands queued and executed in sequence" << endl;
+    cout << "  - DeliveryScheduler reorders queued commands by priority" << endl;
     
     cout << "\n✓ ITERATOR Pattern:" << endl;
     cout << "  - UserListIterator traverses room members" << endl;
     cout << "  - ChatHistoryIterator traverses message history" << endl;
     cout << "  - Hides internal storage, supports reset()" << endl;
+    cout << "  - Value-type cursors support range-for and batch fetches" << endl;
     
     cout << "\n✓ OBSERVER Pattern:" << endl;
     cout << "  - ChatRoom is Subject, Users are Observers" << endl;
@@ -293,6 +1723,7 @@ int main() {
     delete bob;
     delete charlie;
     delete diana;
+    delete eve;
     delete ctrlCat;
     delete dogorithm;
     
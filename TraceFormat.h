@@ -0,0 +1,101 @@
+/**
+ * @file TraceFormat.h
+ * @brief Binary encoding of recorded ChatRoom/Users operations
+ */
+
+#ifndef TRACEFORMAT_H
+#define TRACEFORMAT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @struct TraceOp
+ * @brief One recorded operation, as decoded by TracePlayer
+ *
+ * On disk a trace is TRACE_MAGIC followed by records of the form
+ *   op (1 byte), microseconds since the previous record (varint),
+ *   then the fields the op uses: room and user IDs (varints), text
+ *   (varint length + bytes), the client message ID (varint, 0 if none)
+ *   and a target list (varint count + IDs: recipients of a targeted
+ *   send, the other rooms of a broadcast).
+ * Rooms and users are numbered in order of first appearance; a DEFINE
+ * record carrying the room type or user name precedes the first use.
+ */
+struct TraceOp
+{
+    enum Op
+    {
+        DEFINE_ROOM,  // room, text: room type
+        DEFINE_USER,  // user, text: display name
+        JOIN,         // room, user
+        LEAVE,        // room, user
+        SUBSCRIBE,    // room, user
+        UNSUBSCRIBE,  // room, user
+        SEND,         // room, user, text: message
+        NOTIFY,       // room, text: notification
+        SEND_TARGETED,// room, user, text, message ID, targets: recipient users
+        BROADCAST,    // room (the first), user, text, targets: the other rooms
+        OP_COUNT
+    };
+
+    uint8_t op;
+    int64_t timeUs;   // since the first record
+    uint32_t room;
+    uint32_t user;
+    string text;
+    uint64_t messageId;
+    vector<uint32_t> targets;
+
+    bool hasRoom() const { return op != DEFINE_USER; }
+    bool hasUser() const { return op != DEFINE_ROOM && op != NOTIFY; }
+    bool hasText() const { return op != JOIN && op != LEAVE && op != SUBSCRIBE && op != UNSUBSCRIBE; }
+    bool hasMessageId() const { return op == SEND || op == SEND_TARGETED; }
+    bool hasTargets() const { return op == SEND_TARGETED || op == BROADCAST; }
+    bool isSend() const { return op == SEND || op == SEND_TARGETED || op == BROADCAST; }
+};
+
+static const char TRACE_MAGIC[8] = { 'P', 'S', 'T', 'R', 'A', 'C', 'E', '2' };
+
+/**
+ * @brief Append an unsigned LEB128 varint
+ * @param out Destination buffer
+ * @param value The value
+ */
+inline void putVarint(string& out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+/**
+ * @brief Read an unsigned LEB128 varint
+ * @param in Source bytes
+ * @param pos Read position, advanced past the varint
+ * @param end End of the source
+ * @param value Receives the value
+ * @return false if the input ended or the varint is too long
+ */
+inline bool getVarint(const char* in, size_t& pos, size_t end, uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64 && pos < end; shift += 7)
+    {
+        uint8_t byte = static_cast<uint8_t>(in[pos++]);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
@@ -0,0 +1,326 @@
+/**
+ * @file TracePlayer.cpp
+ * @brief Trace decoding and the playback driver
+ */
+
+#include "TracePlayer.h"
+#include "ChatRoom.h"
+#include "CtrlCat.h"
+#include "Dogorithm.h"
+#include "Users.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+using namespace std;
+
+typedef chrono::steady_clock PlaybackClock;
+
+namespace {
+
+ChatRoom* makeRoom(const string& type)
+{
+    // Unknown types (e.g. federated rooms) replay as local rooms
+    if (type == "Dogorithm")
+    {
+        return new Dogorithm();
+    }
+    return new CtrlCat();
+}
+
+} // namespace
+
+bool TracePlayer::load(const string& path)
+{
+    ifstream in(path.c_str(), ios::binary);
+    if (!in)
+    {
+        return false;
+    }
+    string bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    return parse(bytes);
+}
+
+bool TracePlayer::parse(const string& bytes)
+{
+    operations.clear();
+    roomTypes.clear();
+    userNames.clear();
+    if (bytes.size() < sizeof(TRACE_MAGIC) || memcmp(bytes.data(), TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0)
+    {
+        return false;
+    }
+
+    const char* in = bytes.data();
+    size_t pos = sizeof(TRACE_MAGIC);
+    size_t end = bytes.size();
+    int64_t timeUs = 0;
+    while (pos < end)
+    {
+        TraceOp entry;
+        entry.op = static_cast<uint8_t>(in[pos++]);
+        entry.room = 0;
+        entry.user = 0;
+        entry.messageId = 0;
+        uint64_t delta;
+        uint64_t room = 0;
+        uint64_t user = 0;
+        if (entry.op >= TraceOp::OP_COUNT || !getVarint(in, pos, end, delta) ||
+            (entry.hasRoom() && !getVarint(in, pos, end, room)) ||
+            (entry.hasUser() && !getVarint(in, pos, end, user)))
+        {
+            return false;
+        }
+        if (entry.hasText())
+        {
+            uint64_t length;
+            if (!getVarint(in, pos, end, length) || length > end - pos)
+            {
+                return false;
+            }
+            entry.text.assign(in + pos, length);
+            pos += length;
+        }
+        if (entry.hasMessageId() && !getVarint(in, pos, end, entry.messageId))
+        {
+            return false;
+        }
+        if (entry.hasTargets())
+        {
+            uint64_t targetCount;
+            if (!getVarint(in, pos, end, targetCount) || targetCount > end - pos)
+            {
+                return false;
+            }
+            size_t known = entry.op == TraceOp::BROADCAST ? roomTypes.size() : userNames.size();
+            for (uint64_t i = 0; i < targetCount; i++)
+            {
+                uint64_t target;
+                if (!getVarint(in, pos, end, target) || target >= known)
+                {
+                    return false;
+                }
+                entry.targets.push_back(static_cast<uint32_t>(target));
+            }
+        }
+        timeUs += static_cast<int64_t>(delta);
+        entry.timeUs = timeUs;
+        entry.room = static_cast<uint32_t>(room);
+        entry.user = static_cast<uint32_t>(user);
+
+        if (entry.op == TraceOp::DEFINE_ROOM)
+        {
+            if (room >= roomTypes.size())
+            {
+                roomTypes.resize(room + 1);
+            }
+            roomTypes[room] = entry.text;
+            continue;
+        }
+        if (entry.op == TraceOp::DEFINE_USER)
+        {
+            if (user >= userNames.size())
+            {
+                userNames.resize(user + 1);
+            }
+            userNames[user] = entry.text;
+            continue;
+        }
+        if (room >= roomTypes.size() || (entry.hasUser() && user >= userNames.size()))
+        {
+            return false; // used before being defined
+        }
+        operations.push_back(entry);
+    }
+    return true;
+}
+
+size_t TracePlayer::count(TraceOp::Op op) const
+{
+    size_t n = 0;
+    for (const TraceOp& entry : operations)
+    {
+        n += entry.op == op;
+    }
+    return n;
+}
+
+PlaybackStats TracePlayer::play(const PlaybackOptions& options) const
+{
+    PlaybackOptions effective = options;
+    effective.threads = max(1, min(options.threads, static_cast<int>(max<size_t>(roomTypes.size(), 1))));
+    if (effective.speed <= 0)
+    {
+        effective.speed = 1.0;
+    }
+
+    vector<PlaybackStats> partitions(effective.threads);
+    PlaybackClock::time_point start = PlaybackClock::now();
+    if (effective.threads == 1)
+    {
+        playPartition(effective, 0, partitions[0]);
+    }
+    else
+    {
+        vector<thread> pool;
+        for (int i = 0; i < effective.threads; i++)
+        {
+            pool.push_back(thread(&TracePlayer::playPartition, this, cref(effective), i, ref(partitions[i])));
+        }
+        for (thread& worker : pool)
+        {
+            worker.join();
+        }
+    }
+
+    PlaybackStats total = PlaybackStats();
+    for (const PlaybackStats& part : partitions)
+    {
+        total.operations += part.operations;
+        total.sends += part.sends;
+        total.messagesSaved += part.messagesSaved;
+        total.finalMembers += part.finalMembers;
+        total.maxLagUs = max(total.maxLagUs, part.maxLagUs);
+    }
+    total.elapsedSeconds = chrono::duration<double>(PlaybackClock::now() - start).count();
+    return total;
+}
+
+Users* TracePlayer::replicaOf(vector<Users*>& replicas, uint32_t user) const
+{
+    Users*& replica = replicas[user];
+    if (!replica)
+    {
+        replica = new Users(userNames[user]);
+    }
+    return replica;
+}
+
+void TracePlayer::playPartition(const PlaybackOptions& options, int partition, PlaybackStats& stats) const
+{
+    stats = PlaybackStats();
+    vector<ChatRoom*> rooms(roomTypes.size(), nullptr);
+    for (size_t i = 0; i < roomTypes.size(); i++)
+    {
+        if (static_cast<int>(i % options.threads) == partition)
+        {
+            rooms[i] = makeRoom(roomTypes[i]);
+        }
+    }
+    vector<Users*> replicas(userNames.size(), nullptr);
+
+    PlaybackClock::time_point start = PlaybackClock::now();
+    for (const TraceOp& entry : operations)
+    {
+        ChatRoom* room = rooms[entry.room];
+        // A broadcast is replayed by every thread that owns one of its rooms,
+        // each over its own rooms
+        vector<ChatRoom*> broadcastRooms;
+        if (entry.op == TraceOp::BROADCAST)
+        {
+            if (room)
+            {
+                broadcastRooms.push_back(room);
+            }
+            for (uint32_t target : entry.targets)
+            {
+                if (rooms[target])
+                {
+                    broadcastRooms.push_back(rooms[target]);
+                }
+            }
+            room = broadcastRooms.empty() ? nullptr : broadcastRooms.front();
+        }
+        if (!room)
+        {
+            continue; // another thread's room
+        }
+        if (options.originalTiming)
+        {
+            PlaybackClock::time_point due =
+                start + chrono::microseconds(static_cast<int64_t>(entry.timeUs / options.speed));
+            PlaybackClock::time_point now = PlaybackClock::now();
+            if (now < due)
+            {
+                this_thread::sleep_until(due);
+            }
+            else
+            {
+                stats.maxLagUs = max(stats.maxLagUs, chrono::duration<double, micro>(now - due).count());
+            }
+        }
+
+        Users* user = nullptr;
+        if (entry.hasUser())
+        {
+            user = replicaOf(replicas, entry.user);
+        }
+
+        switch (entry.op)
+        {
+        case TraceOp::JOIN:
+            room->registerUser(user);
+            break;
+        case TraceOp::LEAVE:
+            room->removeUser(user);
+            break;
+        case TraceOp::SUBSCRIBE:
+            room->subscribe(user);
+            break;
+        case TraceOp::UNSUBSCRIBE:
+            room->unsubscribe(user);
+            break;
+        case TraceOp::SEND:
+            user->send(entry.text, room, entry.messageId);
+            stats.sends++;
+            break;
+        case TraceOp::SEND_TARGETED:
+        {
+            vector<Users*> recipients;
+            for (uint32_t target : entry.targets)
+            {
+                recipients.push_back(replicaOf(replicas, target));
+            }
+            if (recipients.size() == 1)
+            {
+                user->sendDirect(entry.text, recipients.front(), room, entry.messageId);
+            }
+            else
+            {
+                user->sendToUsers(entry.text, recipients, room, entry.messageId);
+            }
+            stats.sends++;
+            break;
+        }
+        case TraceOp::BROADCAST:
+            user->broadcast(entry.text, broadcastRooms);
+            if (!rooms[entry.room])
+            {
+                continue; // counted once, by the thread owning its first room
+            }
+            stats.sends++;
+            break;
+        case TraceOp::NOTIFY:
+            room->notify(entry.text, room->getRoomName());
+            break;
+        }
+        stats.operations++;
+    }
+
+    for (ChatRoom* room : rooms)
+    {
+        if (room)
+        {
+            stats.messagesSaved += room->getChatHistory().size();
+            stats.finalMembers += room->getUsers().size();
+            delete room;
+        }
+    }
+    for (Users* user : replicas)
+    {
+        delete user;
+    }
+}
@@ -0,0 +1,116 @@
+/**
+ * @file TracePlayer.h
+ * @brief Re-runs a recorded trace against freshly created rooms and users
+ */
+
+#ifndef TRACEPLAYER_H
+#define TRACEPLAYER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "TraceFormat.h"
+
+using namespace std;
+
+class Users;
+
+/**
+ * @struct PlaybackOptions
+ * @brief How a trace is replayed
+ */
+struct PlaybackOptions
+{
+    bool originalTiming;    // wait between operations as recorded (else full speed)
+    double speed;           // time scale for originalTiming: 2.0 replays twice as fast
+    int threads;            // rooms are split across this many threads
+
+    PlaybackOptions() : originalTiming(false), speed(1.0), threads(1) {}
+};
+
+/**
+ * @struct PlaybackStats
+ * @brief What a replay did and how long it took
+ */
+struct PlaybackStats
+{
+    uint64_t operations;
+    uint64_t sends;             // room, targeted and broadcast sends
+    uint64_t messagesSaved;     // history entries across the replayed rooms
+    uint64_t finalMembers;      // members across the replayed rooms at the end
+    double elapsedSeconds;
+    double maxLagUs;            // worst delay behind the recorded schedule
+
+    double operationsPerSecond() const {
+        return elapsedSeconds > 0 ? operations / elapsedSeconds : 0;
+    }
+};
+
+/**
+ * @class TracePlayer
+ * @brief Loads a trace written by TraceRecorder and replays it
+ *
+ * Each replay builds new rooms (by recorded type) and users (by recorded
+ * name), so a trace can be replayed any number of times against the
+ * current build. With several threads, rooms are dealt out round-robin
+ * and every thread replays its rooms' operations in recorded order.
+ * Users are not thread-safe, so each thread gets its own replica of every
+ * user it meets; a user's activity in rooms on different threads then
+ * runs in parallel, as it would against separate servers.
+ */
+class TracePlayer
+{
+public:
+    /**
+     * @brief Load a trace file
+     * @param path The trace
+     * @return false if the file is missing, not a trace, or truncated
+     */
+    bool load(const string& path);
+
+    /**
+     * @brief Load a trace from memory
+     * @param bytes The encoded trace
+     * @return false if the bytes are not a valid trace
+     */
+    bool parse(const string& bytes);
+
+    /**
+     * @brief Replay the loaded trace
+     * @param options Timing and threading
+     * @return Replay statistics
+     */
+    PlaybackStats play(const PlaybackOptions& options) const;
+
+    /**
+     * @brief Get the loaded operations (DEFINE records excluded)
+     * @return Operations in recorded order
+     */
+    const vector<TraceOp>& getOperations() const { return operations; }
+
+    /**
+     * @brief Count loaded operations of one kind
+     * @param op The operation kind
+     * @return Count
+     */
+    size_t count(TraceOp::Op op) const;
+
+    /**
+     * @brief Get the recorded time span
+     * @return Microseconds from the first to the last operation
+     */
+    int64_t durationUs() const { return operations.empty() ? 0 : operations.back().timeUs; }
+
+    size_t roomCount() const { return roomTypes.size(); }
+    size_t userCount() const { return userNames.size(); }
+
+private:
+    void playPartition(const PlaybackOptions& options, int partition, PlaybackStats& stats) const;
+    Users* replicaOf(vector<Users*>& replicas, uint32_t user) const;
+
+    vector<TraceOp> operations;
+    vector<string> roomTypes;
+    vector<string> userNames;
+};
+
+#endif
@@ -0,0 +1,211 @@
+/**
+ * @file TraceRecorder.cpp
+ * @brief Implementation of the binary trace recorder
+ */
+
+#include "TraceRecorder.h"
+#include "ChatRoom.h"
+#include "Users.h"
+#include "MessageVisibility.h"
+#include <chrono>
+
+using namespace std;
+
+TraceRecorder::TraceRecorder(const string& path)
+    : file(fopen(path.c_str(), "wb")), lastUs(-1), records(0), written(0), nextRoom(0), nextUser(0)
+{
+    buffer.reserve(FLUSH_BYTES + 256);
+    buffer.append(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    flush();
+    if (file)
+    {
+        fclose(file);
+    }
+}
+
+void TraceRecorder::beginRecord(TraceOp::Op op)
+{
+    int64_t now = chrono::duration_cast<chrono::microseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+    if (lastUs < 0)
+    {
+        lastUs = now;
+    }
+    buffer.push_back(static_cast<char>(op));
+    putVarint(buffer, static_cast<uint64_t>(now - lastUs));
+    lastUs = now;
+}
+
+void TraceRecorder::endRecord()
+{
+    records++;
+    if (buffer.size() >= FLUSH_BYTES)
+    {
+        writeOut();
+    }
+}
+
+uint32_t TraceRecorder::roomId(ChatRoom* room)
+{
+    unordered_map<ChatRoom*, uint32_t>::iterator it = rooms.find(room);
+    if (it != rooms.end())
+    {
+        return it->second;
+    }
+    uint32_t id = nextRoom++;
+    rooms[room] = id;
+    string type = room->getRoomName();
+    beginRecord(TraceOp::DEFINE_ROOM);
+    putVarint(buffer, id);
+    putVarint(buffer, type.size());
+    buffer.append(type);
+    return id;
+}
+
+uint32_t TraceRecorder::userId(Users* user)
+{
+    unordered_map<Users*, uint32_t>::iterator it = users.find(user);
+    if (it != users.end())
+    {
+        return it->second;
+    }
+    uint32_t id = nextUser++;
+    users[user] = id;
+    string name = user->getName();
+    beginRecord(TraceOp::DEFINE_USER);
+    putVarint(buffer, id);
+    putVarint(buffer, name.size());
+    buffer.append(name);
+    return id;
+}
+
+void TraceRecorder::recordMember(TraceOp::Op op, ChatRoom* room, Users* user)
+{
+    lock_guard<mutex> hold(lock);
+    // IDs first: a DEFINE record must precede the record that uses it
+    uint32_t roomIndex = roomId(room);
+    uint32_t userIndex = userId(user);
+    beginRecord(op);
+    putVarint(buffer, roomIndex);
+    putVarint(buffer, userIndex);
+    endRecord();
+}
+
+void TraceRecorder::recordSend(ChatRoom* room, Users* user, const string& message, uint64_t messageId)
+{
+    lock_guard<mutex> hold(lock);
+    uint32_t roomIndex = roomId(room);
+    uint32_t userIndex = userId(user);
+    beginRecord(TraceOp::SEND);
+    putVarint(buffer, roomIndex);
+    putVarint(buffer, userIndex);
+    putVarint(buffer, message.size());
+    buffer.append(message);
+    putVarint(buffer, messageId);
+    endRecord();
+}
+
+void TraceRecorder::recordTargeted(ChatRoom* room, Users* user, const string& message,
+                                   const MessageVisibility& visibility, uint64_t messageId)
+{
+    lock_guard<mutex> hold(lock);
+    uint32_t roomIndex = roomId(room);
+    uint32_t userIndex = userId(user);
+    vector<uint32_t> recipients;
+    for (Users* recipient : visibility.recipients)
+    {
+        recipients.push_back(userId(recipient));
+    }
+    beginRecord(TraceOp::SEND_TARGETED);
+    putVarint(buffer, roomIndex);
+    putVarint(buffer, userIndex);
+    putVarint(buffer, message.size());
+    buffer.append(message);
+    putVarint(buffer, messageId);
+    putVarint(buffer, recipients.size());
+    for (uint32_t recipient : recipients)
+    {
+        putVarint(buffer, recipient);
+    }
+    endRecord();
+}
+
+void TraceRecorder::recordBroadcast(const vector<ChatRoom*>& rooms, Users* user, const string& message)
+{
+    lock_guard<mutex> hold(lock);
+    vector<uint32_t> roomIndexes;
+    for (ChatRoom* room : rooms)
+    {
+        roomIndexes.push_back(roomId(room));
+    }
+    uint32_t userIndex = userId(user);
+    beginRecord(TraceOp::BROADCAST);
+    putVarint(buffer, roomIndexes.front());
+    putVarint(buffer, userIndex);
+    putVarint(buffer, message.size());
+    buffer.append(message);
+    putVarint(buffer, roomIndexes.size() - 1);
+    for (size_t i = 1; i < roomIndexes.size(); i++)
+    {
+        putVarint(buffer, roomIndexes[i]);
+    }
+    endRecord();
+}
+
+void TraceRecorder::recordNotify(ChatRoom* room, const string& message)
+{
+    lock_guard<mutex> hold(lock);
+    uint32_t roomIndex = roomId(room);
+    beginRecord(TraceOp::NOTIFY);
+    putVarint(buffer, roomIndex);
+    putVarint(buffer, message.size());
+    buffer.append(message);
+    endRecord();
+}
+
+void TraceRecorder::forgetUser(Users* user)
+{
+    lock_guard<mutex> hold(lock);
+    users.erase(user);
+}
+
+void TraceRecorder::forgetRoom(ChatRoom* room)
+{
+    lock_guard<mutex> hold(lock);
+    rooms.erase(room);
+}
+
+void TraceRecorder::writeOut()
+{
+    if (file && !buffer.empty())
+    {
+        written += fwrite(buffer.data(), 1, buffer.size(), file);
+    }
+    buffer.clear();
+}
+
+void TraceRecorder::flush()
+{
+    lock_guard<mutex> hold(lock);
+    writeOut();
+    if (file)
+    {
+        fflush(file);
+    }
+}
+
+uint64_t TraceRecorder::getRecordCount() const
+{
+    lock_guard<mutex> hold(lock);
+    return records;
+}
+
+uint64_t TraceRecorder::getBytesRecorded() const
+{
+    lock_guard<mutex> hold(lock);
+    return written + buffer.size();
+}
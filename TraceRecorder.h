@@ -0,0 +1,156 @@
+/**
+ * @file TraceRecorder.h
+ * @brief Captures ChatRoom/Users operations into a compact binary trace
+ */
+
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "TraceFormat.h"
+
+using namespace std;
+
+class ChatRoom;
+class Users;
+struct MessageVisibility;
+
+/**
+ * @class TraceRecorder
+ * @brief Appends operations to a trace file for later playback
+ *
+ * Attach one recorder to any number of rooms with
+ * ChatRoom::setTraceRecorder(). From then on the rooms report joins,
+ * leaves, subscriptions, sends and notifications. Sends are recorded once
+ * admitted (a shed send is not in the trace, a parked one is recorded when
+ * it is drained) and before filters, which playback runs again. Each record costs a
+ * few varints and a memcpy into a buffer that is written out every
+ * FLUSH_BYTES, so recording adds well under a microsecond per
+ * operation. Recording may happen from several threads (one lock per
+ * record).
+ *
+ * Rooms and users are identified by address while they are recorded and
+ * written as small IDs; forgetUser() and forgetRoom() retire the ID of a
+ * destroyed object so a new one at the same address gets its own.
+ */
+class TraceRecorder
+{
+public:
+    static const size_t FLUSH_BYTES = 64 * 1024;
+
+    /**
+     * @brief Create a trace file (truncated if it exists)
+     * @param path Output path
+     */
+    explicit TraceRecorder(const string& path);
+
+    /**
+     * @brief Flush and close the file
+     */
+    ~TraceRecorder();
+
+    /**
+     * @brief Check whether the file could be created
+     * @return true if recording works
+     */
+    bool isOpen() const { return file != nullptr; }
+
+    void recordJoin(ChatRoom* room, Users* user) { recordMember(TraceOp::JOIN, room, user); }
+    void recordLeave(ChatRoom* room, Users* user) { recordMember(TraceOp::LEAVE, room, user); }
+    void recordSubscribe(ChatRoom* room, Users* user) { recordMember(TraceOp::SUBSCRIBE, room, user); }
+    void recordUnsubscribe(ChatRoom* room, Users* user) { recordMember(TraceOp::UNSUBSCRIBE, room, user); }
+
+    /**
+     * @brief Record an admitted Users::send
+     * @param room The target room
+     * @param user The sender
+     * @param message The message as sent (before filters)
+     * @param messageId Client-supplied message ID (0 if none)
+     */
+    void recordSend(ChatRoom* room, Users* user, const string& message, uint64_t messageId);
+
+    /**
+     * @brief Record an admitted direct, group or tag send
+     * @param room The room sent through
+     * @param user The sender
+     * @param message The message as sent (before filters)
+     * @param visibility The resolved audience; a tag send is recorded with
+     *                   the users its tag resolved to and replays as a group send
+     * @param messageId Client-supplied message ID (0 if none)
+     */
+    void recordTargeted(ChatRoom* room, Users* user, const string& message, const MessageVisibility& visibility,
+                        uint64_t messageId);
+
+    /**
+     * @brief Record a Users::broadcast
+     * @param rooms The admitted rooms this recorder is attached to
+     * @param user The sender
+     * @param message The message as sent (before filters)
+     */
+    void recordBroadcast(const vector<ChatRoom*>& rooms, Users* user, const string& message);
+
+    /**
+     * @brief Record a notification that is not part of a join or leave
+     * @param room The notifying room
+     * @param message The notification
+     */
+    void recordNotify(ChatRoom* room, const string& message);
+
+    /**
+     * @brief Drop a destroyed user's ID
+     * @param user The user
+     */
+    void forgetUser(Users* user);
+
+    /**
+     * @brief Drop a destroyed room's ID
+     * @param room The room
+     */
+    void forgetRoom(ChatRoom* room);
+
+    /**
+     * @brief Write buffered records to the file
+     */
+    void flush();
+
+    /**
+     * @brief Get the number of operations recorded (DEFINE records excluded)
+     * @return Operation count
+     */
+    uint64_t getRecordCount() const;
+
+    /**
+     * @brief Get the trace size so far, buffered bytes included
+     * @return Bytes
+     */
+    uint64_t getBytesRecorded() const;
+
+private:
+    TraceRecorder(const TraceRecorder&);
+    TraceRecorder& operator=(const TraceRecorder&);
+
+    void recordMember(TraceOp::Op op, ChatRoom* room, Users* user);
+    void beginRecord(TraceOp::Op op);
+    void endRecord();
+    uint32_t roomId(ChatRoom* room);
+    uint32_t userId(Users* user);
+    void writeOut();
+
+    mutable mutex lock;
+    FILE* file;
+    string buffer;
+    int64_t lastUs;
+    uint64_t records;
+    uint64_t written;
+    unordered_map<ChatRoom*, uint32_t> rooms;
+    unordered_map<Users*, uint32_t> users;
+    uint32_t nextRoom;
+    uint32_t nextUser;
+};
+
+#endif
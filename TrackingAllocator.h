@@ -0,0 +1,103 @@
+/**
+ * @file TrackingAllocator.h
+ * @brief Standard allocator that charges a MemoryAccount
+ */
+
+#ifndef TRACKINGALLOCATOR_H
+#define TRACKINGALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+#include <string>
+#include "MemoryAccount.h"
+
+using namespace std;
+
+/**
+ * @class TrackingAllocator
+ * @brief Allocates with operator new and charges the owner's account
+ * @tparam T The type of object allocated
+ *
+ * A container built with TrackingAllocator(&account, category) charges
+ * every block it allocates, nodes and bucket arrays included. A null
+ * account allocates untracked. For a sampled account each block carries
+ * its charge in a small header, so the free uncharges exactly what the
+ * allocation charged. The allocator is not propagated on assignment or
+ * swap, so a container keeps charging its owner; swapping containers of
+ * different owners is not allowed.
+ */
+template <typename T>
+class TrackingAllocator
+{
+public:
+    typedef T value_type;
+
+    TrackingAllocator() : account(nullptr), category(MEM_HISTORY) {}
+    TrackingAllocator(MemoryAccount* owner, MemoryCategory tag) : account(owner), category(tag) {}
+
+    template <typename U>
+    TrackingAllocator(const TrackingAllocator<U>& other) : account(other.account), category(other.category) {}
+
+    T* allocate(size_t n)
+    {
+        size_t bytes = n * sizeof(T);
+        if (!account || !account->isSampled())
+        {
+            T* block = static_cast<T*>(::operator new(bytes));
+            if (account)
+            {
+                account->allocated(category, bytes);
+            }
+            return block;
+        }
+        char* raw = static_cast<char*>(::operator new(bytes + CHARGE_HEADER));
+        *reinterpret_cast<size_t*>(raw) = account->allocated(category, bytes);
+        return reinterpret_cast<T*>(raw + CHARGE_HEADER);
+    }
+
+    void deallocate(T* block, size_t n)
+    {
+        if (!account || !account->isSampled())
+        {
+            if (account)
+            {
+                account->released(category, n * sizeof(T));
+            }
+            ::operator delete(block);
+            return;
+        }
+        char* raw = reinterpret_cast<char*>(block) - CHARGE_HEADER;
+        account->released(category, *reinterpret_cast<size_t*>(raw));
+        ::operator delete(raw);
+    }
+
+    MemoryAccount* getAccount() const { return account; }
+    MemoryCategory getCategory() const { return category; }
+
+    template <typename U>
+    bool operator==(const TrackingAllocator<U>& other) const
+    {
+        return account == other.account && category == other.category;
+    }
+
+    template <typename U>
+    bool operator!=(const TrackingAllocator<U>& other) const
+    {
+        return !(*this == other);
+    }
+
+private:
+    // Keeps the block after the header as aligned as operator new's
+    static const size_t CHARGE_HEADER = alignof(max_align_t);
+
+    MemoryAccount* account;
+    MemoryCategory category;
+
+    template <typename U>
+    friend class TrackingAllocator;
+};
+
+// A string whose heap buffer is charged like its container
+typedef basic_string<char, char_traits<char>, TrackingAllocator<char> > TrackedString;
+
+#endif
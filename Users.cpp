@@ -9,15 +9,147 @@
 #include "Command.h"
 #include "SendMessageCommand.h"
 #include "LogMessageCommand.h"
+#include "SendTargetedMessageCommand.h"
+#include "PublishMessageCommand.h"
+#include "BroadcastCommand.h"
+#include "ChatHistory.h"
+#include <algorithm>
 #include <iostream>
+#include <mutex>
 
 using namespace std;
 
-void Users::send(string message, ChatRoom *room)
+namespace {
+
+// Dense IDs are recycled so recipient bitmaps stay as small as the live user count
+mutex denseIdLock;
+vector<uint32_t> freeDenseIds;
+uint32_t nextDenseId = 0;
+
+uint32_t acquireDenseId()
+{
+    lock_guard<mutex> hold(denseIdLock);
+    if (freeDenseIds.empty())
+    {
+        return nextDenseId++;
+    }
+    uint32_t id = freeDenseIds.back();
+    freeDenseIds.pop_back();
+    return id;
+}
+
+void releaseDenseId(uint32_t id)
+{
+    lock_guard<mutex> hold(denseIdLock);
+    freeDenseIds.push_back(id);
+}
+
+} // namespace
+
+Users::Users(string userName)
+    : name(userName), memory(MemoryAccount::USER, userName),
+      commandQueue(TrackingAllocator<Command*>(&memory, MEM_COMMANDS)),
+      notifications(TrackingAllocator<TrackedString>(&memory, MEM_NOTIFICATIONS)),
+      sendPriority(PRIORITY_NORMAL), denseId(acquireDenseId()),
+      identity(make_shared<SenderIdentity>(this, userName))
+{
+}
+
+Users::~Users()
+{
+    // Histories keep the identity (and the last name) but drop the pointer
+    identity->retire();
+    // detachUser never calls back into removeChatRoom, so iterating is safe
+    for (ChatRoom* room : chatRooms)
+    {
+        room->detachUser(this);
+    }
+    chatRooms.clear();
+    // Rooms left earlier, or only observed, still hold this user as an observer
+    vector<ChatRoom*> observed = subscriptions;
+    for (ChatRoom* room : observed)
+    {
+        room->detachUser(this);
+    }
+    subscriptions.clear();
+    // Queued and parked sends must not run with a dangling sender or recipient
+    DeliveryScheduler::dropUserEverywhere(this);
+    AdmissionController::dropUserEverywhere(this);
+    releaseDenseId(denseId);
+}
+
+SendResult Users::send(string message, ChatRoom *room)
+{
+    return send(message, room, 0);
+}
+
+SendResult Users::send(string message, ChatRoom *room, uint64_t messageId)
+{
+    // A retry costs one lookup instead of a fan-out and history write
+    if (messageId != 0 && room->isDuplicateMessage(this, messageId))
+    {
+        return SEND_DELIVERED;
+    }
+    
+    // Admission control runs before any command is allocated
+    AdmissionController* admission = room->getAdmissionController();
+    if (admission)
+    {
+        AdmissionResult admitted = admission->admit(this, room, message, messageId);
+        if (admitted != ADMIT_NOW)
+        {
+            return admitted == ADMIT_QUEUED ? SEND_QUEUED : SEND_SHED;
+        }
+    }
+    
+    bool delivered = dispatch(message, room, messageId);
+    
+    if (admission)
+    {
+        admission->release();
+    }
+    return delivered ? SEND_DELIVERED : SEND_REJECTED;
+}
+
+bool Users::dispatch(const string& message, ChatRoom *room, uint64_t messageId)
 {
+    // Admitted (now or from the parked queue): this is what a replay sends
+    TraceRecorder* recorder = room->getTraceRecorder();
+    if (recorder)
+    {
+        recorder->recordSend(room, this, message, messageId);
+    }
+    
+    // Filters see the message before any command exists, so a rejected
+    // message is neither delivered nor saved
+    string text = message;
+    if (room->screenMessage(text, this) == FILTER_REJECT)
+    {
+        return false;
+    }
+    
+    // Marked now, not when the log command runs: a retry that arrives while
+    // the commands wait in a DeliveryScheduler must already be recognised
+    if (messageId != 0)
+    {
+        room->recordMessageId(this, messageId);
+    }
+    
+    // Large rooms: write once, members pull it (see ChatRoom::deliverPending)
+    if (room->deliversOnRead())
+    {
+        Command* publishCmd = new PublishMessageCommand(room, text, this, messageId);
+        publishCmd->setPriority(sendPriority);
+        addCommand(publishCmd);
+        executeAll();
+        return true;
+    }
+    
     // Create commands for sending and saving the message
-    Command* sendCmd = new SendMessageCommand(room, message, this);
-    Command* saveCmd = new LogMessageCommand(room, message, this);
+    Command* sendCmd = new SendMessageCommand(room, text, this, messageId);
+    Command* saveCmd = new LogMessageCommand(room, text, this, messageId);
+    sendCmd->setPriority(sendPriority);
+    saveCmd->setPriority(sendPriority);
     
     // Add commands to the queue
     addCommand(sendCmd);
@@ -25,19 +157,217 @@ void Users::send(string message, ChatRoom *room)
     
     // Execute all commands
     executeAll();
+    return true;
+}
+
+size_t Users::broadcast(const string& message, const vector<ChatRoom*>& rooms)
+{
+    vector<ChatRoom*> targets;
+    for (ChatRoom* room : rooms)
+    {
+        if (find(targets.begin(), targets.end(), room) == targets.end())
+        {
+            targets.push_back(room);
+        }
+    }
+    
+    // One post per controller: it admits or sheds all of its rooms together
+    vector<AdmissionController*> decided;
+    vector<AdmissionController*> admitted;
+    for (ChatRoom* room : targets)
+    {
+        AdmissionController* admission = room->getAdmissionController();
+        if (!admission || find(decided.begin(), decided.end(), admission) != decided.end())
+        {
+            continue;
+        }
+        decided.push_back(admission);
+        vector<ChatRoom*> group;
+        for (ChatRoom* other : targets)
+        {
+            if (other->getAdmissionController() == admission)
+            {
+                group.push_back(other);
+            }
+        }
+        if (admission->admitBroadcast(this, group) == ADMIT_NOW)
+        {
+            admitted.push_back(admission);
+        }
+    }
+    
+    vector<ChatRoom*> merged;
+    vector<ChatRoom*> traced;
+    size_t posted = 0;
+    for (ChatRoom* room : targets)
+    {
+        AdmissionController* admission = room->getAdmissionController();
+        if (admission && find(admitted.begin(), admitted.end(), admission) == admitted.end())
+        {
+            continue;
+        }
+        if (room->getTraceRecorder())
+        {
+            traced.push_back(room);
+        }
+        
+        string text = message;
+        FilterVerdict verdict = room->screenMessage(text, this);
+        if (verdict == FILTER_ALLOW)
+        {
+            merged.push_back(room);
+            posted++;
+        }
+        else if (verdict == FILTER_REWRITTEN)
+        {
+            // This room's version differs: it cannot share the payload
+            if (room->deliversOnRead())
+            {
+                Command* publishCmd = new PublishMessageCommand(room, text, this);
+                publishCmd->setPriority(sendPriority);
+                addCommand(publishCmd);
+                posted++;
+                continue;
+            }
+            Command* sendCmd = new SendMessageCommand(room, text, this);
+            Command* saveCmd = new LogMessageCommand(room, text, this);
+            sendCmd->setPriority(sendPriority);
+            saveCmd->setPriority(sendPriority);
+            addCommand(sendCmd);
+            addCommand(saveCmd);
+            posted++;
+        }
+    }
+    
+    // One record per recorder, listing the admitted rooms it is attached to
+    while (!traced.empty())
+    {
+        TraceRecorder* recorder = traced.front()->getTraceRecorder();
+        vector<ChatRoom*>::iterator others = stable_partition(traced.begin(), traced.end(),
+            [recorder](ChatRoom* room) { return room->getTraceRecorder() == recorder; });
+        recorder->recordBroadcast(vector<ChatRoom*>(traced.begin(), others), this, message);
+        traced.erase(traced.begin(), others);
+    }
+    
+    if (!merged.empty())
+    {
+        Command* broadcastCmd = new BroadcastCommand(merged, message, this);
+        broadcastCmd->setPriority(sendPriority);
+        addCommand(broadcastCmd);
+    }
+    executeAll();
+    
+    for (AdmissionController* admission : admitted)
+    {
+        admission->release();
+    }
+    return posted;
+}
+
+size_t Users::broadcastToAllRooms(const string& message)
+{
+    // Copy: delivery may change this user's room list
+    vector<ChatRoom*> rooms = chatRooms;
+    return broadcast(message, rooms);
+}
+
+SendResult Users::sendDirect(string message, Users *toUser, ChatRoom *room, uint64_t messageId)
+{
+    return sendTargeted(message, room, MessageVisibility::direct(this, toUser), messageId);
+}
+
+SendResult Users::sendToUsers(string message, const vector<Users*>& toUsers, ChatRoom *room, uint64_t messageId)
+{
+    MessageVisibility visibility = MessageVisibility::group(this, toUsers);
+    room->resolveRecipients(visibility);
+    return sendTargeted(message, room, visibility, messageId);
+}
+
+SendResult Users::sendToTag(string message, const string& tag, ChatRoom *room, uint64_t messageId)
+{
+    // Resolve the tag now so the log records who actually received it
+    MessageVisibility visibility = MessageVisibility::tagged(this, tag);
+    room->resolveRecipients(visibility);
+    return sendTargeted(message, room, visibility, messageId);
+}
+
+SendResult Users::sendTargeted(const string& message, ChatRoom *room, const MessageVisibility& visibility,
+                               uint64_t messageId)
+{
+    // Same gates as send(): a private message is no cheaper to flood with
+    if (messageId != 0 && room->isDuplicateMessage(this, messageId))
+    {
+        return SEND_DELIVERED;
+    }
+    
+    AdmissionController* admission = room->getAdmissionController();
+    if (admission)
+    {
+        AdmissionResult admitted = admission->admit(this, room, message, visibility, messageId);
+        if (admitted != ADMIT_NOW)
+        {
+            return admitted == ADMIT_QUEUED ? SEND_QUEUED : SEND_SHED;
+        }
+    }
+    
+    bool delivered = dispatchTargeted(message, room, visibility, messageId);
+    
+    if (admission)
+    {
+        admission->release();
+    }
+    return delivered ? SEND_DELIVERED : SEND_REJECTED;
+}
+
+bool Users::dispatchTargeted(const string& message, ChatRoom *room, const MessageVisibility& visibility,
+                             uint64_t messageId)
+{
+    TraceRecorder* recorder = room->getTraceRecorder();
+    if (recorder)
+    {
+        recorder->recordTargeted(room, this, message, visibility, messageId);
+    }
+    
+    string text = message;
+    if (room->screenMessage(text, this) == FILTER_REJECT)
+    {
+        return false;
+    }
+    
+    if (messageId != 0)
+    {
+        room->recordMessageId(this, messageId);
+    }
+    
+    // Targeted delivery goes through the same send/log command pair as send()
+    Command* sendCmd = new SendTargetedMessageCommand(room, text, this, visibility);
+    Command* saveCmd = new LogMessageCommand(room, text, this, visibility);
+    sendCmd->setPriority(sendPriority);
+    saveCmd->setPriority(sendPriority);
+    addCommand(sendCmd);
+    addCommand(saveCmd);
+    executeAll();
+    return true;
 }
 
 void Users::receive(string message, Users *fromUser, ChatRoom *room)
 {
     // Display the received message
-    cout << "[" << name << " received]: " << fromUser->getName() 
+    // Pulled history may come from a sender that no longer exists
+    cout << "[" << name << " received]: " << (fromUser ? fromUser->getName() : string("(former member)"))
          << " says: " << message << endl;
 }
 
+size_t Users::catchUp(ChatRoom *room)
+{
+    return room->deliverPending(this);
+}
+
 void Users::addCommand(Command *command)
 {
     // Add command to the queue
     commandQueue.push_back(command);
+    memory.addObjects(MEM_COMMANDS, 1);
 }
 
 void Users::executeAll()
@@ -45,11 +375,18 @@ void Users::executeAll()
     // Execute all commands in the queue
     for (Command* cmd : commandQueue)
     {
+        DeliveryScheduler* scheduler = cmd->getRoom()->getDeliveryScheduler();
+        if (scheduler)
+        {
+            scheduler->enqueue(cmd); // runs (and deletes) it in priority order
+            continue;
+        }
         cmd->execute();
         delete cmd; // Clean up after execution
     }
     
     // Clear the queue after execution
+    memory.addObjects(MEM_COMMANDS, -static_cast<int64_t>(commandQueue.size()));
     commandQueue.clear();
 }
 
@@ -58,22 +395,60 @@ string Users::getName() const
     return name;
 }
 
+void Users::setName(const string& userName)
+{
+    name = userName;
+    identity->rename(userName);
+    memory.setLabel(userName);
+    // History stores senders, not names: rendered pages must be rebuilt
+    ChatHistory::invalidateAllPages();
+}
+
 void Users::update(const string& message, const string& roomName)
 {
     // Receive notification from subscribed chat room (Observer pattern)
     string notification = "[NOTIFICATION from " + roomName + "]: " + message;
-    notifications.push_back(notification);
+    notifications.push_back(TrackedString(notification.data(), notification.size(), notifications.get_allocator()));
+    memory.addObjects(MEM_NOTIFICATIONS, 1);
     cout << "[" << name << " - Notification]: " << message << " (from " << roomName << ")" << endl;
 }
 
+void Users::presenceChanged(ChatRoom* room, const vector<PresenceUpdate>& changes)
+{
+    // Ephemeral: displayed but never stored in notifications
+    static const char* statusNames[] = { "offline", "online", "away" };
+    cout << "[" << name << " - Presence in " << room->getRoomName() << "]:";
+    for (const PresenceUpdate& change : changes)
+    {
+        if (change.user->getUser() == this)
+        {
+            continue;
+        }
+        cout << " " << change.user->getName() << " " << statusNames[change.state.status()];
+        if (change.state.typing())
+        {
+            cout << " (typing)";
+        }
+    }
+    cout << endl;
+}
+
 vector<string> Users::getNotifications() const
 {
-    return notifications;
+    vector<string> copies;
+    copies.reserve(notifications.size());
+    for (const TrackedString& notification : notifications)
+    {
+        copies.push_back(string(notification.data(), notification.size()));
+    }
+    return copies;
 }
 
 void Users::clearNotifications()
 {
+    memory.addObjects(MEM_NOTIFICATIONS, -static_cast<int64_t>(notifications.size()));
     notifications.clear();
+    notifications.shrink_to_fit(); // clearing is how a user gives the memory back
 }
 
 void Users::addChatRoom(ChatRoom* room)
@@ -81,7 +456,45 @@ void Users::addChatRoom(ChatRoom* room)
     chatRooms.push_back(room);
 }
 
+void Users::removeChatRoom(ChatRoom* room)
+{
+    vector<ChatRoom*>::iterator it = find(chatRooms.begin(), chatRooms.end(), room);
+    if (it != chatRooms.end())
+    {
+        chatRooms.erase(it);
+    }
+}
+
+void Users::addSubscription(ChatRoom* room)
+{
+    subscriptions.push_back(room);
+}
+
+void Users::removeSubscription(ChatRoom* room)
+{
+    vector<ChatRoom*>::iterator it = find(subscriptions.begin(), subscriptions.end(), room);
+    if (it != subscriptions.end())
+    {
+        subscriptions.erase(it);
+    }
+}
+
 vector<ChatRoom*> Users::getChatRooms() const
 {
     return chatRooms;
+}
+
+void Users::setSendPriority(MessagePriority priority)
+{
+    sendPriority = priority;
+}
+
+MessagePriority Users::getSendPriority() const
+{
+    return sendPriority;
+}
+
+TokenBucket& Users::getSendBucket()
+{
+    return sendBucket;
 }
\ No newline at end of file
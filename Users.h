@@ -9,12 +9,31 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
 #include "Observer.h"
+#include "TrackingAllocator.h"
+#include "SenderIdentity.h"
+#include "AdmissionController.h"
+#include "PresenceChannel.h"
+#include "MessagePriority.h"
 
 using namespace std;
 
 class ChatRoom;
 class Command;
+struct MessageVisibility;
+
+/**
+ * @enum SendResult
+ * @brief Outcome of Users::send and the targeted sends
+ */
+enum SendResult
+{
+    SEND_DELIVERED,   // delivered now, or earlier under the same message ID
+    SEND_QUEUED,      // parked by admission control until drainDeferred()
+    SEND_SHED,        // refused by admission control
+    SEND_REJECTED     // rejected by one of the room's filters
+};
 
 /**
  * @class Users
@@ -24,33 +43,127 @@ class Command;
  * - Colleague: Communicates through ChatRoom mediator (Mediator pattern)
  * - Invoker: Creates and executes commands (Command pattern)
  * - Observer: Receives notifications from chat rooms (Observer pattern)
+ * - PresenceListener: Receives coalesced presence diffs (not stored)
  */
-class Users : public Observer
+class Users : public Observer, public PresenceListener
 {
 protected:
     vector<ChatRoom*> chatRooms;
+    vector<ChatRoom*> subscriptions;    // rooms notifying this user, members or not
     string name;
-    vector<Command*> commandQueue;
-    vector<string> notifications; // Store notifications for this user
+    MemoryAccount memory;         // Charged by the queue and notifications below
+    vector<Command*, TrackingAllocator<Command*> > commandQueue;
+    vector<TrackedString, TrackingAllocator<TrackedString> > notifications; // Store notifications for this user
+    TokenBucket sendBucket;       // Per-user rate limit state (AdmissionController)
+    MessagePriority sendPriority; // Class of this user's commands (DeliveryScheduler)
+    uint32_t denseId;             // Small reusable ID for RecipientSet bitmaps
+    SenderHandle identity;        // Outlives the user in every history it wrote to
 
 public:
     /**
      * @brief Constructor
      * @param userName The name of the user
      */
-    Users(string userName) : name(userName) {}
+    Users(string userName);
     
     /**
-     * @brief Virtual destructor
+     * @brief Virtual destructor; leaves every room this user is still in
      */
-    virtual ~Users() {} 
+    virtual ~Users();
     
     /**
      * @brief Send a message to a chat room (Invoker in Command pattern)
      * @param message The message to send
      * @param room The chat room to send the message to
+     * @return SEND_DELIVERED, or why it was not delivered now
+     */
+    SendResult send(string message, ChatRoom* room);
+    
+    /**
+     * @brief Idempotent send: a retry with the same ID is dropped before fan-out
+     * @param message The message to send
+     * @param room The chat room to send the message to
+     * @param messageId Client-supplied message ID, unique per sender (0 disables dedupe)
+     * @return SEND_DELIVERED if it was delivered now or had already been
+     *         delivered, otherwise why it was not
+     */
+    SendResult send(string message, ChatRoom* room, uint64_t messageId);
+    
+    /**
+     * @brief Trace the send, run the room's filters, record the message ID, then queue and
+     *        execute the send/log commands, or a single publish command when
+     *        the room delivers on read (no admission control)
+     * @param message The message to send
+     * @param room The chat room to send the message to
+     * @param messageId Client-supplied message ID (0 if none)
+     * @return false if a filter rejected the message
+     */
+    bool dispatch(const string& message, ChatRoom* room, uint64_t messageId = 0);
+    
+    /**
+     * @brief dispatch() for a targeted send: filters, message ID, then the
+     *        targeted send/log commands (no admission control)
+     * @param message The message to send
+     * @param room The chat room to send through
+     * @param visibility The resolved audience
+     * @param messageId Client-supplied message ID (0 if none)
+     * @return false if a filter rejected the message
+     */
+    bool dispatchTargeted(const string& message, ChatRoom* room, const MessageVisibility& visibility,
+                          uint64_t messageId = 0);
+    
+    /**
+     * @brief Post one message to several rooms with a single merged fan-out
+     * @param message The message to send
+     * @param rooms The target rooms (duplicates are ignored)
+     * @return Number of rooms the message was posted to
+     *
+     * Each room's filters still apply, and each admission controller
+     * admits the broadcast once for all of its rooms or sheds it from all
+     * of them (AdmissionController::admitBroadcast; it is never queued). The
+     * message is copied once, every distinct member of the target rooms
+     * receives it once, and then each room saves it. A room whose
+     * filters rewrite the message gets a separate ordinary send (or
+     * publish, for a room that delivers on read) with its own version.
+     */
+    size_t broadcast(const string& message, const vector<ChatRoom*>& rooms);
+    
+    /**
+     * @brief Post one message to every room this user is in (see broadcast)
+     * @param message The message to send
+     * @return Number of rooms the message was posted to
+     */
+    size_t broadcastToAllRooms(const string& message);
+    
+    /**
+     * @brief Send a private message to one member of a room
+     * @param message The message to send
+     * @param toUser The recipient
+     * @param room The chat room both users belong to
+     * @param messageId Client-supplied message ID (0 disables dedupe)
+     * @return Like send()
+     */
+    SendResult sendDirect(string message, Users* toUser, ChatRoom* room, uint64_t messageId = 0);
+    
+    /**
+     * @brief Send a message to an explicit list of room members
+     * @param message The message to send
+     * @param toUsers The recipients
+     * @param room The chat room the recipients belong to
+     * @param messageId Client-supplied message ID (0 disables dedupe)
+     * @return Like send()
      */
-    void send(string message, ChatRoom* room);
+    SendResult sendToUsers(string message, const vector<Users*>& toUsers, ChatRoom* room, uint64_t messageId = 0);
+    
+    /**
+     * @brief Send a message to every room member carrying a tag
+     * @param message The message to send
+     * @param tag The role or tag name
+     * @param room The chat room whose tag index is used
+     * @param messageId Client-supplied message ID (0 disables dedupe)
+     * @return Like send()
+     */
+    SendResult sendToTag(string message, const string& tag, ChatRoom* room, uint64_t messageId = 0);
     
     /**
      * @brief Receive a message from another user (Colleague in Mediator pattern)
@@ -58,7 +171,14 @@ public:
      * @param fromUser The user who sent the message
      * @param room The chat room where the message was sent
      */
-    void receive(string message, Users* fromUser, ChatRoom* room);
+    virtual void receive(string message, Users* fromUser, ChatRoom* room);
+    
+    /**
+     * @brief Pull the messages published in a large room since this user last looked
+     * @param room A room this user is a member of
+     * @return Number of messages received
+     */
+    size_t catchUp(ChatRoom* room);
     
     /**
      * @brief Add a command to the queue
@@ -67,7 +187,8 @@ public:
     void addCommand(Command* command);
     
     /**
-     * @brief Execute all commands in the queue
+     * @brief Execute all commands in the queue; commands for a room with a
+     *        DeliveryScheduler are handed to it instead
      */
     void executeAll();
     
@@ -77,6 +198,12 @@ public:
      */
     string getName() const;
     
+    /**
+     * @brief Change the user's display name (history re-renders with it)
+     * @param userName The new name
+     */
+    void setName(const string& userName);
+    
     /**
      * @brief Update method for Observer pattern - receives notifications
      * @param message The notification message
@@ -84,6 +211,13 @@ public:
      */
     void update(const string& message, const string& roomName) override;
     
+    /**
+     * @brief Receive a coalesced presence diff from a room
+     * @param room The room the diff belongs to
+     * @param changes Latest state of each changed user
+     */
+    void presenceChanged(ChatRoom* room, const vector<PresenceUpdate>& changes) override;
+    
     /**
      * @brief Get all notifications for this user
      * @return Vector of notification strings
@@ -101,10 +235,79 @@ public:
      */
     void addChatRoom(ChatRoom* room);
     
+    /**
+     * @brief Remove a chat room from this user's list
+     * @param room The chat room to remove
+     */
+    void removeChatRoom(ChatRoom* room);
+    
+    /**
+     * @brief Note a room this user observes (called by ChatRoom::subscribe)
+     * @param room The chat room
+     */
+    void addSubscription(ChatRoom* room);
+    
+    /**
+     * @brief Forget an observed room (called by ChatRoom::unsubscribe and ~ChatRoom)
+     * @param room The chat room
+     */
+    void removeSubscription(ChatRoom* room);
+    
     /**
      * @brief Get all chat rooms this user is part of
      * @return Vector of chat room pointers
      */
     vector<ChatRoom*> getChatRooms() const;
+    
+    /**
+     * @brief Get this user's rate limit state
+     * @return Reference to the user's token bucket
+     */
+    TokenBucket& getSendBucket();
+    
+    /**
+     * @brief Set the priority class of this user's sends (e.g. HIGH for admins)
+     * @param priority The priority class
+     */
+    void setSendPriority(MessagePriority priority);
+    
+    /**
+     * @brief Get the priority class of this user's sends
+     * @return The priority class
+     */
+    MessagePriority getSendPriority() const;
+    
+    /**
+     * @brief Get this user's dense ID (unique among live users, reused after destruction)
+     * @return The ID
+     */
+    uint32_t getDenseId() const { return denseId; }
+    
+    /**
+     * @brief Get the memory account charged by this user's queue and notifications
+     * @return The account
+     */
+    MemoryAccount& getMemoryAccount() { return memory; }
+    
+    /**
+     * @brief Get the identity histories record for this user's messages
+     * @return Shared identity (renamed with the user, retired when it is destroyed)
+     */
+    const SenderHandle& getIdentity() const { return identity; }
+
+private:
+    Users(const Users&);
+    Users& operator=(const Users&);
+    
+    /**
+     * @brief Dedupe and admission control for a targeted send, as in send()
+     * @param message The message to send
+     * @param room The chat room to send through
+     * @param visibility The resolved audience
+     * @param messageId Client-supplied message ID (0 if none)
+     * @return false if shed, queued or rejected by a filter
+     */
+    SendResult sendTargeted(const string& message, ChatRoom* room, const MessageVisibility& visibility,
+                      uint64_t messageId);
 };
 #endif
\ No newline at end of file